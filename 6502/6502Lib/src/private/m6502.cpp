@@ -1,5 +1,10 @@
+#include <stddef.h>
+#include <type_traits>
 #include "m6502.h"
 
+static_assert( std::is_standard_layout< m6502::CPU >::value && offsetof( m6502::CPU, PS ) == 0,
+	"CPU::PS finds its CPU at its own address" );
+
 #define ASSERT( Condition, Text ) { if ( !Condition ) { throw -1; } }
 
 m6502::s32 m6502::CPU::Execute( s32 Cycles, Mem & memory )
@@ -143,7 +148,7 @@ m6502::s32 m6502::CPU::Execute( s32 Cycles, Mem & memory )
 	*	Setting bits 4 & 5 on the stack */
 	auto PushPSToStack = [&Cycles, &memory, this]( )
 	{
-		Byte PSStack = PS | BreakFlagBit | UnusedFlagBit;		
+		Byte PSStack = GetPS() | BreakFlagBit | UnusedFlagBit;		
 		PushByteOntoStack( Cycles, PSStack, memory );
 	};
 
@@ -151,7 +156,7 @@ m6502::s32 m6502::CPU::Execute( s32 Cycles, Mem & memory )
 	*	Clearing bits 4 & 5 (Break & Unused) */
 	auto PopPSFromStack = [&Cycles, &memory, this]()
 	{
-		PS = PopByteFromStack( Cycles, memory );
+		SetPS( PopByteFromStack( Cycles, memory ) );
 		Flag.B = false;
 		Flag.Unused = false;
 	};
@@ -1033,6 +1038,7 @@ m6502::s32 m6502::CPU::Execute( s32 Cycles, Mem & memory )
 	}
 
 	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
 	return NumCyclesUsed;
 }
 
@@ -1138,6 +1144,22 @@ m6502::Word m6502::CPU::AddrIndirectY_6( s32& Cycles, const Mem& memory )
 	return EffectiveAddrY;
 }
 
+m6502::s32 m6502::CPU::ServiceInterrupts( Mem& memory )
+{
+	constexpr s32 InterruptCycles = 7;
+	const bool TakeIRQ = IrqLine && !Flag.I;
+	if ( !NmiPending && !TakeIRQ )
+	{
+		return 0;
+	}
+
+	// pushed with B clear, that is how a handler tells them from a BRK
+	const Byte PSStack = (Byte)((GetPS() & ~BreakFlagBit) | UnusedFlagBit);
+	EnterInterrupt( PC, PSStack, NmiPending ? NmiVector : IrqVector, memory );
+	NmiPending = false;
+	TotalCycles += InterruptCycles;
+	return InterruptCycles;
+}
 
 m6502::Word m6502::CPU::LoadPrg( const Byte* Program, u32 NumBytes, Mem& memory ) const
 {
@@ -1151,7 +1173,17 @@ m6502::Word m6502::CPU::LoadPrg( const Byte* Program, u32 NumBytes, Mem& memory
 		for ( Word i = LoadAddress; i < LoadAddress+NumBytes-2; i++ )
 		{
 			//TODO: mem copy?
-			memory[i] = Program[At++];
+			memory.Data[i] = Program[At++];
+			memory.MarkWritten( i );
+		}
+
+		if ( memory.Decoded )
+		{
+			memory.Decoded->Flush();
+		}
+		if ( memory.Blocks )
+		{
+			memory.Blocks->Flush();
 		}
 	}
 
@@ -1162,5 +1194,5 @@ void m6502::CPU::PrintStatus() const
 {
 	printf( "A: %d X: %d Y: %d\n", A, X, Y );
 	printf( "PC: %d SP: %d\n", PC, SP );
-	printf( "PS: %d\n", PS );
+	printf( "PS: %d\n", GetPS() );
 }
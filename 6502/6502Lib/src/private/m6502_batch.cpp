@@ -0,0 +1,135 @@
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "m6502_batch.h"
+#include "m6502_compact.h"
+
+namespace
+{
+	using namespace m6502;
+
+	/** The jobs one thread has left, it takes from the back & thieves from the front
+	*	(a cache line each, so the threads' locks don't share one) */
+	struct alignas( 64 ) WorkQueue
+	{
+		std::mutex Lock;
+		std::deque<u32> Jobs;
+
+		bool PopBack( u32& Job )
+		{
+			std::lock_guard<std::mutex> Guard( Lock );
+			if ( Jobs.empty() )
+			{
+				return false;
+			}
+			Job = Jobs.back();
+			Jobs.pop_back();
+			return true;
+		}
+
+		bool StealFront( u32& Job )
+		{
+			std::lock_guard<std::mutex> Guard( Lock );
+			if ( Jobs.empty() )
+			{
+				return false;
+			}
+			Job = Jobs.front();
+			Jobs.pop_front();
+			return true;
+		}
+	};
+
+	void RunJob( BatchJob& Job, BatchRunner::ExecuteFunction Engine, std::unique_ptr<Mem>& Bindable )
+	{
+		Mem* Memory = Job.Memory;
+		if ( Job.Compact )
+		{
+			// made when it's first needed, most batches don't use one
+			if ( !Bindable )
+			{
+				Bindable.reset( new Mem() );
+			}
+			Job.Compact->Bind( *Bindable );
+			Memory = Bindable.get();
+		}
+
+		try
+		{
+			Job.CyclesUsed = (Job.Cpu->*Engine)( Job.Cycles, *Memory );
+			Job.Threw = false;
+		}
+		catch ( ... )
+		{
+			Job.CyclesUsed = 0;
+			Job.Threw = true;
+		}
+	}
+
+	void Work( u32 Self, std::vector<WorkQueue>& Queues, BatchJob* Jobs, BatchRunner::ExecuteFunction Engine )
+	{
+		const u32 NumQueues = (u32)Queues.size();
+		std::unique_ptr<Mem> Bindable;
+		u32 Job;
+		for ( ;; )
+		{
+			if ( Queues[Self].PopBack( Job ) )
+			{
+				RunJob( Jobs[Job], Engine, Bindable );
+				continue;
+			}
+
+			// nothing is added once the threads start, so when every queue is
+			// empty the work is done
+			bool Stole = false;
+			for ( u32 i = 1; i < NumQueues && !Stole; i++ )
+			{
+				Stole = Queues[(Self + i) % NumQueues].StealFront( Job );
+			}
+			if ( !Stole )
+			{
+				return;
+			}
+			RunJob( Jobs[Job], Engine, Bindable );
+		}
+	}
+}
+
+m6502::BatchResult m6502::BatchRunner::Run( BatchJob* Jobs, u32 NumJobs ) const
+{
+	const auto Start = std::chrono::steady_clock::now();
+
+	u32 Threads = NumThreads ? NumThreads : std::thread::hardware_concurrency();
+	Threads = Threads ? Threads : 1;
+	Threads = Threads < NumJobs ? Threads : (NumJobs ? NumJobs : 1);
+
+	std::vector<WorkQueue> Queues( Threads );
+	for ( u32 i = 0; i < NumJobs; i++ )
+	{
+		Queues[(u64)i * Threads / NumJobs].Jobs.push_back( i );
+	}
+
+	// the calling thread is the first worker
+	std::vector<std::thread> Workers;
+	for ( u32 i = 1; i < Threads; i++ )
+	{
+		Workers.emplace_back( Work, i, std::ref( Queues ), Jobs, Engine );
+	}
+	Work( 0, Queues, Jobs, Engine );
+	for ( std::thread& Worker : Workers )
+	{
+		Worker.join();
+	}
+
+	BatchResult Result;
+	for ( u32 i = 0; i < NumJobs; i++ )
+	{
+		Result.TotalCycles += Jobs[i].CyclesUsed;
+		Result.NumThrew += Jobs[i].Threw;
+	}
+	Result.Seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - Start ).count();
+	Result.CyclesPerSecond = Result.Seconds > 0 ? Result.TotalCycles / Result.Seconds : 0;
+	return Result;
+}
@@ -0,0 +1,311 @@
+#include "m6502.h"
+#include "m6502_ops.h"
+
+m6502::BlockCache::BlockCache()
+{
+	for ( Block*& B : Blocks )
+	{
+		B = nullptr;
+	}
+}
+
+m6502::BlockCache::~BlockCache()
+{
+	Detach();
+	FreeNative();
+}
+
+void m6502::BlockCache::Attach( Mem& memory )
+{
+	Detach();
+	if ( memory.Blocks )
+	{
+		memory.Blocks->Detach();
+	}
+	Memory = &memory;
+	Memory->Blocks = this;
+	Flush();
+}
+
+void m6502::BlockCache::Detach()
+{
+	// the Mem may have been given to another since, e.g. by a MachinePool
+	if ( Memory && Memory->Blocks == this )
+	{
+		Memory->Blocks = nullptr;
+	}
+	Memory = nullptr;
+}
+
+void m6502::BlockCache::Flush()
+{
+	for ( const std::unique_ptr<Block>& B : Translated )
+	{
+		Blocks[B->Start] = nullptr;
+	}
+	for ( std::vector<Block*>& Overlapping : PageBlocks )
+	{
+		Overlapping.clear();
+	}
+	Translated.clear();
+	FlushPending = false;
+	FlushNative();
+}
+
+void m6502::BlockCache::InvalidateBlocks( Word Address )
+{
+	std::vector<Block*>& Overlapping = PageBlocks[Address / PAGE_SIZE];
+	for ( size_t i = 0; i < Overlapping.size(); )
+	{
+		Block* B = Overlapping[i];
+		if ( B->Valid && !B->Contains( Address ) )
+		{
+			i++;
+			continue;
+		}
+
+		// the block's memory is kept until the next Flush, as the CPU may be
+		// part way through it, or other blocks may still link to it
+		if ( B->Valid )
+		{
+			B->Valid = false;
+			Blocks[B->Start] = nullptr;
+		}
+		Overlapping[i] = Overlapping.back();
+		Overlapping.pop_back();
+	}
+}
+
+void m6502::BlockCache::InvalidateAll()
+{
+	for ( const std::unique_ptr<Block>& B : Translated )
+	{
+		if ( B->Valid )
+		{
+			B->Valid = false;
+			Blocks[B->Start] = nullptr;
+		}
+	}
+	for ( std::vector<Block*>& Overlapping : PageBlocks )
+	{
+		Overlapping.clear();
+	}
+	FlushPending = true;
+}
+
+m6502::BlockCache::Block* m6502::BlockCache::Next( Block* Previous, Word Address )
+{
+	if ( Previous && Previous->Valid )
+	{
+		for ( Block* Linked : Previous->Next )
+		{
+			if ( Linked && Linked->Valid && Linked->Start == Address )
+			{
+				return Linked;
+			}
+		}
+	}
+
+	Block* Found = Blocks[Address];
+	if ( !Found )
+	{
+		if ( FlushPending || Translated.size() >= MAX_BLOCKS )
+		{
+			Flush();
+			Previous = nullptr;
+		}
+		Found = Translate( Address );
+	}
+
+	if ( Previous && Previous->Valid )
+	{
+		for ( u32 i = NUM_LINKS - 1; i > 0; i-- )
+		{
+			Previous->Next[i] = Previous->Next[i - 1];
+		}
+		Previous->Next[0] = Found;
+	}
+	return Found;
+}
+
+m6502::BlockCache::Block* m6502::BlockCache::Translate( Word Address )
+{
+	Block* NewBlock = new Block;
+	NewBlock->Start = Address;
+	NewBlock->Length = 0;
+	NewBlock->MaxCycles = 0;
+	NewBlock->Valid = true;
+	NewBlock->RunCount = 0;
+	NewBlock->Native = nullptr;
+	for ( Block*& Linked : NewBlock->Next )
+	{
+		Linked = nullptr;
+	}
+
+	Word PC = Address;
+	for ( u32 i = 0; i < MAX_BLOCK_INSTRUCTIONS; i++ )
+	{
+		const ops::OpcodeInfo& Info = ops::Opcodes.Info[Memory->Peek( PC )];
+		NewBlock->Ops.push_back( DecodeCache::DecodeInstruction( PC, *Memory ) );
+		NewBlock->MaxCycles += Info.MaxCycles;
+		NewBlock->Length += Info.Length;
+		PC += Info.Length;
+		if ( Info.EndsBlock )
+		{
+			break;
+		}
+	}
+
+	// MAX_BLOCK_INSTRUCTIONS of 3 bytes at most, so a block overlaps 2 pages at most
+	const Word LastAddress = Address + NewBlock->Length - 1;
+	PageBlocks[Address / PAGE_SIZE].push_back( NewBlock );
+	if ( LastAddress / PAGE_SIZE != Address / PAGE_SIZE )
+	{
+		PageBlocks[LastAddress / PAGE_SIZE].push_back( NewBlock );
+	}
+
+	Blocks[Address] = NewBlock;
+	Translated.emplace_back( NewBlock );
+	return NewBlock;
+}
+
+/** Run the micro-ops of Current until it ends, a write invalidates it or,
+*	when CheckBudget is set, the cycles run out */
+template< bool CheckBudget >
+static void RunMicroOps( m6502::CPU& cpu, m6502::s32& Cycles, m6502::Mem& memory,
+	const m6502::BlockCache::Block& Current )
+{
+	using namespace m6502;
+	const BlockCache::MicroOp* Op = Current.Ops.data();
+	const BlockCache::MicroOp* End = Op + Current.Ops.size();
+	do
+	{
+		cpu.PC += Op->Length;
+		Cycles -= Op->BaseCycles;
+		Cycles += Op->Execute( cpu, memory, Op->Operand );
+		Op++;
+	} while ( Op != End && Current.Valid && (!CheckBudget || Cycles > 0) );
+}
+
+m6502::s32 m6502::CPU::ExecuteBlocks( s32 Cycles, Mem & memory )
+{
+	if ( !memory.Blocks )
+	{
+		return ExecuteTable( Cycles, memory );
+	}
+
+	BlockCache& Cache = *memory.Blocks;
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	BlockCache::Block* Current = nullptr;
+	while ( Cycles > 0 )
+	{
+		Current = Cache.Next( Current, PC );
+
+		// a write to the block itself stops it after the writing instruction
+		if ( Cycles > Current->MaxCycles )
+		{
+			// the whole block fits in the budget
+			RunMicroOps< false >( *this, Cycles, memory, *Current );
+		}
+		else
+		{
+			// the last block, stop on the same instruction Execute would
+			RunMicroOps< true >( *this, Cycles, memory, *Current );
+		}
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
+
+m6502::s32 m6502::CPU::ExecuteJit( s32 Cycles, Mem & memory )
+{
+	if ( !memory.Blocks )
+	{
+		return ExecuteTable( Cycles, memory );
+	}
+
+	BlockCache& Cache = *memory.Blocks;
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	BlockCache::Block* Current = nullptr;
+	while ( Cycles > 0 )
+	{
+		Current = Cache.Next( Current, PC );
+		if ( Cycles > Current->MaxCycles )
+		{
+			if ( !Current->Native && ++Current->RunCount == Cache.JitThreshold )
+			{
+				Cache.Compile( *Current );
+			}
+
+			if ( Current->Native )
+			{
+				Cycles -= Cache.RunNative( *Current, *this, memory );
+			}
+			else
+			{
+				RunMicroOps< false >( *this, Cycles, memory, *Current );
+			}
+		}
+		else
+		{
+			RunMicroOps< true >( *this, Cycles, memory, *Current );
+		}
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
+
+m6502::s32 m6502::CPU::ExecuteDebug( s32 Cycles, Mem & memory )
+{
+	const s32 CyclesRequested = Cycles;
+	const u64 TotalCyclesAtStart = TotalCycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	const Breakpoints* Breaks = memory.Breaks;
+	BlockCache* Cache = memory.Blocks;
+	BlockCache::Block* Current = nullptr;
+	LastStop = StopReason::Budget;
+	bool First = true;
+	while ( Cycles > 0 && LastStop == StopReason::Budget )
+	{
+		TotalCycles = TotalCyclesAtStart + (CyclesRequested - Cycles);
+
+		// only the blocks in or running into a page with breakpoints are stepped
+		bool Step = Breaks && Breaks->PageHasAny( (Byte)(PC / Mem::PAGE_SIZE) );
+		if ( !Step && Cache )
+		{
+			Current = Cache->Next( Current, PC );
+			Step = Breaks && Breaks->AnyIn( Current->Start, Current->Length );
+		}
+
+		if ( Step || !Cache )
+		{
+			if ( Breaks && !First && Breaks->IsSet( PC ) )
+			{
+				LastStop = StopReason::Breakpoint;
+				break;
+			}
+			Byte Ins = FetchByte( memory );
+			Cycles += ops::Opcodes.Info[Ins].Execute( *this, memory );
+			Current = nullptr;
+		}
+		else if ( Cycles > Current->MaxCycles )
+		{
+			RunMicroOps< false >( *this, Cycles, memory, *Current );
+		}
+		else
+		{
+			RunMicroOps< true >( *this, Cycles, memory, *Current );
+		}
+		First = false;
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles = TotalCyclesAtStart + NumCyclesUsed;
+	return NumCyclesUsed;
+}
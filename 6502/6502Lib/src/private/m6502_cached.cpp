@@ -0,0 +1,118 @@
+#include <string.h>
+#include "m6502.h"
+#include "m6502_ops.h"
+
+m6502::DecodeCache::DecodeCache()
+{
+	for ( Entry& E : Entries )
+	{
+		E.Execute = nullptr;
+	}
+	memset( CodePages, 0, sizeof( CodePages ) );
+}
+
+m6502::DecodeCache::~DecodeCache()
+{
+	Detach();
+}
+
+void m6502::DecodeCache::Attach( Mem& memory )
+{
+	Detach();
+	if ( memory.Decoded )
+	{
+		memory.Decoded->Detach();
+	}
+	Memory = &memory;
+	Memory->Decoded = this;
+	Flush();
+}
+
+void m6502::DecodeCache::Detach()
+{
+	// the Mem may have been given to another since, e.g. by a MachinePool
+	if ( Memory && Memory->Decoded == this )
+	{
+		Memory->Decoded = nullptr;
+	}
+	Memory = nullptr;
+}
+
+void m6502::DecodeCache::Flush()
+{
+	// only the pages that have been decoded into need clearing
+	for ( u32 Page = 0; Page < NUM_PAGES; Page++ )
+	{
+		if ( CodePages[Page] )
+		{
+			for ( u32 i = 0; i < PAGE_SIZE; i++ )
+			{
+				Entries[Page * PAGE_SIZE + i].Execute = nullptr;
+			}
+			CodePages[Page] = false;
+		}
+	}
+}
+
+const m6502::DecodeCache::Entry& m6502::DecodeCache::Decode( Word Address, const Mem& memory )
+{
+	Entry& Decoded = Entries[Address];
+	Decoded = DecodeInstruction( Address, memory );
+
+	// every page the instruction touches has to invalidate it when written to
+	for ( Byte i = 0; i < Decoded.Length; i++ )
+	{
+		const Word ByteAddress = Address + i;
+		CodePages[ByteAddress / PAGE_SIZE] = true;
+	}
+
+	return Decoded;
+}
+
+m6502::DecodeCache::Entry m6502::DecodeCache::DecodeInstruction( Word Address, const Mem& memory )
+{
+	const Byte Ins = memory.Peek( Address );
+	const ops::OpcodeInfo& Info = ops::Opcodes.Info[Ins];
+
+	Entry Decoded;
+	Decoded.Execute = Info.ExecuteDecoded;
+	Decoded.Length = Info.Length;
+	Decoded.BaseCycles = Info.BaseCycles;
+	Decoded.Opcode = Ins;
+	Decoded.Operand = 0;
+	for ( Byte i = 1; i < Info.Length; i++ )
+	{
+		// 6502 is little endian
+		const Word OperandAddress = Address + i;
+		Decoded.Operand |= memory.Peek( OperandAddress ) << (8 * (i - 1));
+	}
+	return Decoded;
+}
+
+m6502::s32 m6502::CPU::ExecuteCached( s32 Cycles, Mem & memory )
+{
+	if ( !memory.Decoded )
+	{
+		return ExecuteTable( Cycles, memory );
+	}
+
+	DecodeCache& Cache = *memory.Decoded;
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	while ( Cycles > 0 )
+	{
+		const DecodeCache::Entry* Ins = &Cache.Entries[PC];
+		if ( !Ins->Execute )
+		{
+			Ins = &Cache.Decode( PC, memory );
+		}
+
+		PC += Ins->Length;
+		Cycles -= Ins->BaseCycles;
+		Cycles += Ins->Execute( *this, memory, Ins->Operand );
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
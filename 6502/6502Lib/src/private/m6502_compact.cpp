@@ -0,0 +1,139 @@
+#include <string.h>
+#include "m6502_compact.h"
+
+namespace
+{
+	using namespace m6502;
+
+	void IgnoreWrite( void*, Word, Byte )
+	{
+	}
+}
+
+m6502::SharedImage::SharedImage( const Mem& Source )
+{
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		PageFrame Bytes;
+		for ( u32 i = 0; i < Mem::PAGE_SIZE; i++ )
+		{
+			Bytes.Bytes[i] = Source.Peek( (Word)(Page * Mem::PAGE_SIZE + i) );
+		}
+		const Mem::Page& Mapping = Source.Pages[Page];
+		ReadOnly[Page] = Mapping.Read && !Mapping.Write;
+
+		// at most 256 frames, it is quicker to compare them than to hash them
+		Pages[Page] = nullptr;
+		for ( const std::unique_ptr<PageFrame>& Frame : Frames )
+		{
+			if ( memcmp( Frame->Bytes, Bytes.Bytes, Mem::PAGE_SIZE ) == 0 )
+			{
+				Pages[Page] = Frame.get();
+				break;
+			}
+		}
+		if ( !Pages[Page] )
+		{
+			Frames.emplace_back( new PageFrame( Bytes ) );
+			Pages[Page] = Frames.back().get();
+		}
+	}
+}
+
+m6502::CompactMem::CompactMem( const SharedImage& image, PageArena& arena )
+	: Image( &image ), Arena( &arena )
+{
+	memset( Private, 0, sizeof( Private ) );
+}
+
+m6502::CompactMem::~CompactMem()
+{
+	Reset();
+}
+
+void m6502::CompactMem::Bind( Mem& memory )
+{
+	Bound = &memory;
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		Mem::Page& Mapping = memory.Pages[Page];
+		if ( Private[Page] )
+		{
+			Mapping = { Private[Page]->Bytes, Private[Page]->Bytes, nullptr, nullptr, this,
+				Private[Page]->Bytes };
+		}
+		else
+		{
+			Mapping = { Image->Pages[Page]->Bytes, nullptr, nullptr,
+				Image->ReadOnly[Page] ? IgnoreWrite : CopyOnWrite, this, Image->Pages[Page]->Bytes };
+		}
+	}
+
+	if ( memory.Decoded )
+	{
+		memory.Decoded->Flush();
+	}
+	if ( memory.Blocks )
+	{
+		memory.Blocks->Flush();
+	}
+}
+
+void m6502::CompactMem::Reset()
+{
+	for ( PageFrame*& Frame : Private )
+	{
+		if ( Frame )
+		{
+			Arena->Free( Frame );
+			Frame = nullptr;
+		}
+	}
+	Bound = nullptr;
+}
+
+m6502::u32 m6502::CompactMem::NumPrivatePages() const
+{
+	u32 NumPrivate = 0;
+	for ( const PageFrame* Frame : Private )
+	{
+		NumPrivate += Frame != nullptr;
+	}
+	return NumPrivate;
+}
+
+void m6502::CompactMem::Write( Word Address, Byte Value )
+{
+	const Byte Page = (Byte)(Address / Mem::PAGE_SIZE);
+	if ( Image->ReadOnly[Page] )
+	{
+		return;
+	}
+	PageFrame* Frame = Private[Page] ? Private[Page] : MakePrivate( Page );
+	Frame->Bytes[Address % Mem::PAGE_SIZE] = Value;
+}
+
+m6502::PageFrame* m6502::CompactMem::MakePrivate( Byte Page )
+{
+	PageFrame* Frame = Arena->Allocate();
+	memcpy( Frame->Bytes, Image->Pages[Page]->Bytes, Mem::PAGE_SIZE );
+	Private[Page] = Frame;
+
+	// the bound Mem may be running another machine by now; the bytes are the
+	// same as the image's, so nothing it decoded from the page is stale
+	if ( Bound && Bound->Pages[Page].Context == this )
+	{
+		Bound->Pages[Page] = { Frame->Bytes, Frame->Bytes, nullptr, nullptr, this, Frame->Bytes };
+	}
+	return Frame;
+}
+
+void m6502::CompactMem::CopyOnWrite( void* Context, Word Address, Byte Value )
+{
+	CompactMem& Machine = *static_cast<CompactMem*>( Context );
+	Machine.MakePrivate( (Byte)(Address / Mem::PAGE_SIZE) )->Bytes[Address % Mem::PAGE_SIZE] = Value;
+	if ( Machine.Bound )
+	{
+		Machine.Bound->MarkWritten( Address );
+	}
+}
@@ -0,0 +1,64 @@
+#include <string.h>
+#include "m6502.h"
+
+m6502::Breakpoints::Breakpoints()
+{
+	ClearAll();
+}
+
+m6502::Breakpoints::~Breakpoints()
+{
+	Detach();
+}
+
+void m6502::Breakpoints::Attach( Mem& memory )
+{
+	Detach();
+	if ( memory.Breaks )
+	{
+		memory.Breaks->Detach();
+	}
+	Memory = &memory;
+	Memory->Breaks = this;
+}
+
+void m6502::Breakpoints::Detach()
+{
+	// the Mem may have been given to another since, e.g. by a MachinePool
+	if ( Memory && Memory->Breaks == this )
+	{
+		Memory->Breaks = nullptr;
+	}
+	Memory = nullptr;
+}
+
+void m6502::Breakpoints::Set( Word Address )
+{
+	const u32 Page = Address / Mem::PAGE_SIZE;
+	Addresses[Address / 32] |= 1u << (Address % 32);
+	Pages[Page / 32] |= 1u << (Page % 32);
+}
+
+void m6502::Breakpoints::Clear( Word Address )
+{
+	Addresses[Address / 32] &= ~(1u << (Address % 32));
+
+	// the page keeps its bit while any of its 8 words of addresses are set
+	const u32 Page = Address / Mem::PAGE_SIZE;
+	constexpr u32 WordsPerPage = Mem::PAGE_SIZE / 32;
+	u32 Any = 0;
+	for ( u32 i = 0; i < WordsPerPage; i++ )
+	{
+		Any |= Addresses[Page * WordsPerPage + i];
+	}
+	if ( !Any )
+	{
+		Pages[Page / 32] &= ~(1u << (Page % 32));
+	}
+}
+
+void m6502::Breakpoints::ClearAll()
+{
+	memset( Pages, 0, sizeof( Pages ) );
+	memset( Addresses, 0, sizeof( Addresses ) );
+}
@@ -0,0 +1,1192 @@
+#include <exception>
+#include "m6502.h"
+#include "m6502_ops.h"
+
+#if defined( M6502_JIT ) && defined( __linux__ ) && defined( __x86_64__ )
+#define M6502_JIT_X64 1
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <initializer_list>
+#endif
+
+namespace
+{
+	/** Set when an instruction called from native code throws, it can't be
+	*	unwound through the native code so RunNative rethrows it */
+	thread_local std::exception_ptr NativeException;
+}
+
+m6502::s32 m6502::BlockCache::RunNative( const Block& B, CPU& cpu, Mem& memory )
+{
+	cpu.SyncFlags();	// the native code keeps all of PS in a register
+	const s32 CyclesUsed = B.Native( cpu, memory );
+	if ( NativeException )
+	{
+		std::exception_ptr Thrown = NativeException;
+		NativeException = nullptr;
+		std::rethrow_exception( Thrown );
+	}
+	return CyclesUsed;
+}
+
+#ifdef M6502_JIT_X64
+
+/**	The JIT for CPU::ExecuteJit
+*
+*	A block is compiled to one function, s32 Block( CPU&, Mem& ), that returns
+*	the cycles it used. While it runs the 6502 registers live in callee saved
+*	host registers & RBX points at Mem::Data:
+*
+*		A - BPL, X - R12B, Y - R13B, SP - R14B, PS - R15B
+*
+*	The common loads, stores, ALU ops, shifts, flag changes & branches are
+*	compiled inline. The rest (the stack, JSR/RTS/BRK/RTI, JMP ($nnnn) and
+*	decimal mode ADC/SBC) store the registers back to the CPU and call the
+*	same handler ExecuteBlocks would. Stores go through CPU::WriteByte so the
+*	caches are still invalidated, after each one the block checks that it is
+*	still valid and leaves early if it isn't.
+*
+*	The base cycles of every instruction are known when the block is compiled,
+*	so only the page crossing penalties are counted at run time. */
+namespace
+{
+	using namespace m6502;
+
+	enum : int
+	{
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15
+	};
+
+	constexpr int REG_A = RBP;
+	constexpr int REG_X = R12;
+	constexpr int REG_Y = R13;
+	constexpr int REG_SP = R14;
+	constexpr int REG_PS = R15;
+	constexpr int REG_MEMORY = RBX;
+
+	// the native stack frame
+	constexpr s32 SLOT_CPU = 0;
+	constexpr s32 SLOT_MEMORY = 8;
+	constexpr s32 SLOT_PENALTY = 16;		//page crossing cycles so far
+	constexpr s32 FRAME_SIZE = 24;		//keeps RSP 16 byte aligned for the calls
+
+	// x86 condition codes
+	enum : Byte
+	{
+		CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_S = 0x8
+	};
+
+	// the /digit of the 0x80 & 0x81 group and the base opcode of the r/m, reg forms
+	enum : Byte
+	{
+		ALU_ADD = 0, ALU_OR = 1, ALU_ADC = 2, ALU_AND = 4, ALU_CMP = 7
+	};
+
+	enum : Byte
+	{
+		OP_ADD = 0x00, OP_OR = 0x08, OP_ADC = 0x10, OP_AND = 0x20,
+		OP_XOR = 0x30, OP_CMP = 0x38, OP_TEST = 0x84
+	};
+
+	constexpr s32 CALL_OUT_THREW = INT32_MIN;
+
+	/** A register or a [Base + Index + Disp] memory operand */
+	struct Operand
+	{
+		bool IsMemory;
+		int Reg;
+		int Base;
+		int Index;
+		s32 Disp;
+	};
+
+	Operand R( int Reg )
+	{
+		return { false, Reg, 0, -1, 0 };
+	}
+
+	Operand M( int Base, s32 Disp )
+	{
+		return { true, 0, Base, -1, Disp };
+	}
+
+	Operand M( int Base, int Index, s32 Disp )
+	{
+		return { true, 0, Base, Index, Disp };
+	}
+
+	/** Just enough of an x86-64 assembler for the JIT */
+	class Emitter
+	{
+	public:
+		enum : u32
+		{
+			WIDE = 1,		//64 bit operands
+			BYTE_REG = 2,	//the reg field is an 8 bit register
+			BYTE_RM = 4,	//the r/m field is an 8 bit register
+			OPSIZE16 = 8	//16 bit operands
+		};
+
+		std::vector<Byte> Bytes;
+
+		void Emit8( Byte Value )
+		{
+			Bytes.push_back( Value );
+		}
+
+		void Emit16( u32 Value )
+		{
+			Emit8( Value & 0xFF );
+			Emit8( (Value >> 8) & 0xFF );
+		}
+
+		void Emit32( u32 Value )
+		{
+			Emit16( Value & 0xFFFF );
+			Emit16( Value >> 16 );
+		}
+
+		void Emit64( uint64_t Value )
+		{
+			Emit32( (u32)Value );
+			Emit32( (u32)(Value >> 32) );
+		}
+
+		/** Encode an instruction with a ModRM byte, RegField is a register or a /digit */
+		void Op( std::initializer_list<Byte> Opcode, int RegField, const Operand& RM, u32 Flags = 0 )
+		{
+			if ( Flags & OPSIZE16 )
+			{
+				Emit8( 0x66 );
+			}
+
+			Byte Rex = 0x40;
+			if ( Flags & WIDE )
+			{
+				Rex |= 0x08;
+			}
+			if ( RegField & 8 )
+			{
+				Rex |= 0x04;
+			}
+			if ( RM.IsMemory )
+			{
+				if ( RM.Index >= 0 && (RM.Index & 8) )
+				{
+					Rex |= 0x02;
+				}
+				if ( RM.Base & 8 )
+				{
+					Rex |= 0x01;
+				}
+			}
+			else if ( RM.Reg & 8 )
+			{
+				Rex |= 0x01;
+			}
+
+			// without a REX prefix 4-7 are AH, CH, DH, BH rather than SPL, BPL, SIL, DIL
+			const bool NeedsRexForByteReg =
+				((Flags & BYTE_REG) && RegField >= 4 && RegField < 8) ||
+				((Flags & BYTE_RM) && !RM.IsMemory && RM.Reg >= 4 && RM.Reg < 8);
+			if ( Rex != 0x40 || NeedsRexForByteReg )
+			{
+				Emit8( Rex );
+			}
+
+			for ( Byte OpcodeByte : Opcode )
+			{
+				Emit8( OpcodeByte );
+			}
+
+			const Byte Reg = (RegField & 7) << 3;
+			if ( !RM.IsMemory )
+			{
+				Emit8( 0xC0 | Reg | (RM.Reg & 7) );
+				return;
+			}
+
+			// always [Base + Index + disp32], RSP & R12 as the base need a SIB byte
+			if ( RM.Index >= 0 || (RM.Base & 7) == RSP )
+			{
+				const Byte Index = RM.Index >= 0 ? (RM.Index & 7) : 4;
+				Emit8( 0x80 | Reg | 4 );
+				Emit8( (Index << 3) | (RM.Base & 7) );
+			}
+			else
+			{
+				Emit8( 0x80 | Reg | (RM.Base & 7) );
+			}
+			Emit32( (u32)RM.Disp );
+		}
+
+		void MovzxR32M8( int Dest, const Operand& Source )
+		{
+			Op( { 0x0F, 0xB6 }, Dest, Source, BYTE_RM );
+		}
+
+		void MovzxR32M16( int Dest, const Operand& Source )
+		{
+			Op( { 0x0F, 0xB7 }, Dest, Source );
+		}
+
+		void MovM8R8( const Operand& Dest, int Source )
+		{
+			Op( { 0x88 }, Source, Dest, BYTE_REG | BYTE_RM );
+		}
+
+		void MovR32R32( int Dest, int Source )
+		{
+			Op( { 0x8B }, Dest, R( Source ) );
+		}
+
+		void MovR64M( int Dest, const Operand& Source )
+		{
+			Op( { 0x8B }, Dest, Source, WIDE );
+		}
+
+		void MovMR64( const Operand& Dest, int Source )
+		{
+			Op( { 0x89 }, Source, Dest, WIDE );
+		}
+
+		void MovM16Imm( const Operand& Dest, Word Value )
+		{
+			Op( { 0xC7 }, 0, Dest, OPSIZE16 );
+			Emit16( Value );
+		}
+
+		void MovM32Imm( const Operand& Dest, u32 Value )
+		{
+			Op( { 0xC7 }, 0, Dest );
+			Emit32( Value );
+		}
+
+		void MovR32Imm( int Dest, u32 Value )
+		{
+			if ( Dest & 8 )
+			{
+				Emit8( 0x41 );
+			}
+			Emit8( 0xB8 + (Dest & 7) );
+			Emit32( Value );
+		}
+
+		void MovR64Imm( int Dest, const void* Value )
+		{
+			Emit8( (Dest & 8) ? 0x49 : 0x48 );
+			Emit8( 0xB8 + (Dest & 7) );
+			Emit64( (uint64_t)(uintptr_t)Value );
+		}
+
+		/** op r/m8, r8 - OP_ADD, OP_AND, OP_CMP, OP_TEST etc. */
+		void Alu8( Byte Opcode, const Operand& Dest, int Source )
+		{
+			Op( { Opcode }, Source, Dest, BYTE_REG | BYTE_RM );
+		}
+
+		/** op r8, r/m8 */
+		void Alu8RM( Byte Opcode, int Dest, const Operand& Source )
+		{
+			Op( { (Byte)(Opcode + 2) }, Dest, Source, BYTE_REG | BYTE_RM );
+		}
+
+		/** op r/m8, imm8 - ALU_ADD, ALU_AND etc. */
+		void Alu8Imm( Byte Alu, const Operand& Dest, Byte Value )
+		{
+			Op( { 0x80 }, Alu, Dest, BYTE_RM );
+			Emit8( Value );
+		}
+
+		/** op r/m32, r32 */
+		void Alu32( Byte Opcode, const Operand& Dest, int Source )
+		{
+			Op( { (Byte)(Opcode + 1) }, Source, Dest );
+		}
+
+		/** op r32, r/m32 */
+		void Alu32RM( Byte Opcode, int Dest, const Operand& Source )
+		{
+			Op( { (Byte)(Opcode + 3) }, Dest, Source );
+		}
+
+		void Alu32Imm( Byte Alu, const Operand& Dest, u32 Value )
+		{
+			Op( { 0x81 }, Alu, Dest );
+			Emit32( Value );
+		}
+
+		void Test8Imm( const Operand& Dest, Byte Value )
+		{
+			Op( { 0xF6 }, 0, Dest, BYTE_RM );
+			Emit8( Value );
+		}
+
+		void Inc8( const Operand& Dest ) { Op( { 0xFE }, 0, Dest, BYTE_RM ); }
+		void Dec8( const Operand& Dest ) { Op( { 0xFE }, 1, Dest, BYTE_RM ); }
+		void Not8( const Operand& Dest ) { Op( { 0xF6 }, 2, Dest, BYTE_RM ); }
+		void Rcl8( const Operand& Dest ) { Op( { 0xD0 }, 2, Dest, BYTE_RM ); }
+		void Rcr8( const Operand& Dest ) { Op( { 0xD0 }, 3, Dest, BYTE_RM ); }
+		void Shl8( const Operand& Dest ) { Op( { 0xD0 }, 4, Dest, BYTE_RM ); }
+		void Shr8( const Operand& Dest ) { Op( { 0xD0 }, 5, Dest, BYTE_RM ); }
+		void Inc32( const Operand& Dest ) { Op( { 0xFF }, 0, Dest ); }
+
+		void Shl8Imm( const Operand& Dest, Byte Count )
+		{
+			Op( { 0xC0 }, 4, Dest, BYTE_RM );
+			Emit8( Count );
+		}
+
+		void Setcc( Byte Condition, int Dest )
+		{
+			Setcc( Condition, R( Dest ) );
+		}
+
+		void Setcc( Byte Condition, const Operand& Dest )
+		{
+			Op( { 0x0F, (Byte)(0x90 + Condition) }, 0, Dest, BYTE_RM );
+		}
+
+		void Shl32Imm( const Operand& Dest, Byte Count )
+		{
+			Op( { 0xC1 }, 4, Dest );
+			Emit8( Count );
+		}
+
+		/** CF = bit Bit of Dest */
+		void Bt32( const Operand& Dest, Byte Bit )
+		{
+			Op( { 0x0F, 0xBA }, 4, Dest );
+			Emit8( Bit );
+		}
+
+		void Push( int Reg )
+		{
+			if ( Reg & 8 )
+			{
+				Emit8( 0x41 );
+			}
+			Emit8( 0x50 + (Reg & 7) );
+		}
+
+		void Pop( int Reg )
+		{
+			if ( Reg & 8 )
+			{
+				Emit8( 0x41 );
+			}
+			Emit8( 0x58 + (Reg & 7) );
+		}
+
+		void AddRsp( Byte Value ) { Op( { 0x83 }, 0, R( RSP ), WIDE ); Emit8( Value ); }
+		void SubRsp( Byte Value ) { Op( { 0x83 }, 5, R( RSP ), WIDE ); Emit8( Value ); }
+
+		/** The code buffer can be anywhere, so call through RAX */
+		void Call( const void* Function )
+		{
+			MovR64Imm( RAX, Function );
+			Op( { 0xFF }, 2, R( RAX ) );
+		}
+
+		void Ret()
+		{
+			Emit8( 0xC3 );
+		}
+
+		/** @return where to patch the rel32 with Bind */
+		size_t Jcc( Byte Condition )
+		{
+			Emit8( 0x0F );
+			Emit8( 0x80 + Condition );
+			Emit32( 0 );
+			return Bytes.size() - 4;
+		}
+
+		size_t Jmp()
+		{
+			Emit8( 0xE9 );
+			Emit32( 0 );
+			return Bytes.size() - 4;
+		}
+
+		/** Point the jump at Patch to the next instruction emitted */
+		void Bind( size_t Patch )
+		{
+			const u32 Rel = (u32)(Bytes.size() - (Patch + 4));
+			memcpy( &Bytes[Patch], &Rel, sizeof( Rel ) );
+		}
+	};
+
+	/** How the JIT handles each operation, anything else is a call out */
+	enum class JitOp : Byte
+	{
+		CallOut,
+		LDA, LDX, LDY, STA, STX, STY,
+		AND, ORA, EOR, BIT, ADC, SBC, CMP, CPX, CPY,
+		INC, DEC, INX, INY, DEX, DEY,
+		ASL, LSR, ROL, ROR,
+		TAX, TAY, TXA, TYA, TSX, TXS,
+		CLC, SEC, CLD, SED, CLI, SEI, CLV, NOP,
+		BEQ, BNE, BCS, BCC, BMI, BPL, BVS, BVC,
+		JMP
+	};
+
+	enum class JitMode : Byte
+	{
+		Other,
+		Implied, Accumulator, Immediate, Relative,
+		ZeroPage, ZeroPageX, ZeroPageY, Absolute,
+		AbsoluteX, AbsoluteY, AbsoluteX_5, AbsoluteY_5,
+		IndirectX, IndirectY, IndirectY_6
+	};
+
+	template< typename Operation >
+	struct JitOpOf
+	{
+		static constexpr JitOp Value = JitOp::CallOut;
+	};
+
+	template< typename AddrMode >
+	struct JitModeOf
+	{
+		static constexpr JitMode Value = JitMode::Other;
+	};
+
+#define M6502_JIT_OP( Operation ) \
+	template<> struct JitOpOf< ops::Operation > { static constexpr JitOp Value = JitOp::Operation; };
+	M6502_JIT_OP( LDA ) M6502_JIT_OP( LDX ) M6502_JIT_OP( LDY )
+	M6502_JIT_OP( STA ) M6502_JIT_OP( STX ) M6502_JIT_OP( STY )
+	M6502_JIT_OP( AND ) M6502_JIT_OP( ORA ) M6502_JIT_OP( EOR ) M6502_JIT_OP( BIT )
+	M6502_JIT_OP( ADC ) M6502_JIT_OP( SBC )
+	M6502_JIT_OP( CMP ) M6502_JIT_OP( CPX ) M6502_JIT_OP( CPY )
+	M6502_JIT_OP( INC ) M6502_JIT_OP( DEC )
+	M6502_JIT_OP( INX ) M6502_JIT_OP( INY ) M6502_JIT_OP( DEX ) M6502_JIT_OP( DEY )
+	M6502_JIT_OP( ASL ) M6502_JIT_OP( LSR ) M6502_JIT_OP( ROL ) M6502_JIT_OP( ROR )
+	M6502_JIT_OP( TAX ) M6502_JIT_OP( TAY ) M6502_JIT_OP( TXA ) M6502_JIT_OP( TYA )
+	M6502_JIT_OP( TSX ) M6502_JIT_OP( TXS )
+	M6502_JIT_OP( CLC ) M6502_JIT_OP( SEC ) M6502_JIT_OP( CLD ) M6502_JIT_OP( SED )
+	M6502_JIT_OP( CLI ) M6502_JIT_OP( SEI ) M6502_JIT_OP( CLV ) M6502_JIT_OP( NOP )
+	M6502_JIT_OP( BEQ ) M6502_JIT_OP( BNE ) M6502_JIT_OP( BCS ) M6502_JIT_OP( BCC )
+	M6502_JIT_OP( BMI ) M6502_JIT_OP( BPL ) M6502_JIT_OP( BVS ) M6502_JIT_OP( BVC )
+	M6502_JIT_OP( JMP )
+#undef M6502_JIT_OP
+
+#define M6502_JIT_MODE( AddrMode ) \
+	template<> struct JitModeOf< ops::Addr##AddrMode > { static constexpr JitMode Value = JitMode::AddrMode; };
+	M6502_JIT_MODE( Implied ) M6502_JIT_MODE( Accumulator )
+	M6502_JIT_MODE( Immediate ) M6502_JIT_MODE( Relative )
+	M6502_JIT_MODE( ZeroPage ) M6502_JIT_MODE( ZeroPageX ) M6502_JIT_MODE( ZeroPageY )
+	M6502_JIT_MODE( Absolute ) M6502_JIT_MODE( AbsoluteX ) M6502_JIT_MODE( AbsoluteY )
+	M6502_JIT_MODE( AbsoluteX_5 ) M6502_JIT_MODE( AbsoluteY_5 )
+	M6502_JIT_MODE( IndirectX ) M6502_JIT_MODE( IndirectY ) M6502_JIT_MODE( IndirectY_6 )
+#undef M6502_JIT_MODE
+
+	struct JitOpcode
+	{
+		JitOp Operation;
+		JitMode Mode;
+	};
+
+	/** Indexed by the opcode, built from M6502_OPCODES like ops::Opcodes */
+	struct JitOpcodeTable
+	{
+		JitOpcode Info[256];
+
+		JitOpcodeTable()
+		{
+			for ( JitOpcode& Entry : Info )
+			{
+				Entry = { JitOp::CallOut, JitMode::Other };
+			}
+
+#define M6502_JIT_ENTRY( Ins, Operation, AddrMode, Cycles ) \
+			Info[CPU::Ins] = { JitOpOf< ops::Operation >::Value, JitModeOf< ops::AddrMode >::Value };
+			M6502_OPCODES( M6502_JIT_ENTRY )
+#undef M6502_JIT_ENTRY
+		}
+	};
+
+	const JitOpcodeTable JitOpcodes;
+
+	/** The N & Z flags for every value */
+	struct NZTable
+	{
+		Byte Flags[256];
+
+		NZTable()
+		{
+			for ( u32 Value = 0; Value < 256; Value++ )
+			{
+				Flags[Value] = (Value & CPU::NegativeFlagBit) | (Value == 0 ? 0x02 : 0);
+			}
+		}
+	};
+
+	const NZTable NZFlags;
+
+	// called from the native code
+
+	void JitWrite( CPU* cpu, Mem* memory, u32 Address, u32 Value )
+	{
+		cpu->WriteByte( (Byte)Value, (Word)Address, *memory );
+	}
+
+	s32 JitCallOut( CPU* cpu, Mem* memory, const BlockCache::MicroOp* Op )
+	{
+		try
+		{
+			const s32 Cycles = Op->Execute( *cpu, *memory, Op->Operand );
+			cpu->SyncFlags();
+			return Cycles;
+		}
+		catch ( ... )
+		{
+			NativeException = std::current_exception();
+			return CALL_OUT_THREW;
+		}
+	}
+
+	constexpr Byte FLAG_C = 0x01;
+	constexpr Byte FLAG_Z = 0x02;
+	constexpr Byte FLAG_I = 0x04;
+	constexpr Byte FLAG_D = 0x08;
+	constexpr Byte FLAG_V = 0x40;
+	constexpr Byte FLAG_N = 0x80;
+
+	class BlockCompiler
+	{
+	public:
+		BlockCompiler( const BlockCache::Block& B ) : Block( B )
+		{
+		}
+
+		void Compile()
+		{
+			Prologue();
+
+			Word PC = Block.Start;
+			s32 Cycles = 0;
+			for ( const BlockCache::MicroOp& Op : Block.Ops )
+			{
+				Cycles += Op.BaseCycles;
+				CompileOp( Op, PC, Cycles );
+				PC += Op.Length;
+			}
+
+			// stopped at MAX_BLOCK_INSTRUCTIONS rather than a change of PC
+			if ( !ops::Opcodes.Info[Block.Ops.back().Opcode].EndsBlock )
+			{
+				Exit( true, PC, Cycles );
+			}
+
+			Epilogue();
+		}
+
+		Emitter E;
+
+	private:
+		const BlockCache::Block& Block;
+		std::vector<size_t> Exits;
+
+		void LoadRegisters()
+		{
+			E.MovR64M( RDI, M( RSP, SLOT_CPU ) );
+			E.MovzxR32M8( REG_A, M( RDI, offsetof( CPU, A ) ) );
+			E.MovzxR32M8( REG_X, M( RDI, offsetof( CPU, X ) ) );
+			E.MovzxR32M8( REG_Y, M( RDI, offsetof( CPU, Y ) ) );
+			E.MovzxR32M8( REG_SP, M( RDI, offsetof( CPU, SP ) ) );
+
+			// pack the bool per flag of CPU::Flag into PS, clobbers ECX
+			E.MovzxR32M8( REG_PS, M( RDI, FlagOffset( 0 ) ) );
+			for ( Byte Bit = 1; Bit < 8; Bit++ )
+			{
+				E.MovzxR32M8( RCX, M( RDI, FlagOffset( Bit ) ) );
+				E.Shl32Imm( R( RCX ), Bit );
+				E.Alu32( OP_OR, R( REG_PS ), RCX );
+			}
+		}
+
+		/** RDI must be the CPU */
+		void StoreRegisters()
+		{
+			E.MovM8R8( M( RDI, offsetof( CPU, A ) ), REG_A );
+			E.MovM8R8( M( RDI, offsetof( CPU, X ) ), REG_X );
+			E.MovM8R8( M( RDI, offsetof( CPU, Y ) ), REG_Y );
+			E.MovM8R8( M( RDI, offsetof( CPU, SP ) ), REG_SP );
+
+			// and unpack it again, the host flags aren't live between instructions
+			for ( Byte Bit = 0; Bit < 8; Bit++ )
+			{
+				E.Bt32( R( REG_PS ), Bit );
+				E.Setcc( CC_B, M( RDI, FlagOffset( Bit ) ) );
+			}
+		}
+
+		/** Where the bool for bit Bit of PS is in the CPU */
+		static s32 FlagOffset( Byte Bit )
+		{
+			static_assert( sizeof( StatusFlags ) == 8 && offsetof( StatusFlags, N ) == 7,
+				"a bool per flag, in the order of their bits in PS" );
+			return (s32)(offsetof( CPU, Flag ) + Bit);
+		}
+
+		void Prologue()
+		{
+			E.Push( RBX );
+			E.Push( RBP );
+			E.Push( R12 );
+			E.Push( R13 );
+			E.Push( R14 );
+			E.Push( R15 );
+			E.SubRsp( FRAME_SIZE );
+			E.MovMR64( M( RSP, SLOT_CPU ), RDI );
+			E.MovMR64( M( RSP, SLOT_MEMORY ), RSI );
+			E.MovM32Imm( M( RSP, SLOT_PENALTY ), 0 );
+			static_assert( offsetof( Mem, Data ) == 0, "RBX points at Mem::Data" );
+			E.MovR64M( REG_MEMORY, M( RSP, SLOT_MEMORY ) );
+			LoadRegisters();
+		}
+
+		/** Every exit jumps here with the CPU in RDI & the base cycles in EAX */
+		void Epilogue()
+		{
+			for ( size_t Patch : Exits )
+			{
+				E.Bind( Patch );
+			}
+			StoreRegisters();
+			E.Alu32RM( OP_ADD, RAX, M( RSP, SLOT_PENALTY ) );
+			E.AddRsp( FRAME_SIZE );
+			E.Pop( R15 );
+			E.Pop( R14 );
+			E.Pop( R13 );
+			E.Pop( R12 );
+			E.Pop( RBP );
+			E.Pop( RBX );
+			E.Ret();
+		}
+
+		/** Leave the block having used BaseCycles plus the penalties */
+		void Exit( bool SetPC, Word PC, s32 BaseCycles )
+		{
+			E.MovR64M( RDI, M( RSP, SLOT_CPU ) );
+			if ( SetPC )
+			{
+				E.MovM16Imm( M( RDI, offsetof( CPU, PC ) ), PC );
+			}
+			E.MovR32Imm( RAX, (u32)BaseCycles );
+			Exits.push_back( E.Jmp() );
+		}
+
+		/** Leave the block if a write has invalidated it */
+		void ExitIfInvalidated( Word NextPC, s32 BaseCycles )
+		{
+			E.MovR64Imm( RAX, &Block.Valid );
+			E.Alu8Imm( ALU_CMP, M( RAX, 0 ), 0 );
+			const size_t StillValid = E.Jcc( CC_NE );
+			Exit( true, NextPC, BaseCycles );
+			E.Bind( StillValid );
+		}
+
+		void AddPenaltyCycle()
+		{
+			E.Inc32( M( RSP, SLOT_PENALTY ) );
+		}
+
+		/** N & Z from the zero extended value in EAX */
+		void SetZeroAndNegativeFlags()
+		{
+			E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~(FLAG_N | FLAG_Z) );
+			E.MovR64Imm( RCX, NZFlags.Flags );
+			E.Alu8RM( OP_OR, REG_PS, M( RCX, RAX, 0 ) );
+		}
+
+		/** Copy the host flags of the last ALU op into PS */
+		void SetFlagsFromHost( Byte Flags, bool CarryIsBorrow )
+		{
+			// all the SETcc first, the shifts & ORs change the host flags
+			E.Setcc( CarryIsBorrow ? CC_AE : CC_B, R8 );
+			E.Setcc( CC_O, R9 );
+			E.Setcc( CC_S, R10 );
+			E.Setcc( CC_E, R11 );
+			E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~Flags );
+			if ( Flags & FLAG_C )
+			{
+				E.Alu8( OP_OR, R( REG_PS ), R8 );
+			}
+			if ( Flags & FLAG_V )
+			{
+				E.Shl8Imm( R( R9 ), 6 );
+				E.Alu8( OP_OR, R( REG_PS ), R9 );
+			}
+			if ( Flags & FLAG_N )
+			{
+				E.Shl8Imm( R( R10 ), 7 );
+				E.Alu8( OP_OR, R( REG_PS ), R10 );
+			}
+			if ( Flags & FLAG_Z )
+			{
+				E.Shl8Imm( R( R11 ), 1 );
+				E.Alu8( OP_OR, R( REG_PS ), R11 );
+			}
+		}
+
+		/** The effective address into EAX, unless it is known now
+		*	@return true when the address is StaticAddress */
+		bool EmitAddress( JitMode Mode, Word Operand, Word& StaticAddress )
+		{
+			switch ( Mode )
+			{
+			case JitMode::ZeroPage:
+			case JitMode::Absolute:
+				StaticAddress = Operand;
+				return true;
+			case JitMode::ZeroPageX:
+			case JitMode::ZeroPageY:
+				E.MovzxR32M8( RAX, R( Mode == JitMode::ZeroPageX ? REG_X : REG_Y ) );
+				E.Alu8Imm( ALU_ADD, R( RAX ), (Byte)Operand );	//wraps in the zero page
+				return false;
+			case JitMode::AbsoluteX:
+			case JitMode::AbsoluteY:
+			case JitMode::AbsoluteX_5:
+			case JitMode::AbsoluteY_5:
+			{
+				const bool IndexX = Mode == JitMode::AbsoluteX || Mode == JitMode::AbsoluteX_5;
+				E.MovzxR32M8( RAX, R( IndexX ? REG_X : REG_Y ) );
+				E.Alu32Imm( ALU_ADD, R( RAX ), Operand );
+				if ( Mode == JitMode::AbsoluteX || Mode == JitMode::AbsoluteY )
+				{
+					E.Alu32Imm( ALU_CMP, R( RAX ), (Operand & 0xFF00) + 0x100 );
+					const size_t SamePage = E.Jcc( CC_B );
+					AddPenaltyCycle();
+					E.Bind( SamePage );
+				}
+				E.Alu32Imm( ALU_AND, R( RAX ), 0xFFFF );
+				return false;
+			}
+			case JitMode::IndirectX:
+				E.MovzxR32M8( RAX, R( REG_X ) );
+				E.Alu8Imm( ALU_ADD, R( RAX ), (Byte)Operand );
+				E.MovzxR32M16( RAX, M( REG_MEMORY, RAX, 0 ) );
+				return false;
+			case JitMode::IndirectY:
+			case JitMode::IndirectY_6:
+				E.MovzxR32M16( RAX, M( REG_MEMORY, Operand ) );
+				E.MovzxR32M8( RCX, R( REG_Y ) );
+				if ( Mode == JitMode::IndirectY )
+				{
+					E.MovzxR32M8( RDX, R( RAX ) );
+					E.Alu32( OP_ADD, R( RDX ), RCX );
+					E.Alu32Imm( ALU_CMP, R( RDX ), 0x100 );
+					const size_t SamePage = E.Jcc( CC_B );
+					AddPenaltyCycle();
+					E.Bind( SamePage );
+				}
+				E.Alu32( OP_ADD, R( RAX ), RCX );
+				E.Alu32Imm( ALU_AND, R( RAX ), 0xFFFF );
+				return false;
+			default:
+				return false;
+			}
+		}
+
+		/** The value the instruction reads into EAX */
+		void EmitRead( JitMode Mode, Word Operand )
+		{
+			if ( Mode == JitMode::Immediate )
+			{
+				E.MovR32Imm( RAX, Operand & 0xFF );
+				return;
+			}
+
+			Word Address;
+			if ( EmitAddress( Mode, Operand, Address ) )
+			{
+				E.MovzxR32M8( RAX, M( REG_MEMORY, Address ) );
+			}
+			else
+			{
+				E.MovzxR32M8( RAX, M( REG_MEMORY, RAX, 0 ) );
+			}
+		}
+
+		/** CPU::WriteByte( Value in ECX, Address in EDX ) */
+		void EmitWrite( Word NextPC, s32 BaseCycles )
+		{
+			E.MovR64M( RDI, M( RSP, SLOT_CPU ) );
+			E.MovR64M( RSI, M( RSP, SLOT_MEMORY ) );
+			E.Call( (const void*)&JitWrite );
+			ExitIfInvalidated( NextPC, BaseCycles );
+		}
+
+		void EmitAddressToEDX( JitMode Mode, Word Operand )
+		{
+			Word Address;
+			if ( EmitAddress( Mode, Operand, Address ) )
+			{
+				E.MovR32Imm( RDX, Address );
+			}
+			else
+			{
+				E.MovR32R32( RDX, RAX );
+			}
+		}
+
+		/** INC, DEC & the shifts on the byte in Target, leaves the result in EAX */
+		void EmitModify( JitOp Operation, int Target )
+		{
+			switch ( Operation )
+			{
+			case JitOp::INC:
+			case JitOp::DEC:
+				if ( Operation == JitOp::INC )
+				{
+					E.Inc8( R( Target ) );
+				}
+				else
+				{
+					E.Dec8( R( Target ) );
+				}
+				E.MovzxR32M8( RAX, R( Target ) );
+				SetZeroAndNegativeFlags();
+				break;
+			case JitOp::ASL:
+			case JitOp::LSR:
+				if ( Operation == JitOp::ASL )
+				{
+					E.Shl8( R( Target ) );
+				}
+				else
+				{
+					E.Shr8( R( Target ) );
+				}
+				SetFlagsFromHost( FLAG_N | FLAG_Z | FLAG_C, false );
+				E.MovzxR32M8( RAX, R( Target ) );
+				break;
+			default:	// ROL & ROR through the carry
+				E.Bt32( R( REG_PS ), 0 );
+				if ( Operation == JitOp::ROL )
+				{
+					E.Rcl8( R( Target ) );
+				}
+				else
+				{
+					E.Rcr8( R( Target ) );
+				}
+				E.Setcc( CC_B, R8 );
+				E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~FLAG_C );
+				E.Alu8( OP_OR, R( REG_PS ), R8 );
+				E.MovzxR32M8( RAX, R( Target ) );
+				SetZeroAndNegativeFlags();
+				break;
+			}
+		}
+
+		/** Run the instruction's handler, like ExecuteBlocks does */
+		void EmitCallOut( const BlockCache::MicroOp& Op, Word NextPC, s32 BaseCycles )
+		{
+			E.MovR64M( RDI, M( RSP, SLOT_CPU ) );
+			StoreRegisters();
+			E.MovM16Imm( M( RDI, offsetof( CPU, PC ) ), NextPC );
+			E.MovR64M( RSI, M( RSP, SLOT_MEMORY ) );
+			E.MovR64Imm( RDX, &Op );
+			E.Call( (const void*)&JitCallOut );
+			LoadRegisters();
+
+			E.Alu32Imm( ALU_CMP, R( RAX ), (u32)CALL_OUT_THREW );
+			const size_t DidNotThrow = E.Jcc( CC_NE );
+			Exit( false, 0, BaseCycles );
+			E.Bind( DidNotThrow );
+
+			// the handler returns the penalties as a negative number
+			E.Op( { 0x29 }, RAX, M( RSP, SLOT_PENALTY ) );
+
+			if ( ops::Opcodes.Info[Op.Opcode].EndsBlock )
+			{
+				Exit( false, 0, BaseCycles );
+			}
+			else
+			{
+				ExitIfInvalidated( NextPC, BaseCycles );
+			}
+		}
+
+		void EmitBranch( Byte Flag, bool TakenIfSet, Word Operand, Word NextPC, s32 BaseCycles )
+		{
+			const Word Target = NextPC + (SByte)Operand;
+			const bool PageChanged = (Target >> 8) != (NextPC >> 8);
+
+			E.Test8Imm( R( REG_PS ), Flag );
+			const size_t NotTaken = E.Jcc( TakenIfSet ? CC_E : CC_NE );
+			Exit( true, Target, BaseCycles + 1 + (PageChanged ? 1 : 0) );
+			E.Bind( NotTaken );
+			Exit( true, NextPC, BaseCycles );
+		}
+
+		void CompileOp( const BlockCache::MicroOp& Op, Word PC, s32 BaseCycles )
+		{
+			const JitOpcode& Ins = JitOpcodes.Info[Op.Opcode];
+			const Word NextPC = PC + Op.Length;
+			const Word Operand = Op.Operand;
+
+			switch ( Ins.Operation )
+			{
+			case JitOp::LDA:
+			case JitOp::LDX:
+			case JitOp::LDY:
+			{
+				const int Reg = Ins.Operation == JitOp::LDA ? REG_A :
+					Ins.Operation == JitOp::LDX ? REG_X : REG_Y;
+				EmitRead( Ins.Mode, Operand );
+				E.MovM8R8( R( Reg ), RAX );
+				SetZeroAndNegativeFlags();
+				break;
+			}
+			case JitOp::STA:
+			case JitOp::STX:
+			case JitOp::STY:
+			{
+				const int Reg = Ins.Operation == JitOp::STA ? REG_A :
+					Ins.Operation == JitOp::STX ? REG_X : REG_Y;
+				EmitAddressToEDX( Ins.Mode, Operand );
+				E.MovzxR32M8( RCX, R( Reg ) );
+				EmitWrite( NextPC, BaseCycles );
+				break;
+			}
+			case JitOp::AND:
+			case JitOp::ORA:
+			case JitOp::EOR:
+				EmitRead( Ins.Mode, Operand );
+				E.Alu8( Ins.Operation == JitOp::AND ? OP_AND :
+					Ins.Operation == JitOp::ORA ? OP_OR : OP_XOR, R( REG_A ), RAX );
+				E.MovzxR32M8( RAX, R( REG_A ) );
+				SetZeroAndNegativeFlags();
+				break;
+			case JitOp::BIT:
+				EmitRead( Ins.Mode, Operand );
+				E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~(FLAG_N | FLAG_V | FLAG_Z) );
+				E.MovR32R32( RCX, RAX );
+				E.Alu32Imm( ALU_AND, R( RCX ), FLAG_N | FLAG_V );
+				E.Alu8( OP_OR, R( REG_PS ), RCX );
+				E.Alu8( OP_TEST, R( REG_A ), RAX );
+				E.Setcc( CC_E, R8 );
+				E.Shl8Imm( R( R8 ), 1 );
+				E.Alu8( OP_OR, R( REG_PS ), R8 );
+				break;
+			case JitOp::ADC:
+			case JitOp::SBC:
+			{
+				// decimal mode is left to the handler (which throws)
+				E.Test8Imm( R( REG_PS ), FLAG_D );
+				const size_t Binary = E.Jcc( CC_E );
+				EmitCallOut( Op, NextPC, BaseCycles );
+				const size_t Done = E.Jmp();
+				E.Bind( Binary );
+				EmitRead( Ins.Mode, Operand );
+				if ( Ins.Operation == JitOp::SBC )
+				{
+					E.Not8( R( RAX ) );
+				}
+				E.Bt32( R( REG_PS ), 0 );
+				E.Alu8( OP_ADC, R( REG_A ), RAX );
+				SetFlagsFromHost( FLAG_N | FLAG_Z | FLAG_C | FLAG_V, false );
+				E.Bind( Done );
+				break;
+			}
+			case JitOp::CMP:
+			case JitOp::CPX:
+			case JitOp::CPY:
+			{
+				const int Reg = Ins.Operation == JitOp::CMP ? REG_A :
+					Ins.Operation == JitOp::CPX ? REG_X : REG_Y;
+				EmitRead( Ins.Mode, Operand );
+				E.Alu8( OP_CMP, R( Reg ), RAX );
+				SetFlagsFromHost( FLAG_N | FLAG_Z | FLAG_C, true );
+				break;
+			}
+			case JitOp::INC:
+			case JitOp::DEC:
+			case JitOp::ASL:
+			case JitOp::LSR:
+			case JitOp::ROL:
+			case JitOp::ROR:
+				if ( Ins.Mode == JitMode::Accumulator )
+				{
+					EmitModify( Ins.Operation, REG_A );
+				}
+				else
+				{
+					EmitAddressToEDX( Ins.Mode, Operand );
+					E.MovzxR32M8( RAX, M( REG_MEMORY, RDX, 0 ) );
+					EmitModify( Ins.Operation, RAX );
+					E.MovR32R32( RCX, RAX );
+					EmitWrite( NextPC, BaseCycles );
+				}
+				break;
+			case JitOp::INX:
+			case JitOp::DEX:
+			case JitOp::INY:
+			case JitOp::DEY:
+			{
+				const int Reg = Ins.Operation == JitOp::INX || Ins.Operation == JitOp::DEX ? REG_X : REG_Y;
+				EmitModify( Ins.Operation == JitOp::INX || Ins.Operation == JitOp::INY ?
+					JitOp::INC : JitOp::DEC, Reg );
+				break;
+			}
+			case JitOp::TAX:
+			case JitOp::TAY:
+			case JitOp::TXA:
+			case JitOp::TYA:
+			case JitOp::TSX:
+			{
+				int From = REG_A, To = REG_X;
+				switch ( Ins.Operation )
+				{
+				case JitOp::TAY: To = REG_Y; break;
+				case JitOp::TXA: From = REG_X; To = REG_A; break;
+				case JitOp::TYA: From = REG_Y; To = REG_A; break;
+				case JitOp::TSX: From = REG_SP; break;
+				default: break;
+				}
+				E.MovM8R8( R( To ), From );
+				E.MovzxR32M8( RAX, R( To ) );
+				SetZeroAndNegativeFlags();
+				break;
+			}
+			case JitOp::TXS:
+				E.MovM8R8( R( REG_SP ), REG_X );
+				break;
+			case JitOp::CLC: E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~FLAG_C ); break;
+			case JitOp::SEC: E.Alu8Imm( ALU_OR, R( REG_PS ), FLAG_C ); break;
+			case JitOp::CLD: E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~FLAG_D ); break;
+			case JitOp::SED: E.Alu8Imm( ALU_OR, R( REG_PS ), FLAG_D ); break;
+			case JitOp::CLI: E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~FLAG_I ); break;
+			case JitOp::SEI: E.Alu8Imm( ALU_OR, R( REG_PS ), FLAG_I ); break;
+			case JitOp::CLV: E.Alu8Imm( ALU_AND, R( REG_PS ), (Byte)~FLAG_V ); break;
+			case JitOp::NOP: break;
+			case JitOp::BEQ: EmitBranch( FLAG_Z, true, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BNE: EmitBranch( FLAG_Z, false, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BCS: EmitBranch( FLAG_C, true, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BCC: EmitBranch( FLAG_C, false, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BMI: EmitBranch( FLAG_N, true, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BPL: EmitBranch( FLAG_N, false, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BVS: EmitBranch( FLAG_V, true, Operand, NextPC, BaseCycles ); break;
+			case JitOp::BVC: EmitBranch( FLAG_V, false, Operand, NextPC, BaseCycles ); break;
+			case JitOp::JMP:
+				if ( Ins.Mode == JitMode::Absolute )
+				{
+					Exit( true, Operand, BaseCycles );
+				}
+				else
+				{
+					EmitCallOut( Op, NextPC, BaseCycles );
+				}
+				break;
+			case JitOp::CallOut:
+				EmitCallOut( Op, NextPC, BaseCycles );
+				break;
+			}
+		}
+	};
+}
+
+/** mmap'd executable memory, written one block at a time */
+struct m6502::BlockCache::CodeBuffer
+{
+	static constexpr size_t SIZE = 16 * 1024 * 1024;
+
+	Byte* Memory;
+	size_t Used;
+};
+
+bool m6502::BlockCache::JitSupported()
+{
+	return true;
+}
+
+bool m6502::BlockCache::Compile( Block& B )
+{
+	// the native code reads straight from Data, mirrors & devices need the page table
+	if ( !Memory || !Memory->ReadsAreFlat() )
+	{
+		return false;
+	}
+	if ( !Code )
+	{
+		void* Memory = mmap( nullptr, CodeBuffer::SIZE, PROT_READ | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( Memory == MAP_FAILED )
+		{
+			return false;
+		}
+		Code = new CodeBuffer{ (Byte*)Memory, 0 };
+	}
+
+	BlockCompiler Compiler( B );
+	Compiler.Compile();
+	const std::vector<Byte>& Native = Compiler.E.Bytes;
+	if ( Code->Used + Native.size() > CodeBuffer::SIZE )
+	{
+		return false;	// full until the next Flush
+	}
+
+	// the pages are only writable while the block is copied in
+	const uintptr_t PageSize = (uintptr_t)sysconf( _SC_PAGESIZE );
+	Byte* Destination = Code->Memory + Code->Used;
+	const uintptr_t FirstPage = (uintptr_t)Destination & ~(PageSize - 1);
+	const uintptr_t EndPage = ((uintptr_t)Destination + Native.size() + PageSize - 1) & ~(PageSize - 1);
+	if ( mprotect( (void*)FirstPage, EndPage - FirstPage, PROT_READ | PROT_WRITE ) != 0 )
+	{
+		return false;
+	}
+	memcpy( Destination, Native.data(), Native.size() );
+	mprotect( (void*)FirstPage, EndPage - FirstPage, PROT_READ | PROT_EXEC );
+
+	Code->Used = (Code->Used + Native.size() + 15) & ~(size_t)15;
+	B.Native = (NativeBlock)(void*)Destination;
+	return true;
+}
+
+void m6502::BlockCache::FlushNative()
+{
+	if ( Code )
+	{
+		Code->Used = 0;
+	}
+}
+
+void m6502::BlockCache::FreeNative()
+{
+	if ( Code )
+	{
+		munmap( Code->Memory, CodeBuffer::SIZE );
+		delete Code;
+		Code = nullptr;
+	}
+}
+
+#else
+
+bool m6502::BlockCache::JitSupported()
+{
+	return false;
+}
+
+bool m6502::BlockCache::Compile( Block& )
+{
+	return false;
+}
+
+void m6502::BlockCache::FlushNative()
+{
+}
+
+void m6502::BlockCache::FreeNative()
+{
+}
+
+#endif
@@ -0,0 +1,491 @@
+#include <limits.h>
+#include "m6502_lockstep.h"
+#include "m6502_ops.h"
+
+namespace
+{
+	using namespace m6502;
+
+	/** New for the active lanes (Mask 0xFF), Old for the rest, without a branch so the loops vectorise */
+	inline Byte Select( Byte Mask, Byte New, Byte Old )
+	{
+		return (New & Mask) | (Old & ~Mask);
+	}
+
+	inline Word Select16( Byte Mask, Word New, Word Old )
+	{
+		const Word Wide = (Word)-(s32)(Mask & 1);
+		return (New & Wide) | (Old & ~Wide);
+	}
+
+	inline s32 Cost( Byte Mask, s32 Cycles )
+	{
+		return Cycles & -(s32)(Mask & 1);
+	}
+}
+
+m6502::Lockstep::Lockstep( u32 NumberOfLanes )
+{
+	Resize( NumberOfLanes );
+}
+
+void m6502::Lockstep::Resize( u32 NumberOfLanes )
+{
+	NumLanes = NumberOfLanes;
+	for ( std::vector<Byte>* Lanes : { &A, &X, &Y, &SP, &C, &Z, &I, &D, &B, &Unused, &V, &N, &Threw, &Active } )
+	{
+		Lanes->resize( NumLanes, 0 );
+	}
+	PC.resize( NumLanes, 0 );
+	Cycles.resize( NumLanes, 0 );
+	CyclesUsed.resize( NumLanes, 0 );
+	Memory.resize( NumLanes, nullptr );
+	Members.reserve( NumLanes );
+}
+
+void m6502::Lockstep::SetLane( u32 Lane, const CPU& cpu, Mem& memory )
+{
+	CPU Synced = cpu;
+	Synced.SyncFlags();
+	A[Lane] = Synced.A;
+	X[Lane] = Synced.X;
+	Y[Lane] = Synced.Y;
+	SP[Lane] = Synced.SP;
+	PC[Lane] = Synced.PC;
+	C[Lane] = Synced.Flag.C;
+	Z[Lane] = Synced.Flag.Z;
+	I[Lane] = Synced.Flag.I;
+	D[Lane] = Synced.Flag.D;
+	B[Lane] = Synced.Flag.B;
+	Unused[Lane] = Synced.Flag.Unused;
+	V[Lane] = Synced.Flag.V;
+	N[Lane] = Synced.Flag.N;
+	Threw[Lane] = 0;
+	Memory[Lane] = &memory;
+}
+
+void m6502::Lockstep::GetLane( u32 Lane, CPU& cpu ) const
+{
+	cpu.A = A[Lane];
+	cpu.X = X[Lane];
+	cpu.Y = Y[Lane];
+	cpu.SP = SP[Lane];
+	cpu.PC = PC[Lane];
+	cpu.Flag.C = C[Lane];
+	cpu.Flag.Z = Z[Lane];
+	cpu.Flag.I = I[Lane];
+	cpu.Flag.D = D[Lane];
+	cpu.Flag.B = B[Lane];
+	cpu.Flag.Unused = Unused[Lane];
+	cpu.Flag.V = V[Lane];
+	cpu.Flag.N = N[Lane];
+	cpu.LazyFlags = 0;
+}
+
+void m6502::Lockstep::Execute( s32 CyclesToRun )
+{
+	for ( u32 Lane = 0; Lane < NumLanes; Lane++ )
+	{
+		Cycles[Lane] = Threw[Lane] ? 0 : CyclesToRun;
+	}
+
+	for ( ;; )
+	{
+		// the lane that is furthest behind leads, so the others can catch up with it
+		u32 Leader = NumLanes;
+		s32 MostCycles = 0;
+		for ( u32 Lane = 0; Lane < NumLanes; Lane++ )
+		{
+			if ( Cycles[Lane] > MostCycles )
+			{
+				MostCycles = Cycles[Lane];
+				Leader = Lane;
+			}
+		}
+		if ( Leader == NumLanes )
+		{
+			break;
+		}
+		RunGroup( Leader );
+	}
+
+	for ( u32 Lane = 0; Lane < NumLanes; Lane++ )
+	{
+		CyclesUsed[Lane] = Threw[Lane] ? 0 : CyclesToRun - Cycles[Lane];
+	}
+}
+
+void m6502::Lockstep::StepLane( u32 Lane )
+{
+	CPU cpu;
+	GetLane( Lane, cpu );
+	try
+	{
+		const Byte Ins = cpu.FetchByte( *Memory[Lane] );
+		Cycles[Lane] += ops::Opcodes.Info[Ins].Execute( cpu, *Memory[Lane] );
+		cpu.SyncFlags();
+	}
+	catch ( ... )
+	{
+		Threw[Lane] = 1;
+		Cycles[Lane] = 0;
+		return;
+	}
+
+	A[Lane] = cpu.A;
+	X[Lane] = cpu.X;
+	Y[Lane] = cpu.Y;
+	SP[Lane] = cpu.SP;
+	PC[Lane] = cpu.PC;
+	C[Lane] = cpu.Flag.C;
+	Z[Lane] = cpu.Flag.Z;
+	I[Lane] = cpu.Flag.I;
+	D[Lane] = cpu.Flag.D;
+	B[Lane] = cpu.Flag.B;
+	Unused[Lane] = cpu.Flag.Unused;
+	V[Lane] = cpu.Flag.V;
+	N[Lane] = cpu.Flag.N;
+	ScalarInstructions++;
+}
+
+bool m6502::Lockstep::SameCode( u32 Lane, u32 Leader, Byte Length ) const
+{
+	const Word At = PC[Leader];
+	for ( Byte i = 0; i < Length; i++ )
+	{
+		if ( Memory[Lane]->Peek( (Word)(At + i) ) != Memory[Leader]->Peek( (Word)(At + i) ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void m6502::Lockstep::RunGroup( u32 Leader )
+{
+	const Word GroupPC = PC[Leader];
+	const Byte FirstLength = ops::Opcodes.Info[Memory[Leader]->Peek( GroupPC )].Length;
+
+	Members.clear();
+	s32 Slack = INT_MAX;
+	for ( u32 Lane = 0; Lane < NumLanes; Lane++ )
+	{
+		const bool InGroup = Cycles[Lane] > 0 && PC[Lane] == GroupPC && SameCode( Lane, Leader, FirstLength );
+		Active[Lane] = InGroup ? 0xFF : 0;
+		if ( InGroup )
+		{
+			Members.push_back( Lane );
+			Slack = Cycles[Lane] < Slack ? Cycles[Lane] : Slack;
+		}
+	}
+
+	if ( Members.size() < MinGroupLanes )
+	{
+		// each runs to the end of its basic block, where it may meet the others
+		for ( u32 Lane : Members )
+		{
+			bool EndsBlock = false;
+			while ( !EndsBlock && Cycles[Lane] > 0 && !Threw[Lane] )
+			{
+				EndsBlock = ops::Opcodes.Info[Memory[Lane]->Peek( PC[Lane] )].EndsBlock;
+				StepLane( Lane );
+			}
+		}
+		return;
+	}
+
+	// every lane has at least Slack cycles left, counting the worst case for each instruction
+	for ( bool First = true; ; First = false )
+	{
+		const Mem& LeaderMemory = *Memory[Leader];
+		const Word At = PC[Leader];
+		const Byte Ins = LeaderMemory.Peek( At );
+		const ops::OpcodeInfo& Info = ops::Opcodes.Info[Ins];
+		if ( Slack <= 0 )
+		{
+			return;
+		}
+
+		if ( !First )
+		{
+			// a lane may have written different code
+			size_t Kept = 0;
+			for ( u32 Lane : Members )
+			{
+				if ( SameCode( Lane, Leader, Info.Length ) )
+				{
+					Members[Kept++] = Lane;
+				}
+				else
+				{
+					Active[Lane] = 0;
+				}
+			}
+			Members.resize( Kept );
+			if ( Members.size() < MinGroupLanes )
+			{
+				return;
+			}
+		}
+
+		Word Operand = 0;
+		for ( Byte i = 1; i < Info.Length; i++ )
+		{
+			Operand |= LeaderMemory.Peek( (Word)(At + i) ) << (8 * (i - 1));
+		}
+		const bool StillTogether = StepGroup( Ins, Operand, Info.Length, Info.BaseCycles );
+		Slack -= Info.MaxCycles;
+		if ( !StillTogether )
+		{
+			return;
+		}
+	}
+}
+
+bool m6502::Lockstep::StepGroup( Byte Ins, Word Operand, Byte Length, Byte BaseCycles )
+{
+	const Byte Imm = (Byte)Operand;
+	Byte* const a = A.data();
+	Byte* const x = X.data();
+	Byte* const y = Y.data();
+	Byte* const c = C.data();
+	Byte* const z = Z.data();
+	Byte* const v = V.data();
+	Byte* const n = N.data();
+	Byte* const d = D.data();
+	Word* const pc = PC.data();
+	s32* const cycles = Cycles.data();
+	const Byte* const Mask = Active.data();
+	const Word NextPC = (Word)(PC[Members[0]] + Length);
+
+	// the operations every lane does the same way, on its own registers
+	auto SetNZ = [z, n]( u32 i, Byte M, Byte Result )
+	{
+		z[i] = Select( M, Result == 0, z[i] );
+		n[i] = Select( M, Result >> 7, n[i] );
+	};
+	auto Load = [&]( Byte* Register, Byte Value )
+	{
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			Register[i] = Select( M, Value, Register[i] );
+			SetNZ( i, M, Value );
+		}
+	};
+	auto Transfer = [&]( Byte* To, const Byte* From )
+	{
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = From[i];
+			To[i] = Select( M, Value, To[i] );
+			SetNZ( i, M, Value );
+		}
+	};
+	auto Increment = [&]( Byte* Register, Byte By )
+	{
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = Register[i] + By;
+			Register[i] = Select( M, Value, Register[i] );
+			SetNZ( i, M, Value );
+		}
+	};
+	auto Compare = [&]( const Byte* Register )
+	{
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = Register[i];
+			c[i] = Select( M, Value >= Imm, c[i] );
+			SetNZ( i, M, (Byte)(Value - Imm) );
+		}
+	};
+	auto AddWithCarry = [&]( Byte Value )
+	{
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Word Sum = a[i] + Value + c[i];
+			v[i] = Select( M, (((a[i] ^ Sum) & (Value ^ Sum)) >> 7) & 1, v[i] );
+			c[i] = Select( M, Sum >> 8, c[i] );
+			a[i] = Select( M, (Byte)Sum, a[i] );
+			SetNZ( i, M, (Byte)Sum );
+		}
+	};
+	auto Branch = [&]( const Byte* Flag, Byte When )
+	{
+		const Word Target = (Word)(NextPC + (SByte)Imm);
+		const s32 Penalty = (Target >> 8) != (NextPC >> 8) ? 2 : 1;
+		u32 NumTaken = 0;
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Taken = (Flag[i] == When) & M & 1;
+			pc[i] = Select16( M, Taken ? Target : NextPC, pc[i] );
+			cycles[i] -= Cost( M, BaseCycles ) + (Taken ? Penalty : 0);
+			NumTaken += Taken;
+		}
+		LockstepInstructions += Members.size();
+		return NumTaken == 0 || NumTaken == Members.size();
+	};
+	auto Decimal = [&]()
+	{
+		Byte Any = 0;
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			Any |= d[i] & Mask[i];
+		}
+		return Any != 0;
+	};
+
+	switch ( Ins )
+	{
+	case CPU::INS_LDA_IM: Load( a, Imm ); break;
+	case CPU::INS_LDX_IM: Load( x, Imm ); break;
+	case CPU::INS_LDY_IM: Load( y, Imm ); break;
+	case CPU::INS_TAX: Transfer( x, a ); break;
+	case CPU::INS_TAY: Transfer( y, a ); break;
+	case CPU::INS_TXA: Transfer( a, x ); break;
+	case CPU::INS_TYA: Transfer( a, y ); break;
+	case CPU::INS_INX: Increment( x, 1 ); break;
+	case CPU::INS_INY: Increment( y, 1 ); break;
+	case CPU::INS_DEX: Increment( x, 0xFF ); break;
+	case CPU::INS_DEY: Increment( y, 0xFF ); break;
+	case CPU::INS_CMP: Compare( a ); break;
+	case CPU::INS_CPX: Compare( x ); break;
+	case CPU::INS_CPY: Compare( y ); break;
+	case CPU::INS_AND_IM:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte Value = a[i] & Imm;
+			a[i] = Select( Mask[i], Value, a[i] );
+			SetNZ( i, Mask[i], Value );
+		}
+		break;
+	case CPU::INS_ORA_IM:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte Value = a[i] | Imm;
+			a[i] = Select( Mask[i], Value, a[i] );
+			SetNZ( i, Mask[i], Value );
+		}
+		break;
+	case CPU::INS_EOR_IM:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte Value = a[i] ^ Imm;
+			a[i] = Select( Mask[i], Value, a[i] );
+			SetNZ( i, Mask[i], Value );
+		}
+		break;
+	case CPU::INS_ADC:
+	case CPU::INS_SBC:
+		if ( Decimal() )
+		{
+			goto LaneByLane;	// throws, as decimal mode isn't handled
+		}
+		AddWithCarry( Ins == CPU::INS_ADC ? Imm : (Byte)~Imm );
+		break;
+	case CPU::INS_ASL:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = a[i] << 1;
+			c[i] = Select( M, a[i] >> 7, c[i] );
+			a[i] = Select( M, Value, a[i] );
+			SetNZ( i, M, Value );
+		}
+		break;
+	case CPU::INS_LSR:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = a[i] >> 1;
+			c[i] = Select( M, a[i] & 1, c[i] );
+			a[i] = Select( M, Value, a[i] );
+			SetNZ( i, M, Value );
+		}
+		break;
+	case CPU::INS_ROL:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = (a[i] << 1) | c[i];
+			c[i] = Select( M, a[i] >> 7, c[i] );
+			a[i] = Select( M, Value, a[i] );
+			SetNZ( i, M, Value );
+		}
+		break;
+	case CPU::INS_ROR:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			const Byte M = Mask[i];
+			const Byte Value = (a[i] >> 1) | (c[i] << 7);
+			c[i] = Select( M, a[i] & 1, c[i] );
+			a[i] = Select( M, Value, a[i] );
+			SetNZ( i, M, Value );
+		}
+		break;
+	case CPU::INS_CLC:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			c[i] = Select( Mask[i], 0, c[i] );
+		}
+		break;
+	case CPU::INS_SEC:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			c[i] = Select( Mask[i], 1, c[i] );
+		}
+		break;
+	case CPU::INS_CLV:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			v[i] = Select( Mask[i], 0, v[i] );
+		}
+		break;
+	case CPU::INS_NOP:
+		break;
+	case CPU::INS_BEQ: return Branch( z, 1 );
+	case CPU::INS_BNE: return Branch( z, 0 );
+	case CPU::INS_BCS: return Branch( c, 1 );
+	case CPU::INS_BCC: return Branch( c, 0 );
+	case CPU::INS_BMI: return Branch( n, 1 );
+	case CPU::INS_BPL: return Branch( n, 0 );
+	case CPU::INS_BVS: return Branch( v, 1 );
+	case CPU::INS_BVC: return Branch( v, 0 );
+	case CPU::INS_JMP_ABS:
+		for ( u32 i = 0; i < NumLanes; i++ )
+		{
+			pc[i] = Select16( Mask[i], Operand, pc[i] );
+			cycles[i] -= Cost( Mask[i], BaseCycles );
+		}
+		LockstepInstructions += Members.size();
+		return true;
+	default:
+		goto LaneByLane;
+	}
+
+	for ( u32 i = 0; i < NumLanes; i++ )
+	{
+		pc[i] = Select16( Mask[i], NextPC, pc[i] );
+		cycles[i] -= Cost( Mask[i], BaseCycles );
+	}
+	LockstepInstructions += Members.size();
+	return true;
+
+LaneByLane:
+	for ( u32 Lane : Members )
+	{
+		StepLane( Lane );
+		if ( Threw[Lane] )
+		{
+			return false;
+		}
+	}
+	// a load or store leaves them together, a jump may not
+	return !ops::Opcodes.Info[Ins].EndsBlock;
+}
@@ -0,0 +1,205 @@
+#include <string.h>
+#include "m6502.h"
+
+namespace
+{
+	using namespace m6502;
+
+	Byte ReadNothing( void*, Word )
+	{
+		return 0;
+	}
+
+	void IgnoreWrite( void*, Word, Byte )
+	{
+	}
+}
+
+m6502::Mem::Mem()
+{
+	MapRam( 0, NUM_PAGES );
+	memset( WrittenPages, 0xFF, sizeof( WrittenPages ) );
+	memset( DirtyPages, 0, sizeof( DirtyPages ) );
+}
+
+m6502::Mem::Mem( const Mem& Other )
+{
+	*this = Other;
+}
+
+m6502::Mem& m6502::Mem::operator=( const Mem& Other )
+{
+	if ( this == &Other )
+	{
+		return *this;
+	}
+	memcpy( Data, Other.Data, MAX_MEM );
+	ClearWrittenPagesOnly = Other.ClearWrittenPagesOnly;
+	memcpy( WrittenPages, Other.WrittenPages, sizeof( WrittenPages ) );
+	TrackDirtyPages = Other.TrackDirtyPages;
+	memcpy( DirtyPages, Other.DirtyPages, sizeof( DirtyPages ) );
+
+	// the pages that map Data have to map this Data, devices stay as they are
+	const Byte* OtherBegin = Other.Data;
+	const Byte* OtherEnd = Other.Data + MAX_MEM;
+	auto InOtherData = [OtherBegin, OtherEnd]( const Byte* Bytes )
+	{
+		return Bytes >= OtherBegin && Bytes < OtherEnd;
+	};
+	for ( u32 i = 0; i < NUM_PAGES; i++ )
+	{
+		Pages[i] = Other.Pages[i];
+		const Page& P = Other.Pages[i];
+		if ( (P.Code && !InOtherData( P.Code )) || (P.Write && !InOtherData( P.Write )) )
+		{
+			// bytes of someone else's (e.g. a CompactMem's frames), writing
+			// them would change the other machine, so they are copied in
+			Byte* Own = Data + i * PAGE_SIZE;
+			memcpy( Own, P.Code ? P.Code : P.Write, PAGE_SIZE );
+			Pages[i] = { Own, Own, nullptr, nullptr, nullptr, Own };
+			MarkWritten( (Word)(i * PAGE_SIZE) );
+			continue;
+		}
+		if ( P.Read )
+		{
+			Pages[i].Read = Data + (P.Read - OtherBegin);
+		}
+		if ( P.Write )
+		{
+			Pages[i].Write = Data + (P.Write - OtherBegin);
+		}
+		if ( P.Code )
+		{
+			Pages[i].Code = Data + (P.Code - OtherBegin);
+		}
+	}
+
+	if ( Decoded )
+	{
+		Decoded->Flush();
+	}
+	if ( Blocks )
+	{
+		Blocks->Flush();
+	}
+	return *this;
+}
+
+void m6502::Mem::Initialise()
+{
+	if ( TrackDirtyPages )
+	{
+		for ( u32 i = 0; i < NUM_PAGES / 32; i++ )
+		{
+			DirtyPages[i] |= ClearWrittenPagesOnly ? WrittenPages[i] : ~0u;
+		}
+	}
+
+	if ( ClearWrittenPagesOnly )
+	{
+		for ( u32 Page = 0; Page < NUM_PAGES; Page++ )
+		{
+			if ( WrittenPages[Page / 32] == 0 )
+			{
+				Page += 31;		// none of the 32 pages
+			}
+			else if ( WrittenPages[Page / 32] & (1u << (Page % 32)) )
+			{
+				memset( Data + Page * PAGE_SIZE, 0, PAGE_SIZE );
+			}
+		}
+	}
+	else
+	{
+		memset( Data, 0, MAX_MEM );
+	}
+	memset( WrittenPages, 0, sizeof( WrittenPages ) );
+
+	if ( Decoded )
+	{
+		Decoded->Flush();
+	}
+	if ( Blocks )
+	{
+		Blocks->Flush();
+	}
+}
+
+void m6502::Mem::ClearDirtyPages()
+{
+	memset( DirtyPages, 0, sizeof( DirtyPages ) );
+}
+
+m6502::u32 m6502::Mem::NumDirtyPages() const
+{
+	u32 NumDirty = 0;
+	ForEachDirtyPage( [&NumDirty]( Byte ) { NumDirty++; } );
+	return NumDirty;
+}
+
+std::vector<m6502::Byte> m6502::Mem::GetDirtyPages() const
+{
+	std::vector<Byte> Dirty;
+	ForEachDirtyPage( [&Dirty]( Byte Page ) { Dirty.push_back( Page ); } );
+	return Dirty;
+}
+
+void m6502::Mem::MapRam( Byte FirstPage, u32 NumPages )
+{
+	Map( FirstPage, NumPages, { Data, Data, nullptr, nullptr, nullptr, Data }, 0 );
+}
+
+void m6502::Mem::MapRom( Byte FirstPage, u32 NumPages )
+{
+	Map( FirstPage, NumPages, { Data, nullptr, nullptr, IgnoreWrite, nullptr, Data }, 0 );
+}
+
+void m6502::Mem::MapMirror( Byte FirstPage, u32 NumPages, Byte TargetPage )
+{
+	const s32 DataOffset = ((s32)TargetPage - (s32)FirstPage) * (s32)PAGE_SIZE;
+	Map( FirstPage, NumPages, { Data, Data, nullptr, nullptr, nullptr, Data }, DataOffset );
+}
+
+void m6502::Mem::MapDevice( Byte FirstPage, u32 NumPages, ReadHandler OnRead, WriteHandler OnWrite, void* Context )
+{
+	const Page Device = {
+		nullptr, nullptr, OnRead ? OnRead : ReadNothing, OnWrite ? OnWrite : IgnoreWrite, Context, nullptr };
+	Map( FirstPage, NumPages, Device, 0 );
+}
+
+bool m6502::Mem::ReadsAreFlat() const
+{
+	for ( u32 i = 0; i < NUM_PAGES; i++ )
+	{
+		if ( Pages[i].Read != Data + i * PAGE_SIZE )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void m6502::Mem::Map( Byte FirstPage, u32 NumPages, const Page& Mapping, s32 DataOffset )
+{
+	for ( u32 i = FirstPage; i < (u32)FirstPage + NumPages && i < NUM_PAGES; i++ )
+	{
+		// Read & Write are the start of Data, move them to the page's bytes
+		// (wrapping round the 64KB like the addresses do)
+		const u32 DataPage = ((s32)(i * PAGE_SIZE) + DataOffset + (s32)MAX_MEM) % MAX_MEM;
+		Page& P = Pages[i];
+		P = Mapping;
+		P.Read = Mapping.Read ? Mapping.Read + DataPage : nullptr;
+		P.Write = Mapping.Write ? Mapping.Write + DataPage : nullptr;
+		P.Code = Mapping.Code ? Mapping.Code + DataPage : nullptr;
+	}
+
+	if ( Decoded )
+	{
+		Decoded->Flush();
+	}
+	if ( Blocks )
+	{
+		// every block, as the native code reads all of Data, not only these pages
+		Blocks->InvalidateAll();
+	}
+}
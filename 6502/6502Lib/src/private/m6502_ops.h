@@ -0,0 +1,1128 @@
+#pragma once
+#include "m6502.h"
+
+/**	Building blocks for the table driven execution engine (CPU::ExecuteTable)
+*
+*	Every legal opcode is an Op< Operation, AddrMode >. The addressing mode knows
+*	how to fetch the operand bytes and where the effective address is, the
+*	operation knows what to do with it. The compiler stamps out one handler per
+*	opcode, so there are no lambdas and no switch on the instruction at runtime.
+*
+*	Unlike CPU::Execute the cycles aren't counted on every bus access. Each
+*	opcode deducts its base cycles from M6502_OPCODES once, the handlers only
+*	add the page crossing and branch taken penalties on top of that. */
+namespace m6502
+{
+	namespace ops
+	{
+		/** Every entry of the dispatch table has this signature.
+		*	The opcode byte has already been fetched when it is called.
+		*	@return the number of cycles used as a negative number (base cycles
+		*	plus penalties), so the caller's budget can stay in a register
+		*	rather than being passed around by reference */
+		using Handler = s32 (*)( CPU& cpu, Mem& memory );
+
+		/** Same as Handler, but the operand was read when the instruction was
+		*	decoded and the PC is already past the instruction.
+		*	@return only the penalty cycles, as a negative number */
+		using DecodedHandler = DecodeCache::Handler;
+
+		//--------------------------------------------------------------------
+		// Addressing modes
+		//
+		// OperandBytes - how many bytes follow the opcode
+		// PenaltyCycles - the most cycles it can add to the base cycles
+		// Fetch   - read the operand bytes that follow the opcode
+		// Address - turn the operand into an effective address
+		// Read / Write / Modify - access the value the instruction works on
+		//--------------------------------------------------------------------
+
+		/** Shared Read / Write / Modify for the modes that address memory */
+		template< typename Derived >
+		struct AddrMemory
+		{
+			static constexpr Byte PenaltyCycles = 0;
+
+			static Byte Read( CPU& cpu, s32& Cycles, const Mem& memory, Word Operand )
+			{
+				const Word Address = Derived::Address( cpu, Cycles, memory, Operand );
+				return cpu.ReadByte( Address, memory );
+			}
+
+			static void Write( CPU& cpu, s32& Cycles, Mem& memory, Word Operand, Byte Value )
+			{
+				const Word Address = Derived::Address( cpu, Cycles, memory, Operand );
+				cpu.WriteByte( Value, Address, memory );
+			}
+
+			/** Read the value, apply Operation, write the result back */
+			template< typename Operation >
+			static void Modify( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				const Word Address = Derived::Address( cpu, Cycles, memory, Operand );
+				Byte Value = cpu.ReadByte( Address, memory );
+				Value = Operation::Apply( cpu, Value );
+				cpu.WriteByte( Value, Address, memory );
+			}
+		};
+
+		/** No operand, the instruction works on the registers only */
+		struct AddrImplied
+		{
+			static constexpr Byte OperandBytes = 0;
+			static constexpr Byte PenaltyCycles = 0;
+
+			static Word Fetch( CPU&, const Mem& )
+			{
+				return 0;
+			}
+		};
+
+		/** The instruction works on the A register - ASL A etc. */
+		struct AddrAccumulator : AddrImplied
+		{
+			template< typename Operation >
+			static void Modify( CPU& cpu, s32&, Mem&, Word )
+			{
+				cpu.A = Operation::Apply( cpu, cpu.A );
+			}
+		};
+
+		struct AddrImmediate
+		{
+			static constexpr Byte OperandBytes = 1;
+			static constexpr Byte PenaltyCycles = 0;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Byte Read( CPU&, s32&, const Mem&, Word Operand )
+			{
+				return (Byte)Operand;
+			}
+		};
+
+		/** Signed 8-bit offset for the branches */
+		struct AddrRelative : AddrImmediate
+		{
+			/** branch taken & into a new page */
+			static constexpr Byte PenaltyCycles = 2;
+		};
+
+		struct AddrZeroPage : AddrMemory< AddrZeroPage >
+		{
+			static constexpr Byte OperandBytes = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU&, s32&, const Mem&, Word Operand )
+			{
+				return Operand;
+			}
+		};
+
+		struct AddrZeroPageX : AddrMemory< AddrZeroPageX >
+		{
+			static constexpr Byte OperandBytes = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem&, Word Operand )
+			{
+				Byte ZeroPageAddr = (Byte)Operand;
+				ZeroPageAddr += cpu.X;
+				return ZeroPageAddr;
+			}
+		};
+
+		struct AddrZeroPageY : AddrMemory< AddrZeroPageY >
+		{
+			static constexpr Byte OperandBytes = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem&, Word Operand )
+			{
+				Byte ZeroPageAddr = (Byte)Operand;
+				ZeroPageAddr += cpu.Y;
+				return ZeroPageAddr;
+			}
+		};
+
+		struct AddrAbsolute : AddrMemory< AddrAbsolute >
+		{
+			static constexpr Byte OperandBytes = 2;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchWord( memory );
+			}
+
+			static Word Address( CPU&, s32&, const Mem&, Word Operand )
+			{
+				return Operand;
+			}
+		};
+
+		/** Absolute indexed, takes an extra cycle when crossing a page */
+		template< Byte CPU::* Index >
+		struct AddrAbsoluteIndexed : AddrMemory< AddrAbsoluteIndexed< Index > >
+		{
+			static constexpr Byte OperandBytes = 2;
+			static constexpr Byte PenaltyCycles = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchWord( memory );
+			}
+
+			static Word Address( CPU& cpu, s32& Cycles, const Mem&, Word Operand )
+			{
+				const Word AbsAddress = Operand + cpu.*Index;
+				const bool CrossedPageBoundary = (Operand ^ AbsAddress) >> 8;
+				if ( CrossedPageBoundary )
+				{
+					Cycles--;
+				}
+				return AbsAddress;
+			}
+		};
+
+		/** Absolute indexed, the page boundary cycle is always taken so it is
+		*	part of the base cycles - See "STA Absolute,X" */
+		template< Byte CPU::* Index >
+		struct AddrAbsoluteIndexed_5 : AddrMemory< AddrAbsoluteIndexed_5< Index > >
+		{
+			static constexpr Byte OperandBytes = 2;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchWord( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem&, Word Operand )
+			{
+				return Operand + cpu.*Index;
+			}
+		};
+
+		using AddrAbsoluteX = AddrAbsoluteIndexed< &CPU::X >;
+		using AddrAbsoluteY = AddrAbsoluteIndexed< &CPU::Y >;
+		using AddrAbsoluteX_5 = AddrAbsoluteIndexed_5< &CPU::X >;
+		using AddrAbsoluteY_5 = AddrAbsoluteIndexed_5< &CPU::Y >;
+
+		/** Indexed Indirect - ($nn,X) */
+		struct AddrIndirectX : AddrMemory< AddrIndirectX >
+		{
+			static constexpr Byte OperandBytes = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem& memory, Word Operand )
+			{
+				Byte ZPAddress = (Byte)Operand;
+				ZPAddress += cpu.X;
+				return cpu.ReadWord( ZPAddress, memory );
+			}
+		};
+
+		/** Indirect Indexed - ($nn),Y, takes an extra cycle when crossing a page */
+		struct AddrIndirectY : AddrMemory< AddrIndirectY >
+		{
+			static constexpr Byte OperandBytes = 1;
+			static constexpr Byte PenaltyCycles = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU& cpu, s32& Cycles, const Mem& memory, Word Operand )
+			{
+				const Word EffectiveAddr = cpu.ReadWord( Operand, memory );
+				const Word EffectiveAddrY = EffectiveAddr + cpu.Y;
+				const bool CrossedPageBoundary = (EffectiveAddr ^ EffectiveAddrY) >> 8;
+				if ( CrossedPageBoundary )
+				{
+					Cycles--;
+				}
+				return EffectiveAddrY;
+			}
+		};
+
+		/** Indirect Indexed, the page boundary cycle is always taken so it is
+		*	part of the base cycles - See "STA (Indirect,Y)" */
+		struct AddrIndirectY_6 : AddrMemory< AddrIndirectY_6 >
+		{
+			static constexpr Byte OperandBytes = 1;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchByte( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem& memory, Word Operand )
+			{
+				const Word EffectiveAddr = cpu.ReadWord( Operand, memory );
+				return EffectiveAddr + cpu.Y;
+			}
+		};
+
+		/** JMP ($nnnn) - see the note on INS_JMP_IND about the page boundary bug */
+		struct AddrIndirect
+		{
+			static constexpr Byte OperandBytes = 2;
+			static constexpr Byte PenaltyCycles = 0;
+
+			static Word Fetch( CPU& cpu, const Mem& memory )
+			{
+				return cpu.FetchWord( memory );
+			}
+
+			static Word Address( CPU& cpu, s32&, const Mem& memory, Word Operand )
+			{
+				return cpu.ReadWord( Operand, memory );
+			}
+		};
+
+		//--------------------------------------------------------------------
+		// Flags
+		//
+		// With M6502_LAZY_FLAGS the operations leave N/Z/C/V in CPU::LazyNZ,
+		// LazyC & LazyV and only build them in PS when they are read, most of
+		// them are overwritten by the next instruction before anything does.
+		//--------------------------------------------------------------------
+
+#ifdef M6502_LAZY_FLAGS
+		/** N & Z from Value */
+		inline void SetNZ( CPU& cpu, Byte Value )
+		{
+			cpu.LazyNZ = Value;
+			cpu.LazyFlags |= CPU::NegativeFlagBit | CPU::ZeroFlagBit;
+		}
+
+		/** C from bit 8 of Value */
+		inline void SetC( CPU& cpu, Word Value )
+		{
+			cpu.LazyC = Value;
+			cpu.LazyFlags |= CPU::CarryFlagBit;
+		}
+
+		/** V from bit 7 of Value */
+		inline void SetV( CPU& cpu, Byte Value )
+		{
+			cpu.LazyV = Value;
+			cpu.LazyFlags |= CPU::OverflowFlagBit;
+		}
+
+		/** Only the flag that is asked for is worked out, the branches don't
+		*	need all of PS */
+		inline bool GetN( const CPU& cpu )
+		{
+			return (cpu.LazyFlags & CPU::NegativeFlagBit) ? (cpu.LazyNZ & CPU::NegativeFlagBit) != 0 : cpu.Flag.N;
+		}
+
+		inline bool GetZ( const CPU& cpu )
+		{
+			return (cpu.LazyFlags & CPU::ZeroFlagBit) ? cpu.LazyNZ == 0 : cpu.Flag.Z;
+		}
+
+		inline Byte GetC( const CPU& cpu )
+		{
+			return (cpu.LazyFlags & CPU::CarryFlagBit) ? (cpu.LazyC >> 8) & 1 : cpu.Flag.C;
+		}
+
+		inline bool GetV( const CPU& cpu )
+		{
+			return (cpu.LazyFlags & CPU::OverflowFlagBit) ? (cpu.LazyV & CPU::NegativeFlagBit) != 0 : cpu.Flag.V;
+		}
+
+		/** Before PS or Flag is read */
+		inline void SyncFlags( CPU& cpu )
+		{
+			cpu.SyncFlags();
+		}
+
+		/** Before Flags are written straight into PS */
+		inline void ForgetLazyFlags( CPU& cpu, Byte Flags )
+		{
+			cpu.LazyFlags &= ~Flags;
+		}
+#else
+		inline void SetNZ( CPU& cpu, Byte Value ) { cpu.SetZeroAndNegativeFlags( Value ); }
+		inline void SetC( CPU& cpu, Word Value ) { cpu.Flag.C = (Value >> 8) & 1; }
+		inline void SetV( CPU& cpu, Byte Value ) { cpu.Flag.V = Value >> 7; }
+		inline bool GetN( const CPU& cpu ) { return cpu.Flag.N; }
+		inline bool GetZ( const CPU& cpu ) { return cpu.Flag.Z; }
+		inline Byte GetC( const CPU& cpu ) { return cpu.Flag.C; }
+		inline bool GetV( const CPU& cpu ) { return cpu.Flag.V; }
+		inline void SyncFlags( CPU& ) {}
+		inline void ForgetLazyFlags( CPU&, Byte ) {}
+#endif
+
+		/** An engine has one of these so PS is up to date when it returns,
+		*	or when an instruction throws */
+		struct SyncFlagsOnExit
+		{
+			CPU& cpu;
+
+			~SyncFlagsOnExit()
+			{
+				SyncFlags( cpu );
+			}
+		};
+
+		//--------------------------------------------------------------------
+		// Operations
+		//--------------------------------------------------------------------
+
+		/** Operations that only read their operand - LDA, AND, ADC, CMP etc. */
+		template< typename Derived >
+		struct ReadOperation
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				Derived::Apply( cpu, AddrMode::Read( cpu, Cycles, memory, Operand ) );
+			}
+		};
+
+		/** Operations that read, change and write back their operand - ASL, INC etc. */
+		template< typename Derived >
+		struct ReadModifyWriteOperation
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				AddrMode::template Modify< Derived >( cpu, Cycles, memory, Operand );
+			}
+		};
+
+		/** Operations that only touch registers */
+		template< typename Derived >
+		struct ImpliedOperation
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem&, Word )
+			{
+				Derived::Apply( cpu );
+			}
+		};
+
+		/** The operations that change the PC, they end a basic block */
+		struct ControlTransfer
+		{
+		};
+
+		/* Conditional branch */
+		template< typename Derived >
+		struct BranchOperation : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem&, Word Operand )
+			{
+				if ( Derived::Taken( cpu ) )
+				{
+					const Word PCOld = cpu.PC;
+					cpu.PC += (SByte)Operand;
+					Cycles--;
+
+					const bool PageChanged = (cpu.PC >> 8) != (PCOld >> 8);
+					if ( PageChanged )
+					{
+						Cycles--;
+					}
+				}
+			}
+		};
+
+		// Load / Store
+
+		struct LDA : ReadOperation< LDA >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.A = Value;
+				SetNZ( cpu, cpu.A );
+			}
+		};
+
+		struct LDX : ReadOperation< LDX >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.X = Value;
+				SetNZ( cpu, cpu.X );
+			}
+		};
+
+		struct LDY : ReadOperation< LDY >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.Y = Value;
+				SetNZ( cpu, cpu.Y );
+			}
+		};
+
+		struct STA
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				AddrMode::Write( cpu, Cycles, memory, Operand, cpu.A );
+			}
+		};
+
+		struct STX
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				AddrMode::Write( cpu, Cycles, memory, Operand, cpu.X );
+			}
+		};
+
+		struct STY
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				AddrMode::Write( cpu, Cycles, memory, Operand, cpu.Y );
+			}
+		};
+
+		// Logical
+
+		struct AND : ReadOperation< AND >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.A &= Value;
+				SetNZ( cpu, cpu.A );
+			}
+		};
+
+		struct ORA : ReadOperation< ORA >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.A |= Value;
+				SetNZ( cpu, cpu.A );
+			}
+		};
+
+		struct EOR : ReadOperation< EOR >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				cpu.A ^= Value;
+				SetNZ( cpu, cpu.A );
+			}
+		};
+
+		struct BIT : ReadOperation< BIT >
+		{
+			static void Apply( CPU& cpu, Byte Value )
+			{
+				ForgetLazyFlags( cpu, CPU::NegativeFlagBit | CPU::ZeroFlagBit | CPU::OverflowFlagBit );
+				cpu.Flag.Z = !(cpu.A & Value);
+				cpu.Flag.N = (Value & CPU::NegativeFlagBit) != 0;
+				cpu.Flag.V = (Value & CPU::OverflowFlagBit) != 0;
+			}
+		};
+
+		// Arithmetic
+
+		struct ADC : ReadOperation< ADC >
+		{
+			static void Apply( CPU& cpu, Byte Operand )
+			{
+				if ( cpu.Flag.D )
+				{
+					throw -1;	// haven't handled decimal mode!
+				}
+				Word Sum = cpu.A;
+				Sum += Operand;
+				Sum += GetC( cpu );
+				// overflow when the sign of the result differs from both inputs
+				SetV( cpu, (cpu.A ^ Sum) & (Operand ^ Sum) );
+				cpu.A = (Sum & 0xFF);
+				SetNZ( cpu, cpu.A );
+				SetC( cpu, Sum );
+			}
+		};
+
+		struct SBC : ReadOperation< SBC >
+		{
+			static void Apply( CPU& cpu, Byte Operand )
+			{
+				ADC::Apply( cpu, ~Operand );
+			}
+		};
+
+		/** Sets the processor status for a CMP/CPX/CPY instruction */
+		template< Byte CPU::* Register >
+		struct Compare : ReadOperation< Compare< Register > >
+		{
+			static void Apply( CPU& cpu, Byte Operand )
+			{
+				const Byte RegisterValue = cpu.*Register;
+				const Byte Temp = RegisterValue - Operand;
+				SetNZ( cpu, Temp );
+				// no borrow out of bit 8 when RegisterValue >= Operand
+				SetC( cpu, RegisterValue + (Byte)~Operand + 1 );
+			}
+		};
+
+		using CMP = Compare< &CPU::A >;
+		using CPX = Compare< &CPU::X >;
+		using CPY = Compare< &CPU::Y >;
+
+		// Increments, Decrements
+
+		struct INC : ReadModifyWriteOperation< INC >
+		{
+			static Byte Apply( CPU& cpu, Byte Value )
+			{
+				Value++;
+				SetNZ( cpu, Value );
+				return Value;
+			}
+		};
+
+		struct DEC : ReadModifyWriteOperation< DEC >
+		{
+			static Byte Apply( CPU& cpu, Byte Value )
+			{
+				Value--;
+				SetNZ( cpu, Value );
+				return Value;
+			}
+		};
+
+		struct INX : ImpliedOperation< INX >
+		{
+			static void Apply( CPU& cpu ) { cpu.X++; SetNZ( cpu, cpu.X ); }
+		};
+
+		struct INY : ImpliedOperation< INY >
+		{
+			static void Apply( CPU& cpu ) { cpu.Y++; SetNZ( cpu, cpu.Y ); }
+		};
+
+		struct DEX : ImpliedOperation< DEX >
+		{
+			static void Apply( CPU& cpu ) { cpu.X--; SetNZ( cpu, cpu.X ); }
+		};
+
+		struct DEY : ImpliedOperation< DEY >
+		{
+			static void Apply( CPU& cpu ) { cpu.Y--; SetNZ( cpu, cpu.Y ); }
+		};
+
+		// Shifts
+
+		/** Arithmetic shift left */
+		struct ASL : ReadModifyWriteOperation< ASL >
+		{
+			static Byte Apply( CPU& cpu, Byte Operand )
+			{
+				SetC( cpu, Operand << 1 );
+				const Byte Result = Operand << 1;
+				SetNZ( cpu, Result );
+				return Result;
+			}
+		};
+
+		/** Logical shift right */
+		struct LSR : ReadModifyWriteOperation< LSR >
+		{
+			static Byte Apply( CPU& cpu, Byte Operand )
+			{
+				SetC( cpu, (Operand & CPU::ZeroBit) << 8 );
+				const Byte Result = Operand >> 1;
+				SetNZ( cpu, Result );
+				return Result;
+			}
+		};
+
+		/** Rotate left */
+		struct ROL : ReadModifyWriteOperation< ROL >
+		{
+			static Byte Apply( CPU& cpu, Byte Operand )
+			{
+				const Word Result = (Operand << 1) | GetC( cpu );
+				SetC( cpu, Result );
+				SetNZ( cpu, (Byte)Result );
+				return (Byte)Result;
+			}
+		};
+
+		/** Rotate right */
+		struct ROR : ReadModifyWriteOperation< ROR >
+		{
+			static Byte Apply( CPU& cpu, Byte Operand )
+			{
+				const Byte Result = (Operand >> 1) | (GetC( cpu ) << 7);
+				SetC( cpu, (Operand & CPU::ZeroBit) << 8 );
+				SetNZ( cpu, Result );
+				return Result;
+			}
+		};
+
+		// Transfer Registers
+
+		struct TAX : ImpliedOperation< TAX >
+		{
+			static void Apply( CPU& cpu ) { cpu.X = cpu.A; SetNZ( cpu, cpu.X ); }
+		};
+
+		struct TAY : ImpliedOperation< TAY >
+		{
+			static void Apply( CPU& cpu ) { cpu.Y = cpu.A; SetNZ( cpu, cpu.Y ); }
+		};
+
+		struct TXA : ImpliedOperation< TXA >
+		{
+			static void Apply( CPU& cpu ) { cpu.A = cpu.X; SetNZ( cpu, cpu.A ); }
+		};
+
+		struct TYA : ImpliedOperation< TYA >
+		{
+			static void Apply( CPU& cpu ) { cpu.A = cpu.Y; SetNZ( cpu, cpu.A ); }
+		};
+
+		struct TSX : ImpliedOperation< TSX >
+		{
+			static void Apply( CPU& cpu ) { cpu.X = cpu.SP; SetNZ( cpu, cpu.X ); }
+		};
+
+		struct TXS : ImpliedOperation< TXS >
+		{
+			static void Apply( CPU& cpu ) { cpu.SP = cpu.X; }
+		};
+
+		// Status flag changes
+
+		struct CLC : ImpliedOperation< CLC >
+		{
+			static void Apply( CPU& cpu ) { SetC( cpu, 0 ); }
+		};
+
+		struct SEC : ImpliedOperation< SEC >
+		{
+			static void Apply( CPU& cpu ) { SetC( cpu, 0x100 ); }
+		};
+
+		struct CLD : ImpliedOperation< CLD >
+		{
+			static void Apply( CPU& cpu ) { cpu.Flag.D = false; }
+		};
+
+		struct SED : ImpliedOperation< SED >
+		{
+			static void Apply( CPU& cpu ) { cpu.Flag.D = true; }
+		};
+
+		struct CLI : ImpliedOperation< CLI >
+		{
+			static void Apply( CPU& cpu ) { cpu.Flag.I = false; }
+		};
+
+		struct SEI : ImpliedOperation< SEI >
+		{
+			static void Apply( CPU& cpu ) { cpu.Flag.I = true; }
+		};
+
+		struct CLV : ImpliedOperation< CLV >
+		{
+			static void Apply( CPU& cpu ) { SetV( cpu, 0 ); }
+		};
+
+		struct NOP : ImpliedOperation< NOP >
+		{
+			static void Apply( CPU& ) {}
+		};
+
+		// Branches
+
+		struct BEQ : BranchOperation< BEQ >
+		{
+			static bool Taken( const CPU& cpu ) { return GetZ( cpu ); }
+		};
+
+		struct BNE : BranchOperation< BNE >
+		{
+			static bool Taken( const CPU& cpu ) { return !GetZ( cpu ); }
+		};
+
+		struct BCS : BranchOperation< BCS >
+		{
+			static bool Taken( const CPU& cpu ) { return GetC( cpu ); }
+		};
+
+		struct BCC : BranchOperation< BCC >
+		{
+			static bool Taken( const CPU& cpu ) { return !GetC( cpu ); }
+		};
+
+		struct BMI : BranchOperation< BMI >
+		{
+			static bool Taken( const CPU& cpu ) { return GetN( cpu ); }
+		};
+
+		struct BPL : BranchOperation< BPL >
+		{
+			static bool Taken( const CPU& cpu ) { return !GetN( cpu ); }
+		};
+
+		struct BVS : BranchOperation< BVS >
+		{
+			static bool Taken( const CPU& cpu ) { return GetV( cpu ); }
+		};
+
+		struct BVC : BranchOperation< BVC >
+		{
+			static bool Taken( const CPU& cpu ) { return !GetV( cpu ); }
+		};
+
+		// Stack
+
+		struct PHA
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				cpu.PushByteOntoStack( cpu.A, memory );
+			}
+		};
+
+		struct PLA
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				cpu.A = cpu.PopByteFromStack( memory );
+				SetNZ( cpu, cpu.A );
+			}
+		};
+
+		/** Push Processor status onto the stack
+		*	Setting bits 4 & 5 on the stack */
+		struct PHP
+		{
+			static void PushPS( CPU& cpu, Mem& memory )
+			{
+				const Byte PSStack = cpu.GetPS() | CPU::BreakFlagBit | CPU::UnusedFlagBit;
+				cpu.PushByteOntoStack( PSStack, memory );
+			}
+
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				PushPS( cpu, memory );
+			}
+		};
+
+		/** Pop Processor status from the stack
+		*	Clearing bits 4 & 5 (Break & Unused) */
+		struct PLP
+		{
+			static void PopPS( CPU& cpu, Mem& memory )
+			{
+				cpu.SetPS( cpu.PopByteFromStack( memory ) );
+				cpu.Flag.B = false;
+				cpu.Flag.Unused = false;
+			}
+
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				PopPS( cpu, memory );
+			}
+		};
+
+		// Jumps & Calls
+
+		struct JMP : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32& Cycles, Mem& memory, Word Operand )
+			{
+				cpu.PC = AddrMode::Address( cpu, Cycles, memory, Operand );
+			}
+		};
+
+		struct JSR : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word Operand )
+			{
+				cpu.PushWordToStack( memory, cpu.PC - 1 );
+				cpu.PC = Operand;
+			}
+		};
+
+		struct RTS : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				const Word ReturnAddress = cpu.PopWordFromStack( memory );
+				cpu.PC = ReturnAddress + 1;
+			}
+		};
+
+		// System functions
+
+		struct BRK : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				const Byte PSStack = cpu.GetPS() | CPU::BreakFlagBit | CPU::UnusedFlagBit;
+				cpu.EnterInterrupt( cpu.PC + 1, PSStack, CPU::IrqVector, memory );
+				cpu.Flag.B = true;
+			}
+		};
+
+		struct RTI : ControlTransfer
+		{
+			template< typename AddrMode >
+			static void Run( CPU& cpu, s32&, Mem& memory, Word )
+			{
+				PLP::PopPS( cpu, memory );
+				cpu.PC = cpu.PopWordFromStack( memory );
+			}
+		};
+
+		//--------------------------------------------------------------------
+		// The handlers
+		//--------------------------------------------------------------------
+
+		template< typename Operation, typename AddrMode, s32 BaseCycles >
+		struct Op
+		{
+			static s32 Execute( CPU& cpu, Mem& memory )
+			{
+				s32 Cycles = -BaseCycles;
+				const Word Operand = AddrMode::Fetch( cpu, memory );
+				Operation::template Run< AddrMode >( cpu, Cycles, memory, Operand );
+				return Cycles;
+			}
+
+			static s32 ExecuteDecoded( CPU& cpu, Mem& memory, Word Operand )
+			{
+				s32 Cycles = 0;
+				Operation::template Run< AddrMode >( cpu, Cycles, memory, Operand );
+				return Cycles;
+			}
+		};
+
+		/** Handler for every opcode that isn't in M6502_OPCODES */
+		inline s32 IllegalOpcode( CPU& cpu, Mem& memory )
+		{
+			const Byte Ins = memory.Peek( (Word)(cpu.PC - 1) );
+			printf( "Instruction %d not handled\n", Ins );
+			throw -1;
+		}
+
+		inline s32 IllegalOpcodeDecoded( CPU& cpu, Mem& memory, Word )
+		{
+			return IllegalOpcode( cpu, memory );
+		}
+
+		/** Everything the engines need to know about one opcode */
+		struct OpcodeInfo
+		{
+			Handler Execute;
+			DecodedHandler ExecuteDecoded;
+			Byte Length;		//including the opcode
+			Byte BaseCycles;
+			Byte MaxCycles;		//the base cycles plus the worst case penalties
+			bool EndsBlock;		//it changes the PC, or it is illegal
+		};
+
+		/** Indexed by the opcode, built from M6502_OPCODES in m6502_table.cpp */
+		struct OpcodeTable
+		{
+			OpcodeInfo Info[256];
+
+			OpcodeTable();
+		};
+
+		extern const OpcodeTable Opcodes;
+	}
+}
+
+/**	Every legal opcode as OPCODE( Opcode, Operation, AddrMode, BaseCycles )
+*	- Opcode is the name of the CPU::INS_ constant
+*	- BaseCycles includes the opcode fetch but none of the page crossing or
+*	  branch taken penalties */
+#define M6502_OPCODES( OPCODE ) \
+	OPCODE( INS_LDA_IM,   LDA, AddrImmediate,   2 ) \
+	OPCODE( INS_LDA_ZP,   LDA, AddrZeroPage,    3 ) \
+	OPCODE( INS_LDA_ZPX,  LDA, AddrZeroPageX,   4 ) \
+	OPCODE( INS_LDA_ABS,  LDA, AddrAbsolute,    4 ) \
+	OPCODE( INS_LDA_ABSX, LDA, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_LDA_ABSY, LDA, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_LDA_INDX, LDA, AddrIndirectX,   6 ) \
+	OPCODE( INS_LDA_INDY, LDA, AddrIndirectY,   5 ) \
+	OPCODE( INS_LDX_IM,   LDX, AddrImmediate,   2 ) \
+	OPCODE( INS_LDX_ZP,   LDX, AddrZeroPage,    3 ) \
+	OPCODE( INS_LDX_ZPY,  LDX, AddrZeroPageY,   4 ) \
+	OPCODE( INS_LDX_ABS,  LDX, AddrAbsolute,    4 ) \
+	OPCODE( INS_LDX_ABSY, LDX, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_LDY_IM,   LDY, AddrImmediate,   2 ) \
+	OPCODE( INS_LDY_ZP,   LDY, AddrZeroPage,    3 ) \
+	OPCODE( INS_LDY_ZPX,  LDY, AddrZeroPageX,   4 ) \
+	OPCODE( INS_LDY_ABS,  LDY, AddrAbsolute,    4 ) \
+	OPCODE( INS_LDY_ABSX, LDY, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_STA_ZP,   STA, AddrZeroPage,    3 ) \
+	OPCODE( INS_STA_ZPX,  STA, AddrZeroPageX,   4 ) \
+	OPCODE( INS_STA_ABS,  STA, AddrAbsolute,    4 ) \
+	OPCODE( INS_STA_ABSX, STA, AddrAbsoluteX_5, 5 ) \
+	OPCODE( INS_STA_ABSY, STA, AddrAbsoluteY_5, 5 ) \
+	OPCODE( INS_STA_INDX, STA, AddrIndirectX,   6 ) \
+	OPCODE( INS_STA_INDY, STA, AddrIndirectY_6, 6 ) \
+	OPCODE( INS_STX_ZP,   STX, AddrZeroPage,    3 ) \
+	OPCODE( INS_STX_ZPY,  STX, AddrZeroPageY,   4 ) \
+	OPCODE( INS_STX_ABS,  STX, AddrAbsolute,    4 ) \
+	OPCODE( INS_STY_ZP,   STY, AddrZeroPage,    3 ) \
+	OPCODE( INS_STY_ZPX,  STY, AddrZeroPageX,   4 ) \
+	OPCODE( INS_STY_ABS,  STY, AddrAbsolute,    4 ) \
+	OPCODE( INS_TSX,      TSX, AddrImplied,     2 ) \
+	OPCODE( INS_TXS,      TXS, AddrImplied,     2 ) \
+	OPCODE( INS_PHA,      PHA, AddrImplied,     3 ) \
+	OPCODE( INS_PLA,      PLA, AddrImplied,     4 ) \
+	OPCODE( INS_PHP,      PHP, AddrImplied,     3 ) \
+	OPCODE( INS_PLP,      PLP, AddrImplied,     4 ) \
+	OPCODE( INS_JMP_ABS,  JMP, AddrAbsolute,    3 ) \
+	OPCODE( INS_JMP_IND,  JMP, AddrIndirect,    5 ) \
+	OPCODE( INS_JSR,      JSR, AddrAbsolute,    6 ) \
+	OPCODE( INS_RTS,      RTS, AddrImplied,     6 ) \
+	OPCODE( INS_AND_IM,   AND, AddrImmediate,   2 ) \
+	OPCODE( INS_AND_ZP,   AND, AddrZeroPage,    3 ) \
+	OPCODE( INS_AND_ZPX,  AND, AddrZeroPageX,   4 ) \
+	OPCODE( INS_AND_ABS,  AND, AddrAbsolute,    4 ) \
+	OPCODE( INS_AND_ABSX, AND, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_AND_ABSY, AND, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_AND_INDX, AND, AddrIndirectX,   6 ) \
+	OPCODE( INS_AND_INDY, AND, AddrIndirectY,   5 ) \
+	OPCODE( INS_ORA_IM,   ORA, AddrImmediate,   2 ) \
+	OPCODE( INS_ORA_ZP,   ORA, AddrZeroPage,    3 ) \
+	OPCODE( INS_ORA_ZPX,  ORA, AddrZeroPageX,   4 ) \
+	OPCODE( INS_ORA_ABS,  ORA, AddrAbsolute,    4 ) \
+	OPCODE( INS_ORA_ABSX, ORA, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_ORA_ABSY, ORA, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_ORA_INDX, ORA, AddrIndirectX,   6 ) \
+	OPCODE( INS_ORA_INDY, ORA, AddrIndirectY,   5 ) \
+	OPCODE( INS_EOR_IM,   EOR, AddrImmediate,   2 ) \
+	OPCODE( INS_EOR_ZP,   EOR, AddrZeroPage,    3 ) \
+	OPCODE( INS_EOR_ZPX,  EOR, AddrZeroPageX,   4 ) \
+	OPCODE( INS_EOR_ABS,  EOR, AddrAbsolute,    4 ) \
+	OPCODE( INS_EOR_ABSX, EOR, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_EOR_ABSY, EOR, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_EOR_INDX, EOR, AddrIndirectX,   6 ) \
+	OPCODE( INS_EOR_INDY, EOR, AddrIndirectY,   5 ) \
+	OPCODE( INS_BIT_ZP,   BIT, AddrZeroPage,    3 ) \
+	OPCODE( INS_BIT_ABS,  BIT, AddrAbsolute,    4 ) \
+	OPCODE( INS_TAX,      TAX, AddrImplied,     2 ) \
+	OPCODE( INS_TAY,      TAY, AddrImplied,     2 ) \
+	OPCODE( INS_TXA,      TXA, AddrImplied,     2 ) \
+	OPCODE( INS_TYA,      TYA, AddrImplied,     2 ) \
+	OPCODE( INS_INX,      INX, AddrImplied,     2 ) \
+	OPCODE( INS_INY,      INY, AddrImplied,     2 ) \
+	OPCODE( INS_DEY,      DEY, AddrImplied,     2 ) \
+	OPCODE( INS_DEX,      DEX, AddrImplied,     2 ) \
+	OPCODE( INS_DEC_ZP,   DEC, AddrZeroPage,    5 ) \
+	OPCODE( INS_DEC_ZPX,  DEC, AddrZeroPageX,   6 ) \
+	OPCODE( INS_DEC_ABS,  DEC, AddrAbsolute,    6 ) \
+	OPCODE( INS_DEC_ABSX, DEC, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_INC_ZP,   INC, AddrZeroPage,    5 ) \
+	OPCODE( INS_INC_ZPX,  INC, AddrZeroPageX,   6 ) \
+	OPCODE( INS_INC_ABS,  INC, AddrAbsolute,    6 ) \
+	OPCODE( INS_INC_ABSX, INC, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_BEQ,      BEQ, AddrRelative,    2 ) \
+	OPCODE( INS_BNE,      BNE, AddrRelative,    2 ) \
+	OPCODE( INS_BCS,      BCS, AddrRelative,    2 ) \
+	OPCODE( INS_BCC,      BCC, AddrRelative,    2 ) \
+	OPCODE( INS_BMI,      BMI, AddrRelative,    2 ) \
+	OPCODE( INS_BPL,      BPL, AddrRelative,    2 ) \
+	OPCODE( INS_BVC,      BVC, AddrRelative,    2 ) \
+	OPCODE( INS_BVS,      BVS, AddrRelative,    2 ) \
+	OPCODE( INS_CLC,      CLC, AddrImplied,     2 ) \
+	OPCODE( INS_SEC,      SEC, AddrImplied,     2 ) \
+	OPCODE( INS_CLD,      CLD, AddrImplied,     2 ) \
+	OPCODE( INS_SED,      SED, AddrImplied,     2 ) \
+	OPCODE( INS_CLI,      CLI, AddrImplied,     2 ) \
+	OPCODE( INS_SEI,      SEI, AddrImplied,     2 ) \
+	OPCODE( INS_CLV,      CLV, AddrImplied,     2 ) \
+	OPCODE( INS_ADC,      ADC, AddrImmediate,   2 ) \
+	OPCODE( INS_ADC_ZP,   ADC, AddrZeroPage,    3 ) \
+	OPCODE( INS_ADC_ZPX,  ADC, AddrZeroPageX,   4 ) \
+	OPCODE( INS_ADC_ABS,  ADC, AddrAbsolute,    4 ) \
+	OPCODE( INS_ADC_ABSX, ADC, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_ADC_ABSY, ADC, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_ADC_INDX, ADC, AddrIndirectX,   6 ) \
+	OPCODE( INS_ADC_INDY, ADC, AddrIndirectY,   5 ) \
+	OPCODE( INS_SBC,      SBC, AddrImmediate,   2 ) \
+	OPCODE( INS_SBC_ABS,  SBC, AddrAbsolute,    4 ) \
+	OPCODE( INS_SBC_ZP,   SBC, AddrZeroPage,    3 ) \
+	OPCODE( INS_SBC_ZPX,  SBC, AddrZeroPageX,   4 ) \
+	OPCODE( INS_SBC_ABSX, SBC, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_SBC_ABSY, SBC, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_SBC_INDX, SBC, AddrIndirectX,   6 ) \
+	OPCODE( INS_SBC_INDY, SBC, AddrIndirectY,   5 ) \
+	OPCODE( INS_CMP,      CMP, AddrImmediate,   2 ) \
+	OPCODE( INS_CMP_ZP,   CMP, AddrZeroPage,    3 ) \
+	OPCODE( INS_CMP_ZPX,  CMP, AddrZeroPageX,   4 ) \
+	OPCODE( INS_CMP_ABS,  CMP, AddrAbsolute,    4 ) \
+	OPCODE( INS_CMP_ABSX, CMP, AddrAbsoluteX,   4 ) \
+	OPCODE( INS_CMP_ABSY, CMP, AddrAbsoluteY,   4 ) \
+	OPCODE( INS_CMP_INDX, CMP, AddrIndirectX,   6 ) \
+	OPCODE( INS_CMP_INDY, CMP, AddrIndirectY,   5 ) \
+	OPCODE( INS_CPX,      CPX, AddrImmediate,   2 ) \
+	OPCODE( INS_CPY,      CPY, AddrImmediate,   2 ) \
+	OPCODE( INS_CPX_ZP,   CPX, AddrZeroPage,    3 ) \
+	OPCODE( INS_CPY_ZP,   CPY, AddrZeroPage,    3 ) \
+	OPCODE( INS_CPX_ABS,  CPX, AddrAbsolute,    4 ) \
+	OPCODE( INS_CPY_ABS,  CPY, AddrAbsolute,    4 ) \
+	OPCODE( INS_ASL,      ASL, AddrAccumulator, 2 ) \
+	OPCODE( INS_ASL_ZP,   ASL, AddrZeroPage,    5 ) \
+	OPCODE( INS_ASL_ZPX,  ASL, AddrZeroPageX,   6 ) \
+	OPCODE( INS_ASL_ABS,  ASL, AddrAbsolute,    6 ) \
+	OPCODE( INS_ASL_ABSX, ASL, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_LSR,      LSR, AddrAccumulator, 2 ) \
+	OPCODE( INS_LSR_ZP,   LSR, AddrZeroPage,    5 ) \
+	OPCODE( INS_LSR_ZPX,  LSR, AddrZeroPageX,   6 ) \
+	OPCODE( INS_LSR_ABS,  LSR, AddrAbsolute,    6 ) \
+	OPCODE( INS_LSR_ABSX, LSR, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_ROL,      ROL, AddrAccumulator, 2 ) \
+	OPCODE( INS_ROL_ZP,   ROL, AddrZeroPage,    5 ) \
+	OPCODE( INS_ROL_ZPX,  ROL, AddrZeroPageX,   6 ) \
+	OPCODE( INS_ROL_ABS,  ROL, AddrAbsolute,    6 ) \
+	OPCODE( INS_ROL_ABSX, ROL, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_ROR,      ROR, AddrAccumulator, 2 ) \
+	OPCODE( INS_ROR_ZP,   ROR, AddrZeroPage,    5 ) \
+	OPCODE( INS_ROR_ZPX,  ROR, AddrZeroPageX,   6 ) \
+	OPCODE( INS_ROR_ABS,  ROR, AddrAbsolute,    6 ) \
+	OPCODE( INS_ROR_ABSX, ROR, AddrAbsoluteX_5, 7 ) \
+	OPCODE( INS_NOP,      NOP, AddrImplied,     2 ) \
+	OPCODE( INS_BRK,      BRK, AddrImplied,     7 ) \
+	OPCODE( INS_RTI,      RTI, AddrImplied,     6 )
@@ -0,0 +1,138 @@
+#include "m6502_pool.h"
+#include "m6502_trace.h"
+
+namespace
+{
+	using namespace m6502;
+
+	void CountAcquired( PoolStats& Counts, bool Reused )
+	{
+		Counts.NumAcquired++;
+		Counts.NumReused += Reused;
+		Counts.NumInUse++;
+		Counts.PeakInUse = Counts.NumInUse > Counts.PeakInUse ? Counts.NumInUse : Counts.PeakInUse;
+	}
+}
+
+m6502::PageFrame* m6502::PageArena::Allocate()
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	CountAcquired( Counts, !FreeFrames.empty() );
+	if ( !FreeFrames.empty() )
+	{
+		PageFrame* Frame = FreeFrames.back();
+		FreeFrames.pop_back();
+		return Frame;
+	}
+	if ( NumUnusedInLastChunk == 0 )
+	{
+		Chunks.emplace_back( new PageFrame[FRAMES_PER_CHUNK] );
+		NumUnusedInLastChunk = FRAMES_PER_CHUNK;
+		Counts.NumSlots += FRAMES_PER_CHUNK;
+		Counts.BytesReserved += sizeof( PageFrame ) * FRAMES_PER_CHUNK;
+	}
+	return &Chunks.back()[FRAMES_PER_CHUNK - NumUnusedInLastChunk--];
+}
+
+void m6502::PageArena::Free( PageFrame* Frame )
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	Counts.NumInUse--;
+	FreeFrames.push_back( Frame );
+}
+
+m6502::u32 m6502::PageArena::NumAllocated() const
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	return Counts.NumInUse;
+}
+
+m6502::u32 m6502::PageArena::NumFrames() const
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	return Counts.NumSlots;
+}
+
+m6502::PoolStats m6502::PageArena::Stats() const
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	return Counts;
+}
+
+m6502::Machine* m6502::MachinePool::Acquire()
+{
+	Machine* Acquired;
+	{
+		std::lock_guard<std::mutex> Guard( Lock );
+		CountAcquired( Counts, !FreeMachines.empty() );
+		if ( !FreeMachines.empty() )
+		{
+			Acquired = FreeMachines.back();
+			FreeMachines.pop_back();
+		}
+		else
+		{
+			if ( NumUnusedInLastChunk == 0 )
+			{
+				// a new Mem has every page marked written, so it is all cleared below
+				Chunks.emplace_back( new Machine[MACHINES_PER_CHUNK] );
+				NumUnusedInLastChunk = MACHINES_PER_CHUNK;
+				Counts.NumSlots += MACHINES_PER_CHUNK;
+				Counts.BytesReserved += sizeof( Machine ) * MACHINES_PER_CHUNK;
+			}
+			Acquired = &Chunks.back()[MACHINES_PER_CHUNK - NumUnusedInLastChunk--];
+		}
+	}
+
+	// the clearing is the slow part, done outside of the lock
+	Mem& memory = Acquired->Memory;
+	if ( memory.Decoded )
+	{
+		memory.Decoded->Detach();
+	}
+	if ( memory.Blocks )
+	{
+		memory.Blocks->Detach();
+	}
+	if ( memory.Breaks )
+	{
+		memory.Breaks->Detach();
+	}
+	if ( memory.Trace )
+	{
+		memory.Trace->Detach();
+	}
+	memory.MapRam( 0, Mem::NUM_PAGES );
+	memory.TrackDirtyPages = false;
+	memory.ClearDirtyPages();
+	u32 NumWritten = 0;
+	for ( u32 Bits : memory.WrittenPages )
+	{
+		for ( ; Bits; Bits &= Bits - 1 )
+		{
+			NumWritten++;
+		}
+	}
+	memory.ClearWrittenPagesOnly = true;
+	memory.Initialise();
+	memory.ClearWrittenPagesOnly = false;
+	Acquired->Cpu = CPU();
+	Acquired->Cpu.Reset( 0xFFFC );
+
+	std::lock_guard<std::mutex> Guard( Lock );
+	Counts.PagesCleared += NumWritten;
+	return Acquired;
+}
+
+void m6502::MachinePool::Release( Machine* Used )
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	Counts.NumInUse--;
+	FreeMachines.push_back( Used );
+}
+
+m6502::PoolStats m6502::MachinePool::Stats() const
+{
+	std::lock_guard<std::mutex> Guard( Lock );
+	return Counts;
+}
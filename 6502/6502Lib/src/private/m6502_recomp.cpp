@@ -0,0 +1,291 @@
+#include <string.h>
+#include "m6502_recomp.h"
+#include "m6502_ops.h"
+
+namespace
+{
+	using namespace m6502;
+
+	/** The Op< Operation, AddrMode, BaseCycles > of every opcode, as text */
+	struct OpcodeName
+	{
+		const char* Operation;	//nullptr when illegal
+		const char* AddrMode;
+	};
+
+	struct OpcodeNameTable
+	{
+		OpcodeName Info[256];
+
+		OpcodeNameTable()
+		{
+			for ( OpcodeName& Entry : Info )
+			{
+				Entry = { nullptr, nullptr };
+			}
+
+#define M6502_RECOMP_ENTRY( Ins, Operation, AddrMode, Cycles ) \
+			Info[CPU::Ins] = { #Operation, #AddrMode };
+			M6502_OPCODES( M6502_RECOMP_ENTRY )
+#undef M6502_RECOMP_ENTRY
+		}
+	};
+
+	const OpcodeNameTable OpcodeNames;
+
+	bool IsBranch( Byte Ins )
+	{
+		const char* AddrMode = OpcodeNames.Info[Ins].AddrMode;
+		return AddrMode && strcmp( AddrMode, "AddrRelative" ) == 0;
+	}
+
+	std::string Hex( u32 Value, int Digits )
+	{
+		char Text[16];
+		snprintf( Text, sizeof( Text ), "%0*X", Digits, Value );
+		return Text;
+	}
+
+	std::string Label( Word Address )
+	{
+		return "L_" + Hex( Address, 4 );
+	}
+}
+
+m6502::Recompiler::Recompiler( const Byte* Program, u32 NumBytes )
+	: IsInstruction( Mem::MAX_MEM, false ), IsLabel( Mem::MAX_MEM, false )
+{
+	if ( Program && NumBytes > 2 )
+	{
+		LoadAddress = Program[0] | (Program[1] << 8);
+		const u32 MaxBytes = Mem::MAX_MEM - LoadAddress;
+		const u32 NumImageBytes = NumBytes - 2 < MaxBytes ? NumBytes - 2 : MaxBytes;
+		Image.assign( Program + 2, Program + 2 + NumImageBytes );
+	}
+}
+
+void m6502::Recompiler::AddEntryPoint( Word Address )
+{
+	if ( InImage( Address ) )
+	{
+		EntryPoints.push_back( Address );
+	}
+}
+
+void m6502::Recompiler::Trace()
+{
+	std::vector<Word> ToTrace = EntryPoints;
+	for ( Word Entry : EntryPoints )
+	{
+		IsLabel[Entry] = true;
+	}
+
+	auto JumpTo = [this, &ToTrace]( Word Target )
+	{
+		if ( InImage( Target ) )
+		{
+			IsLabel[Target] = true;
+			ToTrace.push_back( Target );
+		}
+	};
+
+	while ( !ToTrace.empty() )
+	{
+		u32 PC = ToTrace.back();
+		ToTrace.pop_back();
+
+		while ( InImage( PC ) && !IsInstruction[PC] )
+		{
+			const Byte Ins = Read( (Word)PC );
+			const ops::OpcodeInfo& Info = ops::Opcodes.Info[Ins];
+			if ( !InImage( PC + Info.Length - 1 ) )
+			{
+				break;	// runs off the end of the image, leave it to the interpreter
+			}
+			IsInstruction[PC] = true;
+
+			Word Operand = 0;
+			for ( Byte i = 1; i < Info.Length; i++ )
+			{
+				Operand |= Read( (Word)(PC + i) ) << (8 * (i - 1));
+			}
+			const Word NextPC = (Word)(PC + Info.Length);
+
+			if ( IsBranch( Ins ) )
+			{
+				JumpTo( NextPC + (SByte)Operand );
+				JumpTo( NextPC );
+				break;
+			}
+			if ( Ins == CPU::INS_JMP_ABS )
+			{
+				JumpTo( Operand );
+				break;
+			}
+			if ( Ins == CPU::INS_JSR )
+			{
+				// assume the subroutine returns
+				JumpTo( Operand );
+				JumpTo( NextPC );
+				break;
+			}
+			if ( Info.EndsBlock )
+			{
+				break;	// RTS, RTI, BRK, JMP ($nnnn) or illegal
+			}
+			PC = NextPC;
+		}
+	}
+}
+
+std::string m6502::Recompiler::Generate( const char* FunctionName ) const
+{
+	// an instruction that doesn't fall through to the next one generated
+	// has to goto it, so it needs a label
+	std::vector<bool> Labels = IsLabel;
+	std::vector<Word> Instructions;
+	for ( u32 Address = 0; Address < Mem::MAX_MEM; Address++ )
+	{
+		if ( IsInstruction[Address] )
+		{
+			Instructions.push_back( (Word)Address );
+		}
+	}
+	for ( size_t i = 0; i < Instructions.size(); i++ )
+	{
+		const Word PC = Instructions[i];
+		const u32 NextPC = PC + ops::Opcodes.Info[Read( PC )].Length;
+		const bool FallsThrough = !ops::Opcodes.Info[Read( PC )].EndsBlock;
+		const bool NextIsGenerated = i + 1 < Instructions.size() && Instructions[i + 1] == NextPC;
+		if ( FallsThrough && !NextIsGenerated && NextPC < Mem::MAX_MEM && IsInstruction[NextPC] )
+		{
+			Labels[NextPC] = true;
+		}
+	}
+
+	std::string Out;
+	Out += "// Generated by m6502-recomp from a PRG loaded at $" + Hex( LoadAddress, 4 ) + ", do not edit\n";
+	Out += "#include \"m6502.h\"\n";
+	Out += "#include \"m6502_ops.h\"\n\n";
+	Out += "/** Runs the recompiled program from cpu.PC, like CPU::Execute\n";
+	Out += "*	@return the number of cycles that were used */\n";
+	Out += std::string( "m6502::s32 " ) + FunctionName + "( m6502::s32 Cycles, m6502::CPU& cpu, m6502::Mem& memory )\n";
+	Out += "{\n";
+	Out += "\tusing namespace m6502;\n";
+	Out += "\tusing namespace m6502::ops;\n";
+	Out += "\tconst s32 CyclesRequested = Cycles;\n";
+	Out += "\tconst u64 TotalCyclesAtStart = cpu.TotalCycles;\n";
+	Out += "\tSyncFlagsOnExit FlagSync{ cpu };\n";
+	Out += "\tgoto Dispatch;\n";
+
+	for ( size_t i = 0; i < Instructions.size(); i++ )
+	{
+		const Word PC = Instructions[i];
+		const Byte Ins = Read( PC );
+		const ops::OpcodeInfo& Info = ops::Opcodes.Info[Ins];
+		const OpcodeName& Name = OpcodeNames.Info[Ins];
+		const u32 NextPC = PC + Info.Length;
+		Word Operand = 0;
+		for ( Byte b = 1; b < Info.Length; b++ )
+		{
+			Operand |= Read( (Word)(PC + b) ) << (8 * (b - 1));
+		}
+
+		if ( Labels[PC] )
+		{
+			// the budget is checked once per block, like CPU::ExecuteBlocks
+			s32 MaxCycles = 0;
+			for ( size_t j = i; j < Instructions.size(); j++ )
+			{
+				const ops::OpcodeInfo& BlockInfo = ops::Opcodes.Info[Read( Instructions[j] )];
+				MaxCycles += BlockInfo.MaxCycles;
+				const bool BlockEnds = BlockInfo.EndsBlock || j + 1 == Instructions.size() ||
+					Instructions[j + 1] != Instructions[j] + BlockInfo.Length || Labels[Instructions[j + 1]];
+				if ( BlockEnds )
+				{
+					break;
+				}
+			}
+			Out += "\n" + Label( PC ) + ":\n";
+			Out += "\tif ( Cycles <= " + std::to_string( MaxCycles ) + " ) { cpu.PC = 0x" + Hex( PC, 4 ) + "; goto Interpret; }\n";
+		}
+
+		if ( !Name.Operation )
+		{
+			Out += "\t// $" + Hex( PC, 4 ) + " illegal opcode $" + Hex( Ins, 2 ) + "\n";
+			Out += "\tcpu.PC = 0x" + Hex( PC, 4 ) + "; goto Interpret;\n";
+			continue;
+		}
+
+		const std::string Op = std::string( "Op< " ) + Name.Operation + ", " + Name.AddrMode + ", " +
+			std::to_string( Info.BaseCycles ) + " >::ExecuteDecoded( cpu, memory, 0x" + Hex( Operand, 4 ) + " )";
+		const std::string GotoNext = InImage( NextPC ) && Labels[(Word)NextPC] ?
+			"goto " + Label( (Word)NextPC ) + ";" : "cpu.PC = 0x" + Hex( NextPC & 0xFFFF, 4 ) + "; goto Dispatch;";
+		Out += "\t// $" + Hex( PC, 4 ) + " " + Name.Operation + " " + Name.AddrMode + " $" + Hex( Operand, 4 ) + "\n";
+		Out += "\tCycles -= " + std::to_string( Info.BaseCycles ) + ";\n";
+
+		if ( IsBranch( Ins ) )
+		{
+			const Word Target = (Word)(NextPC + (SByte)Operand);
+			const bool PageChanged = (Target >> 8) != (NextPC >> 8);
+			const std::string GotoTarget = InImage( Target ) && Labels[Target] ?
+				"goto " + Label( Target ) + ";" : "cpu.PC = 0x" + Hex( Target, 4 ) + "; goto Dispatch;";
+			Out += std::string( "\tif ( " ) + Name.Operation + "::Taken( cpu ) ) { Cycles -= " +
+				std::to_string( PageChanged ? 2 : 1 ) + "; " + GotoTarget + " }\n";
+			Out += "\t" + GotoNext + "\n";
+		}
+		else if ( Ins == CPU::INS_JMP_ABS )
+		{
+			Out += "\t" + std::string( InImage( Operand ) && Labels[Operand] ?
+				"goto " + Label( Operand ) + ";" : "cpu.PC = 0x" + Hex( Operand, 4 ) + "; goto Dispatch;" ) + "\n";
+		}
+		else if ( Info.EndsBlock )
+		{
+			// JSR, RTS, RTI, BRK & JMP ($nnnn) need the PC & set it
+			Out += "\tcpu.PC = 0x" + Hex( NextPC & 0xFFFF, 4 ) + ";\n";
+			Out += "\tCycles += " + Op + ";\n";
+			if ( Ins == CPU::INS_JSR && InImage( Operand ) && Labels[Operand] )
+			{
+				Out += "\tgoto " + Label( Operand ) + ";\n";
+			}
+			else
+			{
+				Out += "\tgoto Dispatch;\n";
+			}
+		}
+		else
+		{
+			Out += "\tCycles += " + Op + ";\n";
+			const bool NextIsGenerated = i + 1 < Instructions.size() && Instructions[i + 1] == NextPC;
+			if ( !NextIsGenerated )
+			{
+				Out += "\t" + GotoNext + "\n";
+			}
+		}
+	}
+
+	Out += "\n";
+	Out += "Interpret:\n";
+	Out += "\tcpu.SyncFlags();\n";
+	Out += "\tif ( Cycles <= 0 )\n";
+	Out += "\t{\n";
+	Out += "\t\tcpu.TotalCycles = TotalCyclesAtStart + (CyclesRequested - Cycles);\n";
+	Out += "\t\treturn CyclesRequested - Cycles;\n";
+	Out += "\t}\n";
+	Out += "\tCycles -= cpu.Execute( 1, memory );\n";
+	Out += "\n";
+	Out += "Dispatch:\n";
+	Out += "\tswitch ( cpu.PC )\n";
+	Out += "\t{\n";
+	for ( Word PC : Instructions )
+	{
+		if ( Labels[PC] )
+		{
+			Out += "\tcase 0x" + Hex( PC, 4 ) + ": goto " + Label( PC ) + ";\n";
+		}
+	}
+	Out += "\tdefault: goto Interpret;\n";
+	Out += "\t}\n";
+	Out += "}\n";
+	return Out;
+}
@@ -0,0 +1,245 @@
+#include "m6502_replay.h"
+
+namespace
+{
+	using namespace m6502;
+
+	const Byte MAGIC[4] = { 'M', '6', 'R', 'L' };
+
+	Byte RecordRead( void* Context, Word Address )
+	{
+		Recorder* Rec = (Recorder*)Context;
+		const Mem::Page& Device = Rec->Devices[Address / Mem::PAGE_SIZE];
+		const Byte Value = Device.OnRead( Device.Context, Address );
+		Rec->Log.AppendDeviceRead( Address, Value );
+		return Value;
+	}
+
+	void PassWrite( void* Context, Word Address, Byte Value )
+	{
+		Recorder* Rec = (Recorder*)Context;
+		const Mem::Page& Device = Rec->Devices[Address / Mem::PAGE_SIZE];
+		Device.OnWrite( Device.Context, Address, Value );
+	}
+
+	Byte ReadFromLog( void* Context, Word Address )
+	{
+		return ((Replayer*)Context)->ReplayRead( Address );
+	}
+}
+
+void m6502::InputLog::Begin( const Mem& memory )
+{
+	Stream.assign( MAGIC, MAGIC + 4 );
+	Stream.push_back( VERSION );
+	for ( u32 i = 0; i < Mem::NUM_PAGES / 8; i++ )
+	{
+		Byte Bits = 0;
+		for ( u32 Bit = 0; Bit < 8; Bit++ )
+		{
+			if ( !memory.Pages[i * 8 + Bit].Read )
+			{
+				Bits |= 1 << Bit;
+			}
+		}
+		Stream.push_back( Bits );
+	}
+	LastCycle = 0;
+}
+
+bool m6502::InputLog::IsValid() const
+{
+	return Stream.size() >= HEADER_SIZE &&
+		Stream[0] == MAGIC[0] && Stream[1] == MAGIC[1] && Stream[2] == MAGIC[2] && Stream[3] == MAGIC[3] &&
+		Stream[4] == VERSION;
+}
+
+bool m6502::InputLog::IsDevicePage( Byte Page ) const
+{
+	return (Stream[5 + Page / 8] & (1 << (Page % 8))) != 0;
+}
+
+void m6502::InputLog::AppendDeviceRead( Word Address, Byte Value )
+{
+	Stream.push_back( EVENT_DEVICE_READ );
+	Stream.push_back( Address & 0xFF );
+	Stream.push_back( Address >> 8 );
+	Stream.push_back( Value );
+}
+
+void m6502::InputLog::AppendTimed( EventType Type, u64 Cycle )
+{
+	Stream.push_back( Type );
+	u64 Delta = Cycle - LastCycle;
+	do
+	{
+		const Byte Low7 = Delta & 0x7F;
+		Delta >>= 7;
+		Stream.push_back( Delta ? Low7 | 0x80 : Low7 );
+	} while ( Delta );
+	LastCycle = Cycle;
+}
+
+bool m6502::InputLog::ReadEvent( u32& Offset, u64& PreviousCycle, Event& Out ) const
+{
+	if ( Offset >= Stream.size() )
+	{
+		return false;
+	}
+	Out.Type = (EventType)Stream[Offset];
+	if ( Out.Type == EVENT_DEVICE_READ )
+	{
+		if ( Offset + 4 > Stream.size() )
+		{
+			return false;
+		}
+		Out.Address = Stream[Offset + 1] | (Stream[Offset + 2] << 8);
+		Out.Value = Stream[Offset + 3];
+		Out.Cycle = 0;
+		Offset += 4;
+		return true;
+	}
+
+	u64 Delta = 0;
+	u32 At = Offset + 1;
+	for ( u32 Shift = 0; ; Shift += 7 )
+	{
+		if ( At >= Stream.size() || Shift > 63 )
+		{
+			return false;
+		}
+		const Byte Next = Stream[At++];
+		Delta |= (u64)(Next & 0x7F) << Shift;
+		if ( !(Next & 0x80) )
+		{
+			break;
+		}
+	}
+	Out.Address = 0;
+	Out.Value = 0;
+	Out.Cycle = PreviousCycle + Delta;
+	PreviousCycle = Out.Cycle;
+	Offset = At;
+	return true;
+}
+
+m6502::Recorder::~Recorder()
+{
+	Detach();
+}
+
+void m6502::Recorder::Attach( Mem& memory )
+{
+	Detach();
+	Memory = &memory;
+	Log.Begin( memory );
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		Devices[Page] = memory.Pages[Page];
+		if ( !memory.Pages[Page].Read )
+		{
+			memory.MapDevice( (Byte)Page, 1, RecordRead, PassWrite, this );
+		}
+	}
+}
+
+void m6502::Recorder::Detach()
+{
+	if ( !Memory )
+	{
+		return;
+	}
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( Memory->Pages[Page].Context == this )
+		{
+			const Mem::Page& Device = Devices[Page];
+			Memory->MapDevice( (Byte)Page, 1, Device.OnRead, Device.OnWrite, Device.Context );
+		}
+	}
+	Memory = nullptr;
+}
+
+void m6502::Recorder::RecordInterrupt( InputLog::EventType Type, u64 Cycle )
+{
+	Log.AppendTimed( Type, Cycle );
+}
+
+void m6502::Recorder::RecordReset( u64 Cycle )
+{
+	Log.AppendTimed( InputLog::EVENT_RESET, Cycle );
+}
+
+m6502::Replayer::~Replayer()
+{
+	Detach();
+}
+
+bool m6502::Replayer::Attach( const InputLog& log, Mem& memory )
+{
+	Detach();
+	if ( !log.IsValid() )
+	{
+		return false;
+	}
+	Log = &log;
+	Memory = &memory;
+	ReadOffset = TimedOffset = InputLog::HEADER_SIZE;
+	ReadLastCycle = TimedLastCycle = 0;
+	Diverged = false;
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( log.IsDevicePage( (Byte)Page ) )
+		{
+			memory.MapDevice( (Byte)Page, 1, ReadFromLog, nullptr, this );
+		}
+	}
+	return true;
+}
+
+void m6502::Replayer::Detach()
+{
+	if ( Memory )
+	{
+		for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+		{
+			if ( Memory->Pages[Page].Context == this )
+			{
+				Memory->MapDevice( (Byte)Page, 1, nullptr, nullptr, nullptr );
+			}
+		}
+	}
+	Log = nullptr;
+	Memory = nullptr;
+}
+
+bool m6502::Replayer::NextTimedEvent( InputLog::Event& Out )
+{
+	while ( Log && Log->ReadEvent( TimedOffset, TimedLastCycle, Out ) )
+	{
+		if ( Out.Type != InputLog::EVENT_DEVICE_READ )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+m6502::Byte m6502::Replayer::ReplayRead( Word Address )
+{
+	InputLog::Event Next;
+	while ( Log && Log->ReadEvent( ReadOffset, ReadLastCycle, Next ) )
+	{
+		if ( Next.Type == InputLog::EVENT_DEVICE_READ )
+		{
+			if ( Next.Address != Address )
+			{
+				Diverged = true;
+				return 0;
+			}
+			return Next.Value;
+		}
+	}
+	Diverged = true;
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "m6502_rewind.h"
+
+namespace
+{
+	using namespace m6502;
+
+	u64 SizeOf( const Snapshot& State, const Snapshot* Before )
+	{
+		u64 Bytes = sizeof( Snapshot );
+		for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+		{
+			if ( !Before || State.Pages[Page] != Before->Pages[Page] )
+			{
+				Bytes += sizeof( Snapshot::PageData );
+			}
+		}
+		return Bytes;
+	}
+}
+
+void m6502::Rewinder::Attach( CPU& cpu, Mem& memory )
+{
+	Detach();
+	Cpu = &cpu;
+	Memory = &memory;
+	Snapshots.Attach( memory );
+	Cycle = 0;
+	TakePoint();
+}
+
+void m6502::Rewinder::Detach()
+{
+	Snapshots.Detach();
+	Points.clear();
+	BytesUsed = 0;
+	Cpu = nullptr;
+	Memory = nullptr;
+}
+
+m6502::s32 m6502::Rewinder::Execute( s32 Cycles )
+{
+	s32 CyclesUsed = 0;
+	while ( CyclesUsed < Cycles )
+	{
+		const u64 NextPoint = Points.back().Cycle + Interval;
+		const u64 UntilNextPoint = NextPoint - Cycle;
+		const s32 Remaining = Cycles - CyclesUsed;
+		const s32 Run = UntilNextPoint < (u64)Remaining ? (s32)UntilNextPoint : Remaining;
+
+		const s32 Used = (Cpu->*Engine)( Run, *Memory );
+		CyclesUsed += Used;
+		Cycle += Used;
+		if ( Cycle >= NextPoint )
+		{
+			TakePoint();
+		}
+	}
+	return CyclesUsed;
+}
+
+bool m6502::Rewinder::StepBack( u64 Cycles )
+{
+	if ( Cycles > Cycle )
+	{
+		return false;
+	}
+	const u64 Target = Cycle - Cycles;
+	if ( Points.empty() || Points.front().Cycle > Target )
+	{
+		return false;
+	}
+
+	while ( Points.back().Cycle > Target )
+	{
+		BytesUsed -= Points.back().Bytes;
+		Points.pop_back();
+	}
+	Snapshots.Restore( Points.back().State, *Cpu );
+	Cycle = Points.back().Cycle;
+	if ( Target > Cycle )
+	{
+		Execute( (s32)(Target - Cycle) );
+	}
+	return true;
+}
+
+void m6502::Rewinder::TakePoint()
+{
+	std::shared_ptr<const Snapshot> State = Snapshots.Take( *Cpu );
+	const Snapshot* Before = Points.empty() ? nullptr : Points.back().State.get();
+	const u64 Bytes = SizeOf( *State, Before );
+	Points.push_back( { Cycle, State, Bytes } );
+	BytesUsed += Bytes;
+
+	// the oldest goes, the next one then holds all of its pages
+	while ( BytesUsed > MemoryBudget && Points.size() > 1 )
+	{
+		BytesUsed -= Points.front().Bytes;
+		Points.pop_front();
+		BytesUsed -= Points.front().Bytes;
+		Points.front().Bytes = SizeOf( *Points.front().State, nullptr );
+		BytesUsed += Points.front().Bytes;
+	}
+}
@@ -0,0 +1,174 @@
+#include <stddef.h>
+#include <string.h>
+#include "m6502_savestate.h"
+
+static_assert( sizeof( m6502::SaveState::Header ) == 64 + 2 * m6502::Mem::NUM_PAGES,
+	"the save state header has to be the same on every compiler" );
+
+namespace
+{
+	using namespace m6502;
+
+	const Byte MAGIC[4] = { 'M', '6', 'S', 'S' };
+
+	constexpr u32 CHECKSUM_START = offsetof( SaveState::Header, Checksum ) + sizeof( u32 );
+
+	u32 AlignUp( u32 Offset )
+	{
+		return (Offset + SaveState::ALIGNMENT - 1) & ~(SaveState::ALIGNMENT - 1);
+	}
+
+	bool IsZero( const Byte* Bytes, u32 NumBytes )
+	{
+		for ( u32 i = 0; i < NumBytes; i++ )
+		{
+			if ( Bytes[i] )
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+std::vector<m6502::Byte> m6502::SaveState::Write( const CPU& cpu, const Mem& memory,
+	const Byte* DeviceState, u32 DeviceStateSize )
+{
+	Header Head;
+	memset( &Head, 0, sizeof( Head ) );
+	memcpy( Head.Magic, MAGIC, sizeof( MAGIC ) );
+	Head.Version = VERSION;
+	Head.HeaderSize = sizeof( Header );
+	Head.PC = cpu.PC;
+	Head.SP = cpu.SP;
+	Head.A = cpu.A;
+	Head.X = cpu.X;
+	Head.Y = cpu.Y;
+	Head.PS = cpu.GetPS();
+	Head.Interrupts = (cpu.IrqLine ? INTERRUPT_IRQ_LINE : 0) | (cpu.NmiPending ? INTERRUPT_NMI_PENDING : 0);
+	Head.TotalCyclesLow = (u32)cpu.TotalCycles;
+	Head.TotalCyclesHigh = (u32)(cpu.TotalCycles >> 32);
+
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( !IsZero( memory.Data + Page * Mem::PAGE_SIZE, Mem::PAGE_SIZE ) )
+		{
+			Head.PageSlots[Page] = (Word)++Head.NumPages;
+		}
+	}
+	Head.PagesOffset = AlignUp( sizeof( Header ) );
+	Head.DeviceStateOffset = Head.PagesOffset + Head.NumPages * Mem::PAGE_SIZE;
+	Head.DeviceStateSize = DeviceStateSize;
+	Head.TotalSize = Head.DeviceStateOffset + DeviceStateSize;
+
+	std::vector<Byte> Out( Head.TotalSize, 0 );
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( Head.PageSlots[Page] )
+		{
+			memcpy( Out.data() + Head.PagesOffset + (Head.PageSlots[Page] - 1) * Mem::PAGE_SIZE,
+				memory.Data + Page * Mem::PAGE_SIZE, Mem::PAGE_SIZE );
+		}
+	}
+	if ( DeviceStateSize )
+	{
+		memcpy( Out.data() + Head.DeviceStateOffset, DeviceState, DeviceStateSize );
+	}
+	memcpy( Out.data(), &Head, sizeof( Head ) );
+
+	const u32 Sum = Checksum( Out.data() + CHECKSUM_START, Head.TotalSize - CHECKSUM_START );
+	memcpy( Out.data() + offsetof( Header, Checksum ), &Sum, sizeof( Sum ) );
+	return Out;
+}
+
+bool m6502::SaveState::Open( const Byte* Data, u32 NumBytes, bool VerifyChecksum )
+{
+	Head = nullptr;
+	Size = 0;
+	if ( !Data || NumBytes < sizeof( Header ) )
+	{
+		return false;
+	}
+
+	const Header* H = (const Header*)Data;
+	if ( memcmp( H->Magic, MAGIC, sizeof( MAGIC ) ) != 0 || H->Version < 1 || H->Version > VERSION ||
+		H->HeaderSize < sizeof( Header ) || H->TotalSize > NumBytes )
+	{
+		return false;
+	}
+
+	// everything the accessors touch has to be inside the save state
+	const u64 PagesEnd = (u64)H->PagesOffset + (u64)H->NumPages * Mem::PAGE_SIZE;
+	const u64 DeviceStateEnd = (u64)H->DeviceStateOffset + H->DeviceStateSize;
+	if ( H->NumPages > Mem::NUM_PAGES || H->PagesOffset < H->HeaderSize ||
+		PagesEnd > H->TotalSize || DeviceStateEnd > H->TotalSize )
+	{
+		return false;
+	}
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( H->PageSlots[Page] > H->NumPages )
+		{
+			return false;
+		}
+	}
+
+	if ( VerifyChecksum && Checksum( Data + CHECKSUM_START, H->TotalSize - CHECKSUM_START ) != H->Checksum )
+	{
+		return false;
+	}
+
+	Head = H;
+	Size = H->TotalSize;
+	return true;
+}
+
+void m6502::SaveState::Load( CPU& cpu, Mem& memory ) const
+{
+	cpu.PC = Head->PC;
+	cpu.SP = Head->SP;
+	cpu.A = Head->A;
+	cpu.X = Head->X;
+	cpu.Y = Head->Y;
+	cpu.SetPS( Head->PS );
+	if ( Head->Version >= 2 )
+	{
+		cpu.IrqLine = (Head->Interrupts & INTERRUPT_IRQ_LINE) != 0;
+		cpu.NmiPending = (Head->Interrupts & INTERRUPT_NMI_PENDING) != 0;
+		cpu.TotalCycles = Head->TotalCyclesLow | ((u64)Head->TotalCyclesHigh << 32);
+	}
+
+	for ( u32 PageNumber = 0; PageNumber < Mem::NUM_PAGES; PageNumber++ )
+	{
+		Byte* To = memory.Data + PageNumber * Mem::PAGE_SIZE;
+		const Byte* From = Page( (Byte)PageNumber );
+		if ( From )
+		{
+			memcpy( To, From, Mem::PAGE_SIZE );
+		}
+		else
+		{
+			memset( To, 0, Mem::PAGE_SIZE );
+		}
+		memory.MarkWritten( (Word)(PageNumber * Mem::PAGE_SIZE) );
+	}
+
+	if ( memory.Decoded )
+	{
+		memory.Decoded->Flush();
+	}
+	if ( memory.Blocks )
+	{
+		memory.Blocks->Flush();
+	}
+}
+
+m6502::u32 m6502::SaveState::Checksum( const Byte* Data, u32 NumBytes )
+{
+	u32 Hash = 2166136261u;
+	for ( u32 i = 0; i < NumBytes; i++ )
+	{
+		Hash = (Hash ^ Data[i]) * 16777619u;
+	}
+	return Hash;
+}
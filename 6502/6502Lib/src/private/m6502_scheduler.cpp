@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "m6502_scheduler.h"
+#include "m6502_replay.h"
+
+namespace
+{
+	using namespace m6502;
+
+	/** std::push_heap makes a max heap, so "less" is "later" */
+	bool Later( const Scheduler::Event& A, const Scheduler::Event& B )
+	{
+		return A.Cycle != B.Cycle ? A.Cycle > B.Cycle : A.Sequence > B.Sequence;
+	}
+}
+
+void m6502::Scheduler::Attach( CPU& cpu, Mem& memory )
+{
+	Cpu = &cpu;
+	Memory = &memory;
+	Clear();
+}
+
+void m6502::Scheduler::Schedule( u64 AtCycle, Action What )
+{
+	Push( { AtCycle, NextSequence++, What, nullptr, nullptr } );
+}
+
+void m6502::Scheduler::Schedule( u64 AtCycle, Callback Call, void* Context )
+{
+	Push( { AtCycle, NextSequence++, Action::Call, Call, Context } );
+}
+
+void m6502::Scheduler::Clear()
+{
+	Events.clear();
+}
+
+void m6502::Scheduler::Push( const Event& Scheduled )
+{
+	Events.push_back( Scheduled );
+	std::push_heap( Events.begin(), Events.end(), Later );
+}
+
+void m6502::Scheduler::FireDueEvents()
+{
+	while ( !Events.empty() && Events.front().Cycle <= Cpu->TotalCycles )
+	{
+		std::pop_heap( Events.begin(), Events.end(), Later );
+		const Event Due = Events.back();
+		Events.pop_back();
+
+		// the line as it was, callbacks raise & clear it too
+		const bool IrqWasRaised = Cpu->IrqLine;
+		const bool NmiWasPending = Cpu->NmiPending;
+		switch ( Due.What )
+		{
+		case Action::RaiseIRQ:
+			Cpu->RaiseIRQ();
+			break;
+		case Action::ClearIRQ:
+			Cpu->ClearIRQ();
+			break;
+		case Action::RaiseNMI:
+			Cpu->RaiseNMI();
+			break;
+		case Action::Call:
+			Due.Call( Due.Context, *this );
+			break;
+		}
+
+		if ( Recording )
+		{
+			if ( Cpu->NmiPending && !NmiWasPending )
+			{
+				Recording->RecordInterrupt( InputLog::EVENT_NMI, Cpu->TotalCycles );
+			}
+			if ( Cpu->IrqLine != IrqWasRaised )
+			{
+				Recording->RecordInterrupt( Cpu->IrqLine ? InputLog::EVENT_IRQ : InputLog::EVENT_CLEAR_IRQ, Cpu->TotalCycles );
+			}
+		}
+	}
+}
+
+m6502::s32 m6502::Scheduler::Execute( s32 Cycles )
+{
+	// the engines & ServiceInterrupts count in TotalCycles
+	const u64 Start = Cpu->TotalCycles;
+	const u64 End = Start + (Cycles > 0 ? Cycles : 0);
+	while ( Cpu->TotalCycles < End )
+	{
+		FireDueEvents();
+		if ( Cpu->ServiceInterrupts( *Memory ) )
+		{
+			continue;
+		}
+
+		const u64 Until = NextEventCycle() < End ? NextEventCycle() : End;
+		const bool IrqMasked = Cpu->IrqLine && Cpu->Flag.I;
+		const s32 Slice = IrqMasked ? 1 : (s32)(Until - Cpu->TotalCycles);
+		(Cpu->*Engine)( Slice, *Memory );
+	}
+	return (s32)(Cpu->TotalCycles - Start);
+}
@@ -0,0 +1,83 @@
+#include <string.h>
+#include "m6502_snapshot.h"
+
+void m6502::Snapshotter::Attach( Mem& memory )
+{
+	Memory = &memory;
+	Memory->TrackDirtyPages = true;
+	Current = nullptr;		// nothing is known about the memory yet
+}
+
+void m6502::Snapshotter::Detach()
+{
+	if ( Memory )
+	{
+		Memory->TrackDirtyPages = false;
+	}
+	Memory = nullptr;
+	Current = nullptr;
+}
+
+std::shared_ptr<const m6502::Snapshot> m6502::Snapshotter::Take( const CPU& cpu )
+{
+	std::shared_ptr<Snapshot> Taken = std::make_shared<Snapshot>();
+	Taken->Cpu = cpu;
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( Current && !Memory->IsPageDirty( (Byte)Page ) )
+		{
+			Taken->Pages[Page] = Current->Pages[Page];
+		}
+		else
+		{
+			std::shared_ptr<Snapshot::PageData> Copy;
+			if ( Arena )
+			{
+				PageArena* From = Arena;
+				Copy.reset( Arena->Allocate(), [From]( PageFrame* Frame ) { From->Free( Frame ); } );
+			}
+			else
+			{
+				Copy = std::make_shared<Snapshot::PageData>();
+			}
+			memcpy( Copy->Bytes, Memory->Data + Page * Mem::PAGE_SIZE, Mem::PAGE_SIZE );
+			Taken->Pages[Page] = Copy;
+		}
+	}
+
+	Memory->ClearDirtyPages();
+	Current = Taken;
+	return Current;
+}
+
+void m6502::Snapshotter::Restore( const std::shared_ptr<const Snapshot>& From, CPU& cpu )
+{
+	cpu = From->Cpu;
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		const bool Same = Current && !Memory->IsPageDirty( (Byte)Page ) &&
+			Current->Pages[Page] == From->Pages[Page];
+		if ( Same )
+		{
+			continue;
+		}
+
+		memcpy( Memory->Data + Page * Mem::PAGE_SIZE, From->Pages[Page]->Bytes, Mem::PAGE_SIZE );
+		Memory->MarkWritten( (Word)(Page * Mem::PAGE_SIZE) );
+		for ( u32 i = 0; i < Mem::PAGE_SIZE; i++ )
+		{
+			const Word Address = (Word)(Page * Mem::PAGE_SIZE + i);
+			if ( Memory->Decoded )
+			{
+				Memory->Decoded->Invalidate( Address );
+			}
+			if ( Memory->Blocks )
+			{
+				Memory->Blocks->Invalidate( Address );
+			}
+		}
+	}
+
+	Memory->ClearDirtyPages();
+	Current = From;
+}
@@ -0,0 +1,71 @@
+#include <type_traits>
+#include "m6502.h"
+#include "m6502_ops.h"
+
+m6502::ops::OpcodeTable::OpcodeTable()
+{
+	for ( OpcodeInfo& Entry : Info )
+	{
+		Entry.Execute = &IllegalOpcode;
+		Entry.ExecuteDecoded = &IllegalOpcodeDecoded;
+		Entry.Length = 1;
+		Entry.BaseCycles = 0;
+		Entry.MaxCycles = 0;
+		Entry.EndsBlock = true;
+	}
+
+#define M6502_TABLE_ENTRY( Ins, Operation, AddrMode, Cycles ) \
+	Info[CPU::Ins].Execute = &Op< Operation, AddrMode, Cycles >::Execute; \
+	Info[CPU::Ins].ExecuteDecoded = &Op< Operation, AddrMode, Cycles >::ExecuteDecoded; \
+	Info[CPU::Ins].Length = 1 + AddrMode::OperandBytes; \
+	Info[CPU::Ins].BaseCycles = Cycles; \
+	Info[CPU::Ins].MaxCycles = Cycles + AddrMode::PenaltyCycles; \
+	Info[CPU::Ins].EndsBlock = std::is_base_of< ControlTransfer, Operation >::value;
+	M6502_OPCODES( M6502_TABLE_ENTRY )
+#undef M6502_TABLE_ENTRY
+}
+
+const m6502::ops::OpcodeTable m6502::ops::Opcodes;
+
+m6502::s32 m6502::CPU::ExecuteTable( s32 Cycles, Mem & memory )
+{
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	while ( Cycles > 0 )
+	{
+		Byte Ins = FetchByte( memory );
+		Cycles += ops::Opcodes.Info[Ins].Execute( *this, memory );
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
+
+m6502::u64 m6502::CPU::RunUntilCycle( u64 Cycle, Mem & memory )
+{
+	// in budgets that fit an s32, the loop of each is the same as ExecuteTable's
+	constexpr u64 MaxBudget = 0x40000000;
+	const u64 Start = TotalCycles;
+	while ( TotalCycles < Cycle )
+	{
+		const u64 Left = Cycle - TotalCycles;
+		ExecuteTable( (s32)(Left < MaxBudget ? Left : MaxBudget), memory );
+	}
+	return TotalCycles - Start;
+}
+
+m6502::s32 m6502::CPU::RunUntilPC( Word Address, s32 MaxCycles, Mem & memory )
+{
+	s32 Cycles = MaxCycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	while ( PC != Address && Cycles > 0 )
+	{
+		Byte Ins = FetchByte( memory );
+		Cycles += ops::Opcodes.Info[Ins].Execute( *this, memory );
+	}
+
+	const s32 NumCyclesUsed = MaxCycles - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
@@ -0,0 +1,80 @@
+#include <initializer_list>
+#include "m6502.h"
+#include "m6502_ops.h"
+
+#if defined( M6502_THREADED_DISPATCH ) && defined( __GNUC__ )
+
+/**	Direct threaded dispatch using the GCC/Clang labels-as-values extension.
+*	Every handler ends with its own fetch & indirect jump to the next opcode,
+*	so the branch predictor gets one jump per opcode to learn from instead of
+*	the single shared one at the top of a switch. */
+m6502::s32 m6502::CPU::ExecuteThreaded( s32 Cycles, Mem & memory )
+{
+	// indexed by the opcode, built from M6502_OPCODES like ops::Opcodes and
+	// the handlers below, a static local so it's only built once
+	struct DispatchTable
+	{
+		struct Entry
+		{
+			Byte Opcode;
+			void* Target;
+		};
+
+		void* Target[256];
+
+		DispatchTable( void* Illegal, std::initializer_list< Entry > Handlers )
+		{
+			for ( void*& Slot : Target )
+			{
+				Slot = Illegal;
+			}
+			for ( const Entry& Handler : Handlers )
+			{
+				Target[Handler.Opcode] = Handler.Target;
+			}
+		}
+	};
+#define M6502_DISPATCH_ENTRY( Ins, Operation, AddrMode, BaseCycles ) { CPU::Ins, &&Label_##Ins },
+	static const DispatchTable Dispatch{ &&Label_Illegal, { M6502_OPCODES( M6502_DISPATCH_ENTRY ) } };
+#undef M6502_DISPATCH_ENTRY
+
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+
+#define M6502_DISPATCH_NEXT() \
+	if ( Cycles <= 0 ) \
+	{ \
+		goto Done; \
+	} \
+	goto *Dispatch.Target[FetchByte( memory )];
+
+	M6502_DISPATCH_NEXT();
+
+#define M6502_THREADED_HANDLER( Ins, Operation, AddrMode, BaseCycles ) \
+Label_##Ins: \
+	Cycles += ops::Op< ops::Operation, ops::AddrMode, BaseCycles >::Execute( *this, memory ); \
+	M6502_DISPATCH_NEXT();
+
+	M6502_OPCODES( M6502_THREADED_HANDLER )
+
+#undef M6502_THREADED_HANDLER
+#undef M6502_DISPATCH_NEXT
+
+Label_Illegal:
+	ops::IllegalOpcode( *this, memory );
+
+Done:
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
+
+#else
+
+/** No labels-as-values (e.g. MSVC) or not asked for, use the portable engine */
+m6502::s32 m6502::CPU::ExecuteThreaded( s32 Cycles, Mem & memory )
+{
+	return ExecuteTable( Cycles, memory );
+}
+
+#endif
@@ -0,0 +1,501 @@
+#include <string.h>
+#include <chrono>
+#include "m6502_trace.h"
+#include "m6502_ops.h"
+
+namespace
+{
+	using namespace m6502;
+
+	constexpr u32 NO_CODE = 0xFFFFFFFF;	//never the code of an instruction, which is 24 bits
+	constexpr u32 RECORDS_PER_POP = 1024;
+	constexpr size_t FLUSH_BYTES = 64 * 1024;
+	constexpr size_t MAX_RECORD_BYTES = 1 + 2 + 3 + 5 + 10;
+
+	/** Publishes the records ExecuteTrace committed when it returns or when
+	*	an instruction throws, a trace that ends in a crash needs them most */
+	struct PublishOnExit
+	{
+		TraceRing& Ring;
+
+		~PublishOnExit()
+		{
+			Ring.Publish();
+		}
+	};
+
+	/** The mnemonic & operand syntax of every opcode, for TraceReader::Format */
+	struct OpcodeText
+	{
+		const char* Mnemonic;	//nullptr when illegal
+		const char* Operand;	//printf format of the operand
+		bool Relative;			//the operand is a branch offset
+	};
+
+	struct OpcodeTextTable
+	{
+		OpcodeText Info[256];
+
+		OpcodeTextTable()
+		{
+			for ( OpcodeText& Entry : Info )
+			{
+				Entry = { nullptr, "", false };
+			}
+
+#define M6502_TRACE_ENTRY( Ins, Operation, AddrMode, Cycles ) \
+			Info[CPU::Ins] = { #Operation, OperandFormat( #AddrMode ), strcmp( #AddrMode, "AddrRelative" ) == 0 };
+			M6502_OPCODES( M6502_TRACE_ENTRY )
+#undef M6502_TRACE_ENTRY
+		}
+
+		static const char* OperandFormat( const char* AddrMode )
+		{
+			const struct { const char* AddrMode; const char* Format; } Formats[] = {
+				{ "AddrImmediate", "#$%02X" },
+				{ "AddrZeroPage", "$%02X" },
+				{ "AddrZeroPageX", "$%02X,X" },
+				{ "AddrZeroPageY", "$%02X,Y" },
+				{ "AddrAbsolute", "$%04X" },
+				{ "AddrAbsoluteX", "$%04X,X" },
+				{ "AddrAbsoluteY", "$%04X,Y" },
+				{ "AddrIndirect", "($%04X)" },
+				{ "AddrIndirectX", "($%02X,X)" },
+				{ "AddrIndirectY", "($%02X),Y" },
+				{ "AddrRelative", "$%04X" },	//the target
+				{ "AddrAccumulator", "A" },
+			};
+			// e.g. AddrAbsoluteX_5 is AddrAbsoluteX that always takes 5 cycles
+			for ( const auto& Entry : Formats )
+			{
+				const size_t Length = strlen( Entry.AddrMode );
+				if ( strncmp( Entry.AddrMode, AddrMode, Length ) == 0 && (AddrMode[Length] == '\0' || AddrMode[Length] == '_') )
+				{
+					return Entry.Format;
+				}
+			}
+			return "";
+		}
+	};
+
+	const OpcodeTextTable OpcodeTexts;
+
+	/** The opcode & the operands in its length, as 24 bits */
+	u32 CodeOf( const TraceRecord& Record )
+	{
+		const Byte Length = ops::Opcodes.Info[Record.Opcode].Length;
+		return Record.Opcode |
+			(Length > 1 ? Record.Operand[0] << 8 : 0) |
+			(Length > 2 ? Record.Operand[1] << 16 : 0);
+	}
+
+	Word FallsThroughTo( const TraceRecord& Record )
+	{
+		return (Word)(Record.PC + ops::Opcodes.Info[Record.Opcode].Length);
+	}
+}
+
+m6502::TraceRing::TraceRing( u32 Capacity )
+{
+	u32 Size = 1;
+	while ( Size < Capacity )
+	{
+		Size <<= 1;
+	}
+	Records.resize( Size );
+	Mask = Size - 1;
+}
+
+m6502::u32 m6502::TraceRing::Pop( TraceRecord* Out, u32 MaxRecords )
+{
+	const u32 From = Tail.load( std::memory_order_relaxed );
+	const u32 Available = Head.load( std::memory_order_acquire ) - From;
+	const u32 NumRecords = Available < MaxRecords ? Available : MaxRecords;
+	for ( u32 i = 0; i < NumRecords; i++ )
+	{
+		Out[i] = Records[(From + i) & Mask];
+	}
+	Tail.store( From + NumRecords, std::memory_order_release );
+	return NumRecords;
+}
+
+m6502::Tracer::Tracer( u32 Capacity )
+	: Ring( Capacity )
+{
+}
+
+m6502::Tracer::~Tracer()
+{
+	Close();
+	Detach();
+}
+
+bool m6502::Tracer::Open( const char* Path )
+{
+	Close();
+	File = fopen( Path, "wb" );
+	if ( !File )
+	{
+		return false;
+	}
+
+	NumStalls = 0;
+	NumRecords = 0;
+	NumBytes = 0;
+	LastCode.assign( Mem::MAX_MEM, NO_CODE );
+	Last = {};
+	First = true;
+	Buffer.resize( FLUSH_BYTES + MAX_RECORD_BYTES );
+	memcpy( Buffer.data(), "M6TR", 4 );
+	Buffer[4] = VERSION;
+	BufferUsed = HEADER_SIZE;
+
+	Closing.store( false );
+	Writer = std::thread( &Tracer::Write, this );
+	return true;
+}
+
+void m6502::Tracer::Close()
+{
+	if ( !File )
+	{
+		return;
+	}
+	// from the CPU's thread, in case a run left records unpublished
+	Ring.Publish();
+	Closing.store( true, std::memory_order_release );
+	Writer.join();
+	Flush();
+	fclose( File );
+	File = nullptr;
+}
+
+void m6502::Tracer::Attach( Mem& memory )
+{
+	Detach();
+	Memory = &memory;
+	memory.Trace = this;
+}
+
+void m6502::Tracer::Detach()
+{
+	if ( Memory && Memory->Trace == this )
+	{
+		Memory->Trace = nullptr;
+	}
+	Memory = nullptr;
+}
+
+void m6502::Tracer::Write()
+{
+	TraceRecord Popped[RECORDS_PER_POP];
+	for ( ;; )
+	{
+		// read Closing first, so nothing pushed before Close is missed
+		const bool LastPass = Closing.load( std::memory_order_acquire );
+		const u32 NumPopped = Ring.Pop( Popped, RECORDS_PER_POP );
+		for ( u32 i = 0; i < NumPopped; i++ )
+		{
+			Encode( Popped[i] );
+			if ( BufferUsed >= FLUSH_BYTES )
+			{
+				Flush();
+			}
+		}
+		if ( NumPopped == 0 )
+		{
+			if ( LastPass )
+			{
+				return;
+			}
+			std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+		}
+	}
+}
+
+void m6502::Tracer::Encode( const TraceRecord& Record )
+{
+	const u32 Code = CodeOf( Record );
+	Byte Contents = 0;
+	if ( First )
+	{
+		Contents = TRACE_PC | TRACE_A | TRACE_X | TRACE_Y | TRACE_SP | TRACE_PS;
+		First = false;
+	}
+	else
+	{
+		Contents |= Record.PC != FallsThroughTo( Last ) ? TRACE_PC : 0;
+		Contents |= Record.A != Last.A ? TRACE_A : 0;
+		Contents |= Record.X != Last.X ? TRACE_X : 0;
+		Contents |= Record.Y != Last.Y ? TRACE_Y : 0;
+		Contents |= Record.SP != Last.SP ? TRACE_SP : 0;
+		Contents |= Record.PS != Last.PS ? TRACE_PS : 0;
+	}
+	Contents |= Code != LastCode[Record.PC] ? TRACE_CODE : 0;
+
+	// there is always room for a record past BufferUsed
+	Byte* Out = Buffer.data() + BufferUsed;
+	*Out++ = Contents;
+	if ( Contents & TRACE_PC )
+	{
+		*Out++ = Record.PC & 0xFF;
+		*Out++ = Record.PC >> 8;
+	}
+	if ( Contents & TRACE_CODE )
+	{
+		const Byte Length = ops::Opcodes.Info[Record.Opcode].Length;
+		for ( Byte i = 0; i < Length; i++ )
+		{
+			*Out++ = (Code >> (8 * i)) & 0xFF;
+		}
+		LastCode[Record.PC] = Code;
+	}
+	const Byte Registers[] = { Record.A, Record.X, Record.Y, Record.SP, Record.PS };
+	for ( u32 i = 0; i < sizeof( Registers ); i++ )
+	{
+		if ( Contents & (TRACE_A << i) )
+		{
+			*Out++ = Registers[i];
+		}
+	}
+	u64 Delta = Record.Cycle - Last.Cycle;
+	do
+	{
+		const Byte Low7 = Delta & 0x7F;
+		Delta >>= 7;
+		*Out++ = Delta ? Low7 | 0x80 : Low7;
+	} while ( Delta );
+	BufferUsed = (size_t)(Out - Buffer.data());
+
+	Last = Record;
+	NumRecords++;
+}
+
+void m6502::Tracer::Flush()
+{
+	NumBytes += fwrite( Buffer.data(), 1, BufferUsed, File );
+	BufferUsed = 0;
+}
+
+m6502::s32 m6502::CPU::ExecuteTrace( s32 Cycles, Mem & memory )
+{
+	// nothing would empty the ring of a Tracer that isn't open
+	if ( !memory.Trace || !memory.Trace->IsOpen() )
+	{
+		return ExecuteTable( Cycles, memory );
+	}
+
+	Tracer& Trace = *memory.Trace;
+	const s32 CyclesRequested = Cycles;
+	ops::SyncFlagsOnExit FlagSync{ *this };
+	PublishOnExit Publish{ Trace.Ring };
+	while ( Cycles > 0 )
+	{
+		TraceRecord& Record = Trace.Claim();
+		Record.Cycle = TotalCycles + (CyclesRequested - Cycles);
+		Record.PC = PC;
+		const Byte* Page = memory.Pages[PC / Mem::PAGE_SIZE].Code;
+		if ( Page && PC % Mem::PAGE_SIZE < Mem::PAGE_SIZE - 2 )
+		{
+			const Byte* Code = Page + PC % Mem::PAGE_SIZE;
+			Record.Opcode = Code[0];
+			Record.Operand[0] = Code[1];
+			Record.Operand[1] = Code[2];
+		}
+		else
+		{
+			Record.Opcode = memory.Peek( PC );
+			Record.Operand[0] = memory.Peek( (Word)(PC + 1) );
+			Record.Operand[1] = memory.Peek( (Word)(PC + 2) );
+		}
+		Record.A = A;
+		Record.X = X;
+		Record.Y = Y;
+		Record.SP = SP;
+		Record.PS = GetPS();
+		Trace.Ring.Commit();
+
+		Byte Ins = FetchByte( memory );
+		Cycles += ops::Opcodes.Info[Ins].Execute( *this, memory );
+	}
+
+	const s32 NumCyclesUsed = CyclesRequested - Cycles;
+	TotalCycles += NumCyclesUsed;
+	return NumCyclesUsed;
+}
+
+bool m6502::TraceReader::Load( const char* Path )
+{
+	Stream.clear();
+	FILE* File = fopen( Path, "rb" );
+	if ( !File )
+	{
+		return false;
+	}
+	Byte Chunk[64 * 1024];
+	size_t NumRead;
+	while ( (NumRead = fread( Chunk, 1, sizeof( Chunk ), File )) > 0 )
+	{
+		Stream.insert( Stream.end(), Chunk, Chunk + NumRead );
+	}
+	fclose( File );
+	Rewind();
+	return IsValid();
+}
+
+bool m6502::TraceReader::IsValid() const
+{
+	return Stream.size() >= Tracer::HEADER_SIZE && memcmp( Stream.data(), "M6TR", 4 ) == 0 &&
+		Stream[4] == Tracer::VERSION;
+}
+
+void m6502::TraceReader::Rewind()
+{
+	Offset = Tracer::HEADER_SIZE;
+	LastCode.assign( Mem::MAX_MEM, NO_CODE );
+	Last = {};
+	First = true;
+}
+
+bool m6502::TraceReader::Next( TraceRecord& Out )
+{
+	if ( !IsValid() || Offset >= Stream.size() )
+	{
+		return false;
+	}
+	u32 At = Offset;
+	auto Take = [this, &At]( Byte& Value ) -> bool
+	{
+		if ( At >= Stream.size() )
+		{
+			return false;
+		}
+		Value = Stream[At++];
+		return true;
+	};
+
+	Byte Contents = 0;
+	Take( Contents );
+	TraceRecord Record = Last;
+	if ( First && !(Contents & Tracer::TRACE_PC) )
+	{
+		return false;
+	}
+	if ( Contents & Tracer::TRACE_PC )
+	{
+		Byte Low, High;
+		if ( !Take( Low ) || !Take( High ) )
+		{
+			return false;
+		}
+		Record.PC = Low | (High << 8);
+	}
+	else
+	{
+		Record.PC = FallsThroughTo( Last );
+	}
+
+	u32 Code = LastCode[Record.PC];
+	if ( Contents & Tracer::TRACE_CODE )
+	{
+		Byte Opcode;
+		if ( !Take( Opcode ) )
+		{
+			return false;
+		}
+		Code = Opcode;
+		for ( Byte i = 1; i < ops::Opcodes.Info[Opcode].Length; i++ )
+		{
+			Byte Operand;
+			if ( !Take( Operand ) )
+			{
+				return false;
+			}
+			Code |= Operand << (8 * i);
+		}
+	}
+	else if ( Code == NO_CODE )
+	{
+		return false;
+	}
+	Record.Opcode = Code & 0xFF;
+	Record.Operand[0] = (Code >> 8) & 0xFF;
+	Record.Operand[1] = (Code >> 16) & 0xFF;
+
+	Byte* Registers[] = { &Record.A, &Record.X, &Record.Y, &Record.SP, &Record.PS };
+	for ( u32 i = 0; i < sizeof( Registers ) / sizeof( Registers[0] ); i++ )
+	{
+		if ( (Contents & (Tracer::TRACE_A << i)) && !Take( *Registers[i] ) )
+		{
+			return false;
+		}
+	}
+
+	u64 Delta = 0;
+	for ( u32 Shift = 0; ; Shift += 7 )
+	{
+		Byte Next;
+		if ( Shift > 63 || !Take( Next ) )
+		{
+			return false;
+		}
+		Delta |= (u64)(Next & 0x7F) << Shift;
+		if ( !(Next & 0x80) )
+		{
+			break;
+		}
+	}
+	Record.Cycle = Last.Cycle + Delta;
+
+	LastCode[Record.PC] = Code;
+	Last = Record;
+	First = false;
+	Offset = At;
+	Out = Record;
+	return true;
+}
+
+std::string m6502::TraceReader::Format( const TraceRecord& Record )
+{
+	const OpcodeText& Text = OpcodeTexts.Info[Record.Opcode];
+	const Byte Length = ops::Opcodes.Info[Record.Opcode].Length;
+
+	char Bytes[12];
+	const char* BytesFormats[] = { "%02X", "%02X %02X", "%02X %02X %02X" };
+	snprintf( Bytes, sizeof( Bytes ), BytesFormats[Length - 1], Record.Opcode, Record.Operand[0], Record.Operand[1] );
+
+	char Instruction[16] = "???";
+	if ( Text.Mnemonic )
+	{
+		const Word Operand = Text.Relative ? (Word)(Record.PC + 2 + (SByte)Record.Operand[0]) :
+			Length > 2 ? (Word)(Record.Operand[0] | (Record.Operand[1] << 8)) : Record.Operand[0];
+		char OperandText[12];
+		snprintf( OperandText, sizeof( OperandText ), Text.Operand, Operand );
+		snprintf( Instruction, sizeof( Instruction ), OperandText[0] ? "%s %s" : "%s", Text.Mnemonic, OperandText );
+	}
+
+	char Flags[9];
+	for ( u32 Bit = 0; Bit < 8; Bit++ )
+	{
+		Flags[Bit] = Record.PS & (0x80 >> Bit) ? '1' : '0';
+	}
+	Flags[8] = '\0';
+
+	char Line[96];
+	snprintf( Line, sizeof( Line ), "%10llu  %04X  %-8s  %-12s  A:%02X X:%02X Y:%02X SP:%02X NV-BDIZC:%s",
+		Record.Cycle, Record.PC, Bytes, Instruction, Record.A, Record.X, Record.Y, Record.SP, Flags );
+	return Line;
+}
+
+m6502::u64 m6502::TraceReader::WriteText( FILE* Out )
+{
+	Rewind();
+	u64 NumRecords = 0;
+	TraceRecord Record;
+	while ( Next( Record ) )
+	{
+		fprintf( Out, "%s\n", Format( Record ).c_str() );
+		NumRecords++;
+	}
+	return NumRecords;
+}
@@ -0,0 +1,162 @@
+#include "m6502_watch.h"
+
+m6502::Watchpoints::~Watchpoints()
+{
+	Detach();
+}
+
+void m6502::Watchpoints::Attach( CPU& cpu, Mem& memory )
+{
+	Detach();
+	Cpu = &cpu;
+	Memory = &memory;
+	Route();
+}
+
+void m6502::Watchpoints::Detach()
+{
+	if ( Memory )
+	{
+		const std::vector<Range> Kept = Ranges;
+		Ranges.clear();
+		Route();
+		Ranges = Kept;
+	}
+	Cpu = nullptr;
+	Memory = nullptr;
+}
+
+void m6502::Watchpoints::Add( Word First, Word Last, Kind On )
+{
+	Ranges.push_back( { First, Last, On } );
+	if ( Memory )
+	{
+		Route();
+	}
+}
+
+void m6502::Watchpoints::ClearAll()
+{
+	Ranges.clear();
+	if ( Memory )
+	{
+		Route();
+	}
+}
+
+void m6502::Watchpoints::Route()
+{
+	Byte Kinds[Mem::NUM_PAGES] = {};
+	for ( const Range& R : Ranges )
+	{
+		for ( u32 Page = R.First / Mem::PAGE_SIZE; Page <= (u32)R.Last / Mem::PAGE_SIZE; Page++ )
+		{
+			Kinds[Page] |= R.On;
+		}
+	}
+
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		if ( Kinds[Page] == Routed[Page] )
+		{
+			continue;
+		}
+		if ( !Routed[Page] )
+		{
+			Originals[Page] = Memory->Pages[Page];
+		}
+
+		const Mem::Page& Original = Originals[Page];
+		if ( !Kinds[Page] )
+		{
+			Memory->Pages[Page] = Original;
+		}
+		else if ( (Kinds[Page] & WATCH_READ) || !Original.Read )
+		{
+			// a device's reads go through CheckedRead too, which passes them on,
+			// decoding still reads the bytes so code runs from the page
+			Memory->Pages[Page] = { nullptr, nullptr, CheckedRead, CheckedWrite, this, Original.Code };
+		}
+		else
+		{
+			// reads stay a load, only the writes are checked
+			Memory->Pages[Page] = { Original.Read, nullptr, nullptr, CheckedWrite, this, Original.Code };
+		}
+		Routed[Page] = Kinds[Page];
+	}
+
+	// they may have decoded or compiled the old mapping
+	if ( Memory->Decoded )
+	{
+		Memory->Decoded->Flush();
+	}
+	if ( Memory->Blocks )
+	{
+		Memory->Blocks->Flush();
+	}
+}
+
+m6502::Byte m6502::Watchpoints::Watched( Word Address ) const
+{
+	Byte Kinds = 0;
+	for ( const Range& R : Ranges )
+	{
+		if ( Address >= R.First && Address <= R.Last )
+		{
+			Kinds |= R.On;
+		}
+	}
+	return Kinds;
+}
+
+void m6502::Watchpoints::Record( Word Address, Byte OldValue, Byte NewValue, bool Write )
+{
+	NumHits++;
+	if ( Hits.size() < MaxHits )
+	{
+		Hits.push_back( { Cpu->TotalCycles, Cpu->PC, Address, OldValue, NewValue, Write } );
+	}
+	if ( StopOnHit )
+	{
+		Cpu->LastStop = CPU::StopReason::Watchpoint;
+	}
+}
+
+m6502::Byte m6502::Watchpoints::CheckedRead( void* Context, Word Address )
+{
+	Watchpoints& Watch = *static_cast<Watchpoints*>( Context );
+	const Mem::Page& Original = Watch.Originals[Address / Mem::PAGE_SIZE];
+	const Byte Value = Original.Read ?
+		Original.Read[Address % Mem::PAGE_SIZE] : Original.OnRead( Original.Context, Address );
+	if ( Watch.Watched( Address ) & WATCH_READ )
+	{
+		Watch.Record( Address, Value, Value, false );
+	}
+	return Value;
+}
+
+void m6502::Watchpoints::CheckedWrite( void* Context, Word Address, Byte Value )
+{
+	Watchpoints& Watch = *static_cast<Watchpoints*>( Context );
+	Mem& memory = *Watch.Memory;
+	const Mem::Page& Original = Watch.Originals[Address / Mem::PAGE_SIZE];
+
+	// a device's old value isn't read, that could change it
+	const Byte OldValue = Original.Read ? Original.Read[Address % Mem::PAGE_SIZE] : 0;
+	if ( Original.Write )
+	{
+		Byte* Target = Original.Write + Address % Mem::PAGE_SIZE;
+		*Target = Value;
+		const size_t Offset = (size_t)(Target - memory.Data);
+		memory.MarkWritten( Offset < Mem::MAX_MEM ? (Word)Offset : Address );
+	}
+	else
+	{
+		Original.OnWrite( Original.Context, Address, Value );
+	}
+
+	if ( Watch.Watched( Address ) & WATCH_WRITE )
+	{
+		Watch.Record( Address, OldValue, Value, true );
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory>
+#include <vector>
 
 // http://www.obelisk.me.uk/6502/
 
@@ -12,25 +14,157 @@ namespace m6502
 
 	using u32 = unsigned int;
 	using s32 = signed int;
+	using u64 = unsigned long long;
 
 	struct Mem;
 	struct CPU;
 	struct StatusFlags;
+	struct DecodeCache;
+	struct BlockCache;
+	struct Breakpoints;
+	struct Tracer;
 }
 
+/**	The 64KB the CPU sees, through a table of 256 byte pages
+*	- Every page starts as RAM backed by its own bytes of Data, the CPU reads
+*	  & writes those with one indexed load/store and no calls
+*	- MapRom, MapMirror & MapDevice change what the CPU's accesses to a page
+*	  do, a device's handlers are only called for the pages it is mapped to
+*	- operator[] & Data are the backing memory, they bypass the page table
+*	  (for loading programs & tests) */
 struct m6502::Mem
 {
 	static constexpr u32 MAX_MEM = 1024 * 64;
+	static constexpr u32 PAGE_SIZE = 256;
+	static constexpr u32 NUM_PAGES = MAX_MEM / PAGE_SIZE;
 	Byte Data[MAX_MEM];
 
-	void Initialise()
+	/** A device's registers, Address is the full address the CPU used */
+	using ReadHandler = Byte (*)( void* Context, Word Address );
+	using WriteHandler = void (*)( void* Context, Word Address, Byte Value );
+
+	/** How the CPU's reads & writes of one page are handled */
+	struct Page
 	{
-		for ( u32 i = 0; i < MAX_MEM; i++ )
+		const Byte* Read;		//the page's 256 bytes, or nullptr to call OnRead
+		Byte* Write;			//the page's 256 bytes, or nullptr to call OnWrite
+		ReadHandler OnRead;
+		WriteHandler OnWrite;
+		void* Context;			//passed to OnRead & OnWrite
+		const Byte* Code;		//the bytes Peek decodes, the same as Read unless
+								//a handler sits in front of them (Watchpoints)
+	};
+
+	/** Indexed by Address / PAGE_SIZE */
+	Page Pages[NUM_PAGES];
+
+	/** Set by DecodeCache::Attach, the CPU's writes invalidate it */
+	DecodeCache* Decoded = nullptr;
+
+	/** Set by BlockCache::Attach, the CPU's writes invalidate it */
+	BlockCache* Blocks = nullptr;
+
+	/** Set by Breakpoints::Attach, for CPU::ExecuteDebug */
+	Breakpoints* Breaks = nullptr;
+
+	/** Set by Tracer::Attach, for CPU::ExecuteTrace */
+	Tracer* Trace = nullptr;
+
+	/** Initialise only clears the pages written since the last Initialise,
+	*	by the CPU or through operator[]. Anything that writes to Data some
+	*	other way (e.g. memcpy into Data) must call MarkWritten. */
+	bool ClearWrittenPagesOnly = false;
+
+	/** A bit per page of Data, set when the page is written, cleared by Initialise */
+	u32 WrittenPages[NUM_PAGES / 32];
+
+	/** Keep DirtyPages up to date, for snapshots & restoring only what changed */
+	bool TrackDirtyPages = false;
+
+	/** A bit per page of Data, set like WrittenPages when TrackDirtyPages is
+	*	on (& by Initialise for the pages it clears), cleared by ClearDirtyPages */
+	u32 DirtyPages[NUM_PAGES / 32];
+
+	/** Every page is RAM (& written, Data starts as junk) */
+	Mem();
+
+	/** The copy's pages map the copy's own Data, no caches are attached to it.
+	*	A page mapped to bytes outside of Data (e.g. by CompactMem::Bind) is
+	*	copied into the copy's Data as RAM, even when it was read only. Device
+	*	pages keep their handlers, so the copy shares the devices */
+	Mem( const Mem& Other );
+	Mem& operator=( const Mem& Other );
+
+	/** Zero the memory & flush the caches, see ClearWrittenPagesOnly */
+	void Initialise();
+
+	/** Address is in Data, e.g. the target of a mirror */
+	void MarkWritten( Word Address )
+	{
+		const u32 Page = Address / PAGE_SIZE;
+		WrittenPages[Page / 32] |= 1u << (Page % 32);
+		if ( TrackDirtyPages )
+		{
+			DirtyPages[Page / 32] |= 1u << (Page % 32);
+		}
+	}
+
+	void ClearDirtyPages();
+
+	bool IsPageDirty( Byte Page ) const
+	{
+		return (DirtyPages[Page / 32] & (1u << (Page % 32))) != 0;
+	}
+
+	u32 NumDirtyPages() const;
+
+	/** @return the dirty pages in ascending order */
+	std::vector<Byte> GetDirtyPages() const;
+
+	/** Call Visit( Byte Page ) for each dirty page in ascending order */
+	template<typename Visitor>
+	void ForEachDirtyPage( Visitor&& Visit ) const
+	{
+		for ( u32 Page = 0; Page < NUM_PAGES; Page++ )
 		{
-			Data[i] = 0;
+			if ( DirtyPages[Page / 32] == 0 )
+			{
+				Page += 31;		// none of the 32 pages
+			}
+			else if ( IsPageDirty( (Byte)Page ) )
+			{
+				Visit( (Byte)Page );
+			}
 		}
 	}
 
+	/** Pages read & write their own bytes of Data */
+	void MapRam( Byte FirstPage, u32 NumPages = 1 );
+
+	/** Pages read their own bytes of Data, the CPU's writes to them are ignored */
+	void MapRom( Byte FirstPage, u32 NumPages = 1 );
+
+	/** Pages read & write the Data of the pages from TargetPage on, e.g. a
+	*	mirrored region. The caches only see writes by the address used, so
+	*	code shouldn't modify itself through a mirror */
+	void MapMirror( Byte FirstPage, u32 NumPages, Byte TargetPage );
+
+	/** The CPU's reads & writes of the pages call OnRead & OnWrite, either can
+	*	be nullptr (reads are 0, writes are ignored). Code can't run from them */
+	void MapDevice( Byte FirstPage, u32 NumPages, ReadHandler OnRead, WriteHandler OnWrite, void* Context );
+
+	/** @return true when every page reads its own bytes of Data (RAM or ROM),
+	*	so native code can read Data directly */
+	bool ReadsAreFlat() const;
+
+	/** Read through the page table without calling a device, for decoding
+	*	@return 0 in a device page */
+	Byte Peek( Word Address ) const
+	{
+		const Page& P = Pages[Address / PAGE_SIZE];
+		return P.Code ? P.Code[Address % PAGE_SIZE] : 0;
+	}
+
 	/** read 1 byte */
 	Byte operator[]( u32 Address ) const
 	{
@@ -38,57 +172,366 @@ struct m6502::Mem
 		return Data[Address];
 	}
 
-	/** write 1 byte */
+	/** write 1 byte, the page is marked written even when it is only read
+	*	through this, so the library reads with Peek or a const Mem */
 	Byte& operator[]( u32 Address )
 	{
 		// assert here Address is < MAX_MEM
+		MarkWritten( (Word)Address );
 		return Data[Address];
 	}
+
+private:
+	/** Map the pages & drop what the caches decoded from them, a device's
+	*	handler may be doing this part way through a block */
+	void Map( Byte FirstPage, u32 NumPages, const Page& Mapping, s32 DataOffset );
+};
+
+/**	Instructions decoded once by CPU::ExecuteCached, keyed by their address
+*	- Attach it to a Mem, the writes the CPU makes to that memory invalidate
+*	  the instructions they overlap, so self modifying code still works
+*	- Anything else that changes the memory (e.g. mem[0x1000] = 0xEA) must
+*	  call Invalidate or Flush. Mem::Initialise & CPU::LoadPrg call Flush.
+*	- It is over 1MB, best not to put it on the stack */
+struct m6502::DecodeCache
+{
+	/** Runs a decoded instruction, the PC is already past the instruction
+	*	@return the penalty cycles (page crossing etc.) as a negative number */
+	using Handler = s32 (*)( CPU& cpu, Mem& memory, Word Operand );
+
+	struct Entry
+	{
+		Handler Execute;	//nullptr when not decoded
+		Word Operand;
+		Byte Length;		//including the opcode
+		Byte BaseCycles;
+		Byte Opcode;
+	};
+
+	static constexpr u32 PAGE_SIZE = 256;
+	static constexpr u32 NUM_PAGES = Mem::MAX_MEM / PAGE_SIZE;
+
+	Entry Entries[Mem::MAX_MEM];
+	bool CodePages[NUM_PAGES];		//pages that hold part of a decoded instruction
+	Mem* Memory = nullptr;
+
+	DecodeCache();
+	~DecodeCache();
+	DecodeCache( const DecodeCache& ) = delete;
+	DecodeCache& operator=( const DecodeCache& ) = delete;
+
+	/** Start caching the instructions in memory (flushes the cache) */
+	void Attach( Mem& memory );
+
+	void Detach();
+
+	/** Forget every decoded instruction */
+	void Flush();
+
+	/** Forget the instructions that overlap Address */
+	void Invalidate( Word Address )
+	{
+		if ( CodePages[Address / PAGE_SIZE] )
+		{
+			// an instruction is up to 3 bytes, the byte could be its opcode or an operand
+			Entries[Address].Execute = nullptr;
+			Entries[(Word)(Address - 1)].Execute = nullptr;
+			Entries[(Word)(Address - 2)].Execute = nullptr;
+		}
+	}
+
+	/** Decode the instruction at Address from memory */
+	const Entry& Decode( Word Address, const Mem& memory );
+
+	/** Decode the instruction at Address without caching it */
+	static Entry DecodeInstruction( Word Address, const Mem& memory );
+};
+
+/**	Straight line runs of instructions translated by CPU::ExecuteBlocks
+*	- A block ends at its first branch, JMP, JSR, RTS, RTI or BRK (or after
+*	  MAX_BLOCK_INSTRUCTIONS), its micro-ops are the decoded instructions
+*	- MaxCycles is known when the block is translated, so ExecuteBlocks only
+*	  checks the cycle budget once per block
+*	- Each block remembers the blocks that ran after it, so following a
+*	  branch or a JSR that has been seen before skips the lookup
+*	- Attached to a Mem like the DecodeCache, the CPU's writes invalidate the
+*	  blocks they overlap. Anything else must call Invalidate or Flush.
+*	- CPU::ExecuteJit compiles the blocks that have run JitThreshold times to
+*	  native code, when the library is built with M6502_JIT on Linux x86-64
+*	  and every page of the memory reads its own Data (see Mem::ReadsAreFlat) */
+struct m6502::BlockCache
+{
+	using MicroOp = DecodeCache::Entry;
+
+	/** A block compiled to native code
+	*	@return the number of cycles that were used */
+	using NativeBlock = s32 (*)( CPU& cpu, Mem& memory );
+
+	/** The executable memory the native blocks are written to, see m6502_jit.cpp */
+	struct CodeBuffer;
+
+	static constexpr u32 PAGE_SIZE = 256;
+	static constexpr u32 NUM_PAGES = Mem::MAX_MEM / PAGE_SIZE;
+	static constexpr u32 MAX_BLOCK_INSTRUCTIONS = 32;
+	static constexpr u32 MAX_BLOCKS = 8192;	//then everything is flushed, which frees the invalidated blocks
+	static constexpr u32 NUM_LINKS = 2;
+
+	struct Block
+	{
+		Word Start;
+		Word Length;		//in bytes
+		s32 MaxCycles;		//the base cycles plus the worst case penalties of every micro-op
+		bool Valid;			//false once a write has overlapped it
+		Block* Next[NUM_LINKS];	//the blocks that ran after this one, most recent first
+		std::vector<MicroOp> Ops;
+		u32 RunCount;		//times ExecuteJit has run the whole block
+		NativeBlock Native;	//nullptr until it is compiled
+
+		bool Contains( Word Address ) const
+		{
+			return (Word)(Address - Start) < Length;
+		}
+	};
+
+	Block* Blocks[Mem::MAX_MEM];		//by start address, nullptr when not translated
+	std::vector<Block*> PageBlocks[NUM_PAGES];	//the valid blocks that overlap each page
+	std::vector<std::unique_ptr<Block>> Translated;	//every block until the next Flush
+	bool FlushPending = false;		//set by InvalidateAll, Next flushes before it translates
+	Mem* Memory = nullptr;
+
+	u32 JitThreshold = 64;		//runs before a block is compiled, 0 to never compile
+	CodeBuffer* Code = nullptr;	//allocated by the first Compile
+
+	BlockCache();
+	~BlockCache();
+	BlockCache( const BlockCache& ) = delete;
+	BlockCache& operator=( const BlockCache& ) = delete;
+
+	/** Start translating the code in memory (flushes the cache) */
+	void Attach( Mem& memory );
+
+	void Detach();
+
+	/** Forget every block */
+	void Flush();
+
+	/** Forget the blocks that overlap Address */
+	void Invalidate( Word Address )
+	{
+		if ( !PageBlocks[Address / PAGE_SIZE].empty() )
+		{
+			InvalidateBlocks( Address );
+		}
+	}
+
+	void InvalidateBlocks( Word Address );
+
+	/** Forget every block like Flush, but keep their memory until Next
+	*	flushes, as the CPU may be part way through one of them */
+	void InvalidateAll();
+
+	/** @return the block that starts at Address, following the links from
+	*	Previous (which may be nullptr) or translating it when needed */
+	Block* Next( Block* Previous, Word Address );
+
+	/** Translate the block that starts at Address from the attached memory */
+	Block* Translate( Word Address );
+
+	/** @return true when the library was built with the JIT for this platform */
+	static bool JitSupported();
+
+	/** Compile a block to native code, sets Block.Native
+	*	@return false when the JIT isn't supported or the code buffer is full */
+	bool Compile( Block& B );
+
+	/** Run the native code of a block, rethrowing anything the instructions threw
+	*	@return the number of cycles that were used */
+	s32 RunNative( const Block& B, CPU& cpu, Mem& memory );
+
+	/** Forget all the native code, the blocks are being flushed */
+	void FlushNative();
+
+	void FreeNative();
 };
 
+/**	PC breakpoints for CPU::ExecuteDebug
+*	- A bit per address, plus a bit per page that has any of them, so
+*	  ExecuteDebug only looks at the pages of each block it enters and steps
+*	  through the few pages that have breakpoints an instruction at a time
+*	- The other engines don't look at them, so they cost nothing unless
+*	  ExecuteDebug is the engine */
+struct m6502::Breakpoints
+{
+	u32 Pages[Mem::NUM_PAGES / 32];
+	u32 Addresses[Mem::MAX_MEM / 32];
+	Mem* Memory = nullptr;
+
+	Breakpoints();
+	~Breakpoints();
+	Breakpoints( const Breakpoints& ) = delete;
+	Breakpoints& operator=( const Breakpoints& ) = delete;
+
+	/** Break in the code of memory */
+	void Attach( Mem& memory );
+
+	void Detach();
+
+	void Set( Word Address );
+
+	void Clear( Word Address );
+
+	void ClearAll();
+
+	bool IsSet( Word Address ) const
+	{
+		return (Addresses[Address / 32] & (1u << (Address % 32))) != 0;
+	}
+
+	bool PageHasAny( Byte Page ) const
+	{
+		return (Pages[Page / 32] & (1u << (Page % 32))) != 0;
+	}
+
+	/** @return true when the pages of the Length bytes from Start have any */
+	bool AnyIn( Word Start, Word Length ) const
+	{
+		return PageHasAny( (Byte)(Start / Mem::PAGE_SIZE) ) ||
+			PageHasAny( (Byte)((Word)(Start + Length - 1) / Mem::PAGE_SIZE) );
+	}
+};
+
+/**	The processor status, one bool per flag so setting a flag is a plain
+*	byte store rather than a bitfield read-modify-write. It is only packed
+*	into the 6502's status byte when PHP/BRK/the API ask for it. */
 struct m6502::StatusFlags
 {	
-	Byte C : 1;	//0: Carry Flag	
-	Byte Z : 1;	//1: Zero Flag
-	Byte I : 1; //2: Interrupt disable
-	Byte D : 1; //3: Decimal mode
-	Byte B : 1; //4: Break
-	Byte Unused : 1; //5: Unused
-	Byte V : 1; //6: Overflow
-	Byte N : 1; //7: Negative
+	bool C;			//0: Carry Flag	
+	bool Z;			//1: Zero Flag
+	bool I;			//2: Interrupt disable
+	bool D;			//3: Decimal mode
+	bool B;			//4: Break
+	bool Unused;	//5: Unused
+	bool V;			//6: Overflow
+	bool N;			//7: Negative
+
+	Byte Pack() const
+	{
+		return (Byte)(C | (Z << 1) | (I << 2) | (D << 3) | (B << 4) | (Unused << 5) | (V << 6) | (N << 7));
+	}
+
+	void Unpack( Byte PS )
+	{
+		C = (PS & 0x01) != 0;
+		Z = (PS & 0x02) != 0;
+		I = (PS & 0x04) != 0;
+		D = (PS & 0x08) != 0;
+		B = (PS & 0x10) != 0;
+		Unused = (PS & 0x20) != 0;
+		V = (PS & 0x40) != 0;
+		N = (PS & 0x80) != 0;
+	}
 };
 
 struct m6502::CPU
 {
+	/** The processor status as a Byte under its old name, it reads & assigns
+	*	through GetPS() & SetPS(). It holds nothing, being the first member it
+	*	is at the CPU's address, so it needs no pointer back that a copy of
+	*	the CPU would have to fix */
+	struct StatusByte
+	{
+		operator Byte() const
+		{
+			return reinterpret_cast<const CPU*>( this )->GetPS();
+		}
+
+		StatusByte& operator=( Byte Value )
+		{
+			reinterpret_cast<CPU*>( this )->SetPS( Value );
+			return *this;
+		}
+
+		/** Assigns the value, e.g. cpu.PS = Other.PS */
+		StatusByte& operator=( const StatusByte& Other )
+		{
+			return *this = (Byte)Other;
+		}
+	} PS;
+
 	Word PC;		//program counter
 	Byte SP;		//stack pointer
 
 	Byte A, X, Y;	//registers
 
-	union // processor status
+	/** Processor status, GetPS() & SetPS() read & write it as a Byte */
+	StatusFlags Flag = {};
+
+	/** Lazy N/Z/C/V for the table driven engines, when the library is built
+	*	with M6502_LAZY_FLAGS the flags in LazyFlags are kept here instead of
+	*	in Flag until something reads them, see SyncFlags() */
+	Byte LazyNZ;			//N & Z are from this result
+	Byte LazyV;				//V is bit 7
+	Word LazyC;				//C is bit 8
+	Byte LazyFlags = 0;		//the PS bits that are pending
+
+	/** Cycles run by the engines & ServiceInterrupts, it is never reset */
+	u64 TotalCycles = 0;
+
+	/** Why ExecuteDebug returned */
+	enum class StopReason : Byte
 	{
-		Byte PS;	
-		StatusFlags Flag;
+		Budget,			//the cycles ran out
+		Breakpoint,		//the PC is at a breakpoint, the instruction hasn't run
+		Watchpoint,		//a Watchpoints with StopOnHit was hit
 	};
 
+	StopReason LastStop = StopReason::Budget;
+
+	/** The interrupt inputs, see ServiceInterrupts */
+	bool IrqLine = false;		//held until ClearIRQ, taken while I is clear
+	bool NmiPending = false;	//edge triggered, taken once
+
 	void Reset( Mem& memory )
 	{
 		Reset( 0xFFFC, memory );
 	}
 
 	void Reset( Word ResetVector, Mem& memory )
+	{
+		Reset( ResetVector );
+		memory.Initialise();
+	}
+
+	/** Reset the registers only, the memory is kept as it is */
+	void Reset( Word ResetVector )
 	{
 		PC = ResetVector;
 		SP = 0xFF;
 		Flag.C = Flag.Z = Flag.I = Flag.D = Flag.B = Flag.V = Flag.N = 0;
+		Flag.Unused = 0;
+		LazyFlags = 0;
 		A = X = Y = 0;
-		memory.Initialise();
+		IrqLine = NmiPending = false;
+	}
+
+	void RaiseIRQ()
+	{
+		IrqLine = true;
+	}
+
+	void ClearIRQ()
+	{
+		IrqLine = false;
+	}
+
+	void RaiseNMI()
+	{
+		NmiPending = true;
 	}
 
 	Byte FetchByte( s32& Cycles, const Mem& memory )
 	{
-		Byte Data = memory[PC];
-		PC++;
+		Byte Data = FetchByte( memory );
 		Cycles--;
 		return Data;
 	}
@@ -100,13 +543,7 @@ struct m6502::CPU
 
 	Word FetchWord( s32& Cycles, const Mem& memory )
 	{
-		// 6502 is little endian
-		Word Data = memory[PC];
-		PC++;
-		
-		Data |= (memory[PC] << 8 );
-		PC++;
-
+		Word Data = FetchWord( memory );
 		Cycles -= 2;
 		return Data;
 	}
@@ -116,7 +553,7 @@ struct m6502::CPU
 		Word Address,
 		const Mem& memory )
 	{
-		Byte Data = memory[Address];
+		Byte Data = ReadByte( Address, memory );
 		Cycles--;
 		return Data;
 	}
@@ -134,15 +571,15 @@ struct m6502::CPU
 	/** write 1 byte to memory */
 	void WriteByte( Byte Value, s32& Cycles, Word Address, Mem& memory )
 	{
-		memory[Address] = Value;
+		WriteByte( Value, Address, memory );
 		Cycles--;
 	}
 
 	/** write 2 bytes to memory */
 	void WriteWord(	Word Value, s32& Cycles, Word Address, Mem& memory )
 	{
-		memory[Address] = Value & 0xFF;
-		memory[Address + 1] = (Value >> 8);
+		WriteByte( Value & 0xFF, Address, memory );
+		WriteByte( Value >> 8, Address + 1, memory );
 		Cycles -= 2;
 	}
 
@@ -154,10 +591,8 @@ struct m6502::CPU
 
 	void PushWordToStack( s32& Cycles, Mem& memory, Word Value )
 	{
-		WriteByte( Value >> 8, Cycles, SPToAddress(), memory );
-		SP--;
-		WriteByte( Value & 0xFF, Cycles, SPToAddress(), memory );
-		SP--;
+		PushWordToStack( memory, Value );
+		Cycles -= 2;
 	}
 
 	/** Push the PC-1 onto the stack */
@@ -180,29 +615,112 @@ struct m6502::CPU
 
 	void PushByteOntoStack( s32& Cycles, Byte Value, Mem& memory )
 	{
-		const Word SPWord = SPToAddress();
-		memory[SPWord] = Value;
-		Cycles--;
-		SP--;
-		Cycles--;
+		PushByteOntoStack( Value, memory );
+		Cycles -= 2;
 	}
 
 	Byte PopByteFromStack( s32& Cycles, Mem& memory )
 	{
-		SP++;
-		Cycles--;
-		const Word SPWord = SPToAddress();
-		Byte Value = memory[SPWord];
-		Cycles--;
+		Byte Value = PopByteFromStack( memory );
+		Cycles -= 2;
 		return Value;
 	}
 
 	/** Pop a 16-bit value from the stack */
 	Word PopWordFromStack( s32& Cycles, Mem& memory )
 	{
-		Word ValueFromStack = ReadWord( Cycles, SPToAddress()+1, memory );
+		Word ValueFromStack = PopWordFromStack( memory );
+		Cycles -= 3;
+		return ValueFromStack;
+	}
+
+	// Bus access without the cycle counting, the table driven engines
+	// deduct the cycles once per instruction instead (see m6502_ops.h)
+
+	Byte FetchByte( const Mem& memory )
+	{
+		Byte Data = ReadByte( PC, memory );
+		PC++;
+		return Data;
+	}
+
+	Word FetchWord( const Mem& memory )
+	{
+		// 6502 is little endian
+		Word Data = ReadByte( PC, memory );
+		PC++;
+
+		Data |= (ReadByte( PC, memory ) << 8 );
+		PC++;
+		return Data;
+	}
+
+	Byte ReadByte( Word Address, const Mem& memory ) const
+	{
+		const Mem::Page& Page = memory.Pages[Address / Mem::PAGE_SIZE];
+		if ( Page.Read )
+		{
+			return Page.Read[Address % Mem::PAGE_SIZE];
+		}
+		return Page.OnRead( Page.Context, Address );
+	}
+
+	Word ReadWord( Word Address, const Mem& memory ) const
+	{
+		Byte LoByte = ReadByte( Address, memory );
+		Byte HiByte = ReadByte( Address + 1, memory );
+		return LoByte | (HiByte << 8);
+	}
+
+	/** write 1 byte to memory */
+	void WriteByte( Byte Value, Word Address, Mem& memory )
+	{
+		const Mem::Page& Page = memory.Pages[Address / Mem::PAGE_SIZE];
+		if ( Page.Write )
+		{
+			Byte* Target = Page.Write + Address % Mem::PAGE_SIZE;
+			*Target = Value;
+			// a page mapped outside of Data (see CompactMem) is marked by its address
+			const size_t Offset = (size_t)(Target - memory.Data);
+			memory.MarkWritten( Offset < Mem::MAX_MEM ? (Word)Offset : Address );
+		}
+		else
+		{
+			Page.OnWrite( Page.Context, Address, Value );
+		}
+		if ( memory.Decoded )
+		{
+			memory.Decoded->Invalidate( Address );
+		}
+		if ( memory.Blocks )
+		{
+			memory.Blocks->Invalidate( Address );
+		}
+	}
+
+	void PushWordToStack( Mem& memory, Word Value )
+	{
+		PushByteOntoStack( Value >> 8, memory );
+		PushByteOntoStack( Value & 0xFF, memory );
+	}
+
+	void PushByteOntoStack( Byte Value, Mem& memory )
+	{
+		WriteByte( Value, SPToAddress(), memory );
+		SP--;
+	}
+
+	Byte PopByteFromStack( Mem& memory )
+	{
+		SP++;
+		return ReadByte( SPToAddress(), memory );
+	}
+
+	/** Pop a 16-bit value from the stack */
+	Word PopWordFromStack( Mem& memory )
+	{
+		Word ValueFromStack = ReadWord( SPToAddress()+1, memory );
 		SP += 2;
-		Cycles--;
 		return ValueFromStack;
 	}
 
@@ -213,8 +731,16 @@ struct m6502::CPU
 		BreakFlagBit = 0b000010000,
 		UnusedFlagBit = 0b000100000,
 		InterruptDisableFlagBit = 0b000000100,
+		ZeroFlagBit = 0b00000010,
+		CarryFlagBit = 0b00000001,
 		ZeroBit = 0b00000001;
 
+	// interrupt vectors
+	static constexpr Word
+		NmiVector = 0xFFFA,
+		ResetVector = 0xFFFC,
+		IrqVector = 0xFFFE;
+
 	// opcodes
 	static constexpr Byte
 		//LDA
@@ -418,6 +944,52 @@ struct m6502::CPU
 		Flag.N = (Register & NegativeFlagBit) > 0;
 	}
 
+	/** @return the processor status packed into a byte, as PHP pushes it
+	*	but without the Break & Unused bits being forced on */
+	Byte GetPS() const
+	{
+		Byte Value = Flag.Pack();
+		if ( LazyFlags )
+		{
+			const Byte Lazy = (LazyNZ & NegativeFlagBit) | (LazyNZ == 0 ? ZeroFlagBit : 0) |
+				((LazyV >> 1) & OverflowFlagBit) | ((LazyC >> 8) & CarryFlagBit);
+			Value = (Value & ~LazyFlags) | (Lazy & LazyFlags);
+		}
+		return Value;
+	}
+
+	void SetPS( Byte Value )
+	{
+		Flag.Unpack( Value );
+		LazyFlags = 0;
+	}
+
+	/** Write the pending lazy flags into Flag, the engines do this before they
+	*	return so PS & Flag are always up to date outside of them */
+	void SyncFlags()
+	{
+		if ( LazyFlags )
+		{
+			SetPS( GetPS() );
+		}
+	}
+
+	/** Push ReturnAddress & Status and jump through Vector with interrupts
+	*	disabled, the way BRK, IRQs & NMIs enter their handlers */
+	void EnterInterrupt( Word ReturnAddress, Byte Status, Word Vector, Mem& memory )
+	{
+		PushWordToStack( memory, ReturnAddress );
+		PushByteOntoStack( Status, memory );
+		PC = ReadWord( Vector, memory );
+		Flag.I = true;
+	}
+
+	/** Take a pending NMI, or the IRQ when it is raised & I is clear, before
+	*	the next instruction. Call it between calls to the engines, which
+	*	don't look at the interrupt inputs (see m6502::Scheduler)
+	*	@return the cycles it took, 0 when there was nothing to take */
+	s32 ServiceInterrupts( Mem& memory );
+
 	/** @return the address that the program was loading into, or 0 if no program */
 	Word LoadPrg( const Byte* Program, u32 NumBytes, Mem& memory ) const;
 
@@ -427,6 +999,68 @@ struct m6502::CPU
 	/** @return the number of cycles that were used */
 	s32 Execute( s32 Cycles, Mem& memory );
 
+	/** Same as Execute, but dispatches through a 256 entry table of handlers
+	*	that are specialised for each operation & addressing mode.
+	*	Execute stays as the reference implementation.
+	*	@return the number of cycles that were used */
+	s32 ExecuteTable( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteTable, but with direct threaded (computed goto) dispatch
+	*	when the library is built with M6502_THREADED_DISPATCH on GCC/Clang.
+	*	Otherwise it just calls ExecuteTable.
+	*	@return the number of cycles that were used */
+	s32 ExecuteThreaded( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteTable, but runs the instructions from the DecodeCache
+	*	attached to memory, decoding each address only the first time it runs.
+	*	Without a DecodeCache attached it just calls ExecuteTable.
+	*	@return the number of cycles that were used */
+	s32 ExecuteCached( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteTable, but runs whole basic blocks from the BlockCache
+	*	attached to memory, checking the cycle budget once per block. Near the
+	*	end of the budget it checks per instruction, so it stops on the same
+	*	instruction as Execute.
+	*	Without a BlockCache attached it just calls ExecuteTable.
+	*	@return the number of cycles that were used */
+	s32 ExecuteBlocks( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteBlocks, but the blocks that have run JitThreshold times
+	*	are compiled to x86-64 code, with A/X/Y/SP/PS kept in host registers.
+	*	The instructions the JIT doesn't handle call the same handlers as
+	*	ExecuteBlocks, which (like Execute) stays the fallback.
+	*	Only compiles with the library built with M6502_JIT on Linux x86-64,
+	*	otherwise it is the same as ExecuteBlocks.
+	*	@return the number of cycles that were used */
+	s32 ExecuteJit( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteBlocks, but stops before an instruction at one of the
+	*	Breakpoints attached to memory, setting LastStop. The instruction at
+	*	the PC it starts from runs even with a breakpoint, so it continues
+	*	from the one it stopped at. Also stops after a block that hit one of
+	*	the Watchpoints (m6502_watch.h) that stop, and keeps TotalCycles up to
+	*	date at each block for them. Without a BlockCache attached it steps
+	*	like ExecuteTable.
+	*	@return the number of cycles that were used */
+	s32 ExecuteDebug( s32 Cycles, Mem& memory );
+
+	/** Same as ExecuteTable, but hands a record of every instruction (see
+	*	m6502_trace.h) to the Tracer attached to memory before running it.
+	*	Without an open Tracer attached it just calls ExecuteTable.
+	*	@return the number of cycles that were used */
+	s32 ExecuteTrace( s32 Cycles, Mem& memory );
+
+	/** Run with ExecuteTable's dispatch until TotalCycles reaches Cycle,
+	*	stopping at the end of the instruction that reaches it like Execute.
+	*	Not limited to the 2^31 cycles of a budget.
+	*	@return the number of cycles that were used */
+	u64 RunUntilCycle( u64 Cycle, Mem& memory );
+
+	/** Run with ExecuteTable's dispatch until the PC is Address at the start
+	*	of an instruction (0 cycles if it already is), or MaxCycles are used.
+	*	@return the number of cycles that were used */
+	s32 RunUntilPC( Word Address, s32 MaxCycles, Mem& memory );
+
 	/** Addressing mode - Zero page */
 	Word AddrZeroPage( s32& Cycles, const Mem& memory );
 
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct BatchJob;
+	struct BatchResult;
+	struct BatchRunner;
+	struct CompactMem;
+}
+
+/** One machine to run & what happened when it ran */
+struct m6502::BatchJob
+{
+	CPU* Cpu = nullptr;
+	Mem* Memory = nullptr;
+	CompactMem* Compact = nullptr;	//instead of Memory, bound to a Mem of the thread's
+	s32 Cycles = 0;			//to run
+
+	s32 CyclesUsed = 0;		//0 when it threw
+	bool Threw = false;		//e.g. an illegal opcode
+};
+
+struct m6502::BatchResult
+{
+	u64 TotalCycles = 0;	//of every job that didn't throw
+	u32 NumThrew = 0;
+	double Seconds = 0;		//wall clock, for the whole batch
+	double CyclesPerSecond = 0;
+};
+
+/**	Runs many independent machines across threads
+*	- Each thread starts with an even share of the jobs & runs them from
+*	  the back, once it runs out it steals from the front of the others'
+*	  shares, so a few long jobs don't leave the other threads idle
+*	- Every job must have its own CPU & Mem (& caches attached to it), or its
+*	  own CompactMem, the threads share nothing else (but the SharedImage &
+*	  the PageArena, which are safe to share)
+*	- Runs with Engine, any of the CPU::Execute... functions */
+struct m6502::BatchRunner
+{
+	using ExecuteFunction = s32 (CPU::*)( s32 Cycles, Mem& memory );
+
+	ExecuteFunction Engine = &CPU::Execute;
+	u32 NumThreads = 0;		//0 for one per core
+
+	/** Run every job, filling in its results
+	*	@return the totals of the whole batch */
+	BatchResult Run( BatchJob* Jobs, u32 NumJobs ) const;
+
+	BatchResult Run( std::vector<BatchJob>& Jobs ) const
+	{
+		return Run( Jobs.data(), (u32)Jobs.size() );
+	}
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "m6502_pool.h"
+
+namespace m6502
+{
+	struct SharedImage;
+	struct CompactMem;
+}
+
+/**	The memory every machine starts with, one copy shared by all of them
+*	- Pages with the same bytes share a frame (e.g. every page of zeros)
+*	- Only the bytes & which pages are ROM are kept from the Mem it is
+*	  made from: device pages are zeros, mirrors become copies
+*	- Immutable once made, it must outlive the CompactMems using it */
+struct m6502::SharedImage
+{
+	const PageFrame* Pages[Mem::NUM_PAGES];
+	bool ReadOnly[Mem::NUM_PAGES];			//a ROM page, the CPU's writes are ignored
+
+	explicit SharedImage( const Mem& Source );
+	SharedImage( const SharedImage& ) = delete;
+	SharedImage& operator=( const SharedImage& ) = delete;
+
+	/** @return the distinct frames the pages share */
+	u32 NumFrames() const
+	{
+		return (u32)Frames.size();
+	}
+
+private:
+	std::vector<std::unique_ptr<PageFrame>> Frames;
+};
+
+/**	The memory of one machine, as a SharedImage plus the pages it wrote
+*	- Bind maps a Mem's pages to this machine's bytes, so the CPU reads the
+*	  image or the private frames directly. The first write to a page of the
+*	  image copies it to a frame from the arena, a machine only holds the
+*	  pages it changed (about 2KB + 256 bytes a page instead of 64KB)
+*	- One Mem can be bound to many machines in turn, e.g. one for each thread
+*	  of a BatchRunner. Its Data isn't used, so Mem::operator[], snapshots &
+*	  the JIT don't see the machine's memory: use Read & Write here
+*	- Bind the Mem to something else (or MapRam it) before this is destroyed */
+struct m6502::CompactMem
+{
+	const SharedImage* Image;
+	PageArena* Arena;
+	PageFrame* Private[Mem::NUM_PAGES];		//nullptr while the page is the image's
+	Mem* Bound = nullptr;					//the Mem last bound to this
+
+	CompactMem( const SharedImage& image, PageArena& arena );
+	~CompactMem();
+	CompactMem( const CompactMem& ) = delete;
+	CompactMem& operator=( const CompactMem& ) = delete;
+
+	/** Map every page of memory to this machine, flushing its caches */
+	void Bind( Mem& memory );
+
+	/** Go back to the image, freeing the private frames, Bind again after */
+	void Reset();
+
+	u32 NumPrivatePages() const;
+
+	Byte Read( Word Address ) const
+	{
+		const Byte Page = (Byte)(Address / Mem::PAGE_SIZE);
+		const PageFrame* Frame = Private[Page] ? Private[Page] : Image->Pages[Page];
+		return Frame->Bytes[Address % Mem::PAGE_SIZE];
+	}
+
+	/** Write like the CPU does, ROM pages are left alone */
+	void Write( Word Address, Byte Value );
+
+private:
+	/** Copy Page of the image to a frame of its own, remapping the bound Mem */
+	PageFrame* MakePrivate( Byte Page );
+
+	static void CopyOnWrite( void* Context, Word Address, Byte Value );
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct Lockstep;
+}
+
+/**	Many CPUs running the same code, with their registers in parallel arrays
+*	(structure of arrays), one lane per CPU & each with its own Mem
+*	- The lanes at the same PC, with the same code there, run together as a
+*	  group: loads of immediates, ADC/SBC, AND/ORA/EOR, CMP/CPX/CPY, the
+*	  shifts & rotates of A, transfers, increments, flag changes, branches &
+*	  JMP are worked out for every lane at once in loops the compiler turns
+*	  into SIMD (AVX2 with M6502_LOCKSTEP_AVX2)
+*	- Everything else runs lane by lane through the same handlers as
+*	  CPU::ExecuteTable
+*	- A group splits when a branch goes both ways or an instruction jumps to
+*	  somewhere that can differ (RTS, JSR, BRK, ...), the lanes that end up at
+*	  the same PC later are grouped again
+*	- The code is fetched without calling devices (Mem::Peek), so it must be
+*	  in RAM or ROM */
+struct m6502::Lockstep
+{
+	u32 NumLanes = 0;
+
+	std::vector<Byte> A, X, Y, SP;
+	std::vector<Word> PC;
+	std::vector<Byte> C, Z, I, D, B, Unused, V, N;	//0 or 1
+	std::vector<s32> Cycles;		//left in the budget of each lane
+	std::vector<s32> CyclesUsed;	//by the last Execute
+	std::vector<Byte> Threw;		//1 once an instruction threw, the lane stops
+	std::vector<Mem*> Memory;
+
+	u64 LockstepInstructions = 0;	//lane instructions run for a whole group at once
+	u64 ScalarInstructions = 0;		//lane instructions run one lane at a time
+
+	/** A group with fewer lanes than this runs lane by lane */
+	u32 MinGroupLanes = 4;
+
+	explicit Lockstep( u32 NumberOfLanes = 0 );
+
+	void Resize( u32 NumberOfLanes );
+
+	/** Copy cpu's registers into Lane, which runs with memory */
+	void SetLane( u32 Lane, const CPU& cpu, Mem& memory );
+
+	/** Copy the registers of Lane into cpu */
+	void GetLane( u32 Lane, CPU& cpu ) const;
+
+	/** Run every lane that hasn't thrown for (at least) Cycles, like
+	*	CPU::Execute, the cycles each lane used are in CyclesUsed */
+	void Execute( s32 Cycles );
+
+private:
+	std::vector<Byte> Active;		//0xFF for the lanes in the group
+	std::vector<u32> Members;		//the lanes in the group
+
+	void StepLane( u32 Lane );
+	void RunGroup( u32 Leader );
+	bool SameCode( u32 Lane, u32 Leader, Byte Length ) const;
+	bool StepGroup( Byte Ins, Word Operand, Byte Length, Byte BaseCycles );
+};
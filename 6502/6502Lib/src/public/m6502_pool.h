@@ -0,0 +1,106 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct PoolStats;
+	struct PageFrame;
+	struct PageArena;
+	struct Machine;
+	struct MachinePool;
+}
+
+/** How full a PageArena or MachinePool is */
+struct m6502::PoolStats
+{
+	u32 NumSlots = 0;			//frames or machines in the chunks, in use or free
+	u32 NumInUse = 0;
+	u32 PeakInUse = 0;
+	u64 NumAcquired = 0;		//over the pool's lifetime
+	u64 NumReused = 0;			//of those, ones that were released before
+	u64 PagesCleared = 0;		//by MachinePool::Acquire, to zero the memory
+	u64 BytesReserved = 0;		//by the chunks
+};
+
+/** The bytes of one page, on cache lines of their own */
+struct alignas( 64 ) m6502::PageFrame
+{
+	Byte Bytes[Mem::PAGE_SIZE];
+};
+
+/**	Hands out PageFrames from chunks of them & takes them back for reuse
+*	- The frames aren't cleared, whoever allocates one fills it
+*	- Thread safe, the machines using it can run on different threads
+*	- The chunks are only freed with the arena, so it must outlive the frames */
+struct m6502::PageArena
+{
+	static constexpr u32 FRAMES_PER_CHUNK = 64;
+
+	PageArena() = default;
+	PageArena( const PageArena& ) = delete;
+	PageArena& operator=( const PageArena& ) = delete;
+
+	PageFrame* Allocate();
+
+	void Free( PageFrame* Frame );
+
+	/** @return the frames handed out & not freed */
+	u32 NumAllocated() const;
+
+	/** @return the frames in all the chunks */
+	u32 NumFrames() const;
+
+	PoolStats Stats() const;
+
+private:
+	mutable std::mutex Lock;
+	std::vector<std::unique_ptr<PageFrame[]>> Chunks;
+	std::vector<PageFrame*> FreeFrames;
+	u32 NumUnusedInLastChunk = 0;
+	PoolStats Counts;
+};
+
+/** A CPU & its memory, from a MachinePool */
+struct alignas( 64 ) m6502::Machine
+{
+	CPU Cpu;
+	Mem Memory;
+};
+
+/**	Hands out Machines from chunks of them & takes them back for reuse, so
+*	short lived machines don't each allocate 70KB from the heap
+*	- A machine is handed out as if it were new: all RAM, no caches, devices
+*	  or dirty tracking, its memory zeroed & the CPU reset to $FFFC. The
+*	  caches, Breakpoints & Tracer the last owner attached are detached, but
+*	  Watchpoints have to be detached before it is released
+*	- Only the pages a reused machine wrote are zeroed (Mem::WrittenPages),
+*	  anything that wrote to its Data without the CPU or Mem::operator[]
+*	  must call Mem::MarkWritten
+*	- The memory of a chunk is first touched by the thread that acquires its
+*	  machines, so on a NUMA system a pool for each worker thread keeps them
+*	  on that thread's node
+*	- Thread safe, it must outlive the machines */
+struct m6502::MachinePool
+{
+	static constexpr u32 MACHINES_PER_CHUNK = 16;
+
+	MachinePool() = default;
+	MachinePool( const MachinePool& ) = delete;
+	MachinePool& operator=( const MachinePool& ) = delete;
+
+	Machine* Acquire();
+
+	void Release( Machine* Used );
+
+	PoolStats Stats() const;
+
+private:
+	mutable std::mutex Lock;
+	std::vector<std::unique_ptr<Machine[]>> Chunks;
+	std::vector<Machine*> FreeMachines;
+	u32 NumUnusedInLastChunk = 0;
+	PoolStats Counts;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct Recompiler;
+}
+
+/**	Ahead of time recompiler behind the m6502-recomp tool
+*	- Traces the code reachable from the entry points of a PRG image, and
+*	  turns it into a C++ function that runs it with the CPU & Mem state:
+*
+*		m6502::s32 Name( m6502::s32 Cycles, m6502::CPU& cpu, m6502::Mem& memory );
+*
+*	  which is used like CPU::Execute, starting at cpu.PC.
+*	- Only for programs that never modify their own code, the operands are
+*	  baked into the C++ when it is generated.
+*	- RTS, RTI, BRK and JMP ($nnnn) jump through a switch of the traced
+*	  addresses, anything that isn't in it (and the last few cycles of the
+*	  budget) runs an instruction at a time with CPU::Execute. */
+struct m6502::Recompiler
+{
+	Word LoadAddress = 0;
+	std::vector<Byte> Image;			//the program without the PRG header
+	std::vector<Word> EntryPoints;
+	std::vector<bool> IsInstruction;	//by address, an instruction starts here
+	std::vector<bool> IsLabel;			//by address, something jumps here
+
+	/** Program & NumBytes are a PRG image, the same as CPU::LoadPrg */
+	Recompiler( const Byte* Program, u32 NumBytes );
+
+	/** Entry points outside of the image are ignored */
+	void AddEntryPoint( Word Address );
+
+	/** Find every instruction that can be reached from the entry points */
+	void Trace();
+
+	/** @return the C++ source of the traced code as FunctionName */
+	std::string Generate( const char* FunctionName ) const;
+
+	bool InImage( u32 Address ) const
+	{
+		return Address >= LoadAddress && Address < LoadAddress + Image.size();
+	}
+
+	Byte Read( Word Address ) const
+	{
+		return Image[Address - LoadAddress];
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct InputLog;
+	struct Recorder;
+	struct Replayer;
+}
+
+/**	The inputs that make a run non-deterministic, as a compact byte stream
+*	- The header is "M6RL", a version byte & a bit per page that was a device
+*	  page when the recording started
+*	- Then the events in the order they happened, each a type byte & either
+*	  the address (2 bytes, little endian) & value a device read returned, or
+*	  the cycle an interrupt or reset happened at, as a LEB128 delta from the
+*	  cycle of the previous one. The IRQ line is level triggered, so it is
+*	  recorded both when it is raised & when it is cleared */
+struct m6502::InputLog
+{
+	enum EventType : Byte
+	{
+		EVENT_DEVICE_READ = 0,
+		EVENT_IRQ = 1,
+		EVENT_NMI = 2,
+		EVENT_RESET = 3,
+		EVENT_CLEAR_IRQ = 4,	//the IRQ line was let go
+	};
+
+	static constexpr Byte VERSION = 1;
+	static constexpr u32 HEADER_SIZE = 4 + 1 + Mem::NUM_PAGES / 8;
+
+	struct Event
+	{
+		EventType Type;
+		Word Address;	//EVENT_DEVICE_READ
+		Byte Value;		//EVENT_DEVICE_READ
+		u64 Cycle;		//the others
+	};
+
+	std::vector<Byte> Stream;
+	u64 LastCycle = 0;		//of the last timed event appended
+
+	/** Start a new log of the device pages in memory */
+	void Begin( const Mem& memory );
+
+	/** @return false when Stream doesn't start with a header of this version */
+	bool IsValid() const;
+
+	bool IsDevicePage( Byte Page ) const;
+
+	void AppendDeviceRead( Word Address, Byte Value );
+
+	/** Cycle is from the start of the recording & never goes backwards */
+	void AppendTimed( EventType Type, u64 Cycle );
+
+	/** Decode the event at Offset in Stream & move Offset past it
+	*	@return false at the end of the stream or when the event is truncated */
+	bool ReadEvent( u32& Offset, u64& PreviousCycle, Event& Out ) const;
+};
+
+/**	Records what the devices mapped into a Mem return
+*	- Attach wraps the read & write handlers of every device page, the
+*	  devices still run, every value they return to the CPU is appended
+*	  to Log
+*	- Interrupts & resets come from outside of the CPU, whoever raises them
+*	  calls RecordInterrupt/RecordReset with the cycle they happened at */
+struct m6502::Recorder
+{
+	InputLog Log;
+	Mem* Memory = nullptr;
+	Mem::Page Devices[Mem::NUM_PAGES];	//the handlers that were wrapped
+
+	Recorder() = default;
+	~Recorder();
+	Recorder( const Recorder& ) = delete;
+	Recorder& operator=( const Recorder& ) = delete;
+
+	/** Start a new recording of the devices mapped into memory */
+	void Attach( Mem& memory );
+
+	/** Give the device pages their own handlers back */
+	void Detach();
+
+	void RecordInterrupt( InputLog::EventType Type, u64 Cycle );
+
+	void RecordReset( u64 Cycle );
+};
+
+/**	Plays an InputLog back instead of the devices
+*	- Attach maps the pages that were device pages in the recording to the
+*	  replayer, reads return the recorded values in order & writes are dropped
+*	- The interrupts & resets are handed back by NextTimedEvent for whoever
+*	  drives the CPU to raise at the same cycles
+*	- A read of a different address than the recording (or one past the end
+*	  of it) returns 0 & sets Diverged */
+struct m6502::Replayer
+{
+	const InputLog* Log = nullptr;
+	Mem* Memory = nullptr;
+	u32 ReadOffset = 0;			//of the next device read in Log->Stream
+	u32 TimedOffset = 0;		//of the next interrupt or reset
+	u64 ReadLastCycle = 0;
+	u64 TimedLastCycle = 0;
+	bool Diverged = false;
+
+	Replayer() = default;
+	~Replayer();
+	Replayer( const Replayer& ) = delete;
+	Replayer& operator=( const Replayer& ) = delete;
+
+	/** Start replaying log into memory
+	*	@return false when the log isn't valid */
+	bool Attach( const InputLog& log, Mem& memory );
+
+	/** The device pages read 0 & ignore writes again */
+	void Detach();
+
+	/** The next interrupt or reset, in the order they were recorded
+	*	@return false when there are no more */
+	bool NextTimedEvent( InputLog::Event& Out );
+
+	/** @return the recorded value of the next device read */
+	Byte ReplayRead( Word Address );
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <deque>
+#include "m6502_snapshot.h"
+
+namespace m6502
+{
+	struct Rewinder;
+}
+
+/**	Runs a CPU & keeps a snapshot every Interval cycles, so it can step back
+*	- Each snapshot shares the pages that didn't change with the one before
+*	  it, only the pages written in between cost memory
+*	- The oldest snapshots are dropped to keep their memory in MemoryBudget
+*	- StepBack restores the nearest snapshot before the cycle & runs forward
+*	  from it, so the devices must behave the same the 2nd time (e.g. be
+*	  replayed, see m6502_replay.h)
+*	- Runs with Engine, any of the CPU::Execute... functions */
+struct m6502::Rewinder
+{
+	using ExecuteFunction = s32 (CPU::*)( s32 Cycles, Mem& memory );
+
+	struct Point
+	{
+		u64 Cycle;
+		std::shared_ptr<const Snapshot> State;
+		u64 Bytes;		//of the pages it doesn't share with the point before it
+	};
+
+	CPU* Cpu = nullptr;
+	Mem* Memory = nullptr;
+	Snapshotter Snapshots;
+	ExecuteFunction Engine = &CPU::Execute;
+	s32 Interval = 100000;		//cycles between the snapshots, more than 0
+	u64 MemoryBudget = 16 * 1024 * 1024;
+
+	u64 Cycle = 0;				//run since Attach
+	std::deque<Point> Points;	//oldest first
+	u64 BytesUsed = 0;			//by Points
+
+	/** Start keeping the history of cpu & memory, from a snapshot now */
+	void Attach( CPU& cpu, Mem& memory );
+
+	void Detach();
+
+	/** Run the CPU, taking the snapshots that fall due
+	*	@return the number of cycles that were used */
+	s32 Execute( s32 Cycles );
+
+	/** Go back to the first instruction that starts at or after Cycle - Cycles,
+	*	the snapshots after that point are forgotten
+	*	@return false when that is before the oldest snapshot kept */
+	bool StepBack( u64 Cycles );
+
+private:
+	void TakePoint();
+};
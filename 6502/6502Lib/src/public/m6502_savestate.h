@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct SaveState;
+}
+
+/**	A CPU & its memory as one block of bytes, laid out to be used in place
+*	(e.g. straight from an mmap'd file) on a little endian machine
+*	- Header (starting "M6SS"), then a slot for each page (0 when the page is all zeros), then
+*	  the non-zero pages in order on 64 byte boundaries, then the devices'
+*	  state (whatever the caller saved, the format doesn't look inside it)
+*	- The checksum is FNV-1a over everything after the checksum field
+*	- A new Version only adds fields, in Reserved or after the header, so
+*	  Open takes the older versions too & Load leaves what they don't have
+*	  as it is. Version 2 added the cycle count & the interrupt inputs */
+struct m6502::SaveState
+{
+	static constexpr u32 VERSION = 2;
+	static constexpr u32 ALIGNMENT = 64;
+
+	enum InterruptBits : Byte
+	{
+		INTERRUPT_IRQ_LINE = 1 << 0,
+		INTERRUPT_NMI_PENDING = 1 << 1,
+	};
+
+	struct Header
+	{
+		Byte Magic[4];
+		u32 Version;
+		u32 TotalSize;		//bytes, including the header
+		u32 Checksum;
+		u32 HeaderSize;		//sizeof( Header ) when it was written
+		u32 NumPages;		//that are stored
+		u32 PagesOffset;
+		u32 DeviceStateOffset;
+		u32 DeviceStateSize;
+		Word PC;
+		Byte SP;
+		Byte A;
+		Byte X;
+		Byte Y;
+		Byte PS;
+		Byte Interrupts;		//INTERRUPT_... bits, from version 2
+		u32 TotalCyclesLow;		//from version 2, as 2 halves so the header only needs 4 byte alignment
+		u32 TotalCyclesHigh;
+		Byte Reserved[12];
+		Word PageSlots[Mem::NUM_PAGES];	//1 + the index of the stored page, 0 when it is all zeros
+	};
+
+	const Header* Head = nullptr;
+	u32 Size = 0;
+
+	/** @return the save state of cpu & memory (the bytes of Mem::Data, not the
+	*	page table) with DeviceState copied after it */
+	static std::vector<Byte> Write( const CPU& cpu, const Mem& memory,
+		const Byte* DeviceState = nullptr, u32 DeviceStateSize = 0 );
+
+	/** Use the save state in Data, which must stay valid & aligned to 4 bytes
+	*	while it is used, nothing is copied
+	*	@return false when it isn't a save state of this version or an older one, it is cut
+	*	short or (when VerifyChecksum) the checksum doesn't match */
+	bool Open( const Byte* Data, u32 NumBytes, bool VerifyChecksum = true );
+
+	/** @return the 256 bytes of the page in the save state, nullptr when they are all zero */
+	const Byte* Page( Byte PageNumber ) const
+	{
+		const Word Slot = Head->PageSlots[PageNumber];
+		return Slot ? (const Byte*)Head + Head->PagesOffset + (Slot - 1) * Mem::PAGE_SIZE : nullptr;
+	}
+
+	const Byte* DeviceState() const
+	{
+		return (const Byte*)Head + Head->DeviceStateOffset;
+	}
+
+	/** Copy the registers & the memory into cpu & memory, flushing its caches */
+	void Load( CPU& cpu, Mem& memory ) const;
+
+	static u32 Checksum( const Byte* Data, u32 NumBytes );
+};
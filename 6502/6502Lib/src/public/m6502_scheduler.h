@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct Recorder;
+	struct Scheduler;
+}
+
+/**	Runs a CPU with events at set cycles, e.g. a timer raising an IRQ
+*	- The events are kept in a min heap by the cycle of CPU::TotalCycles
+*	  they are due at, Execute runs the engine
+*	  straight through to the next one, without checking anything between
+*	  the instructions, then fires the events that are due & takes the
+*	  interrupts that are pending with CPU::ServiceInterrupts
+*	- An event fires between instructions, at the end of the one that runs
+*	  over its cycle, like an interrupt line is sampled
+*	- While an IRQ is held with I set it runs an instruction at a time, so it
+*	  is taken as soon as CLI, PLP or RTI clears I
+*	- Events at the same cycle fire in the order they were scheduled */
+struct m6502::Scheduler
+{
+	using ExecuteFunction = s32 (CPU::*)( s32 Cycles, Mem& memory );
+
+	/** Called when its event fires, it can raise interrupts on
+	*	scheduler.Cpu & schedule more events (e.g. the next tick of a timer) */
+	using Callback = void (*)( void* Context, Scheduler& scheduler );
+
+	enum class Action : Byte
+	{
+		RaiseIRQ,
+		ClearIRQ,
+		RaiseNMI,
+		Call,
+	};
+
+	struct Event
+	{
+		u64 Cycle;
+		u64 Sequence;		//the order it was scheduled in
+		Action What;
+		Callback Call;		//Action::Call
+		void* Context;
+	};
+
+	CPU* Cpu = nullptr;
+	Mem* Memory = nullptr;
+	ExecuteFunction Engine = &CPU::Execute;
+
+	/** When set, the changes the events make to the IRQ line & the NMIs
+	*	they raise are recorded to it, the callbacks' included */
+	Recorder* Recording = nullptr;
+
+	/** Run cpu & memory, with no events */
+	void Attach( CPU& cpu, Mem& memory );
+
+	/** AtCycle is a CPU::TotalCycles, one that has passed fires at the start
+	*	of the next Execute */
+	void Schedule( u64 AtCycle, Action What );
+
+	void Schedule( u64 AtCycle, Callback Call, void* Context );
+
+	u32 NumPending() const
+	{
+		return (u32)Events.size();
+	}
+
+	/** @return the cycle the next event is due at, or ~0 when there isn't one */
+	u64 NextEventCycle() const
+	{
+		return Events.empty() ? ~0ull : Events.front().Cycle;
+	}
+
+	/** Forget every event that hasn't fired */
+	void Clear();
+
+	/** Run for (at least) Cycles, firing the events & taking the interrupts
+	*	@return the number of cycles that were used */
+	s32 Execute( s32 Cycles );
+
+private:
+	std::vector<Event> Events;		//a min heap of Cycle, then Sequence
+	u64 NextSequence = 0;
+
+	void Push( const Event& Scheduled );
+	void FireDueEvents();
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include "m6502_pool.h"
+
+namespace m6502
+{
+	struct Snapshot;
+	struct Snapshotter;
+}
+
+/**	The CPU & the memory at one point in time
+*	- Pages that weren't written between two snapshots are shared by them
+*	  (reference counted), so a snapshot only holds its own copy of the
+*	  pages that changed since the one before it
+*	- Immutable once taken, so it can be restored by any number of machines,
+*	  on any thread
+*	- Only the bytes of Mem::Data, not the page table or the devices' state */
+struct m6502::Snapshot
+{
+	using PageData = PageFrame;
+
+	CPU Cpu;
+	std::shared_ptr<const PageData> Pages[Mem::NUM_PAGES];
+};
+
+/**	Takes & restores the snapshots of one Mem
+*	- Attach turns on the Mem's dirty page tracking, after that the pages
+*	  that weren't written since the last Take or Restore are known to be the
+*	  same as that snapshot's
+*	- Take copies the pages written since then & shares the rest
+*	- Restore copies the pages written since then, and the pages the two
+*	  snapshots don't share, rather than all 64KB
+*	- Anything that writes to Mem::Data without going through the CPU or
+*	  Mem::operator[] must call Mem::MarkWritten */
+struct m6502::Snapshotter
+{
+	Mem* Memory = nullptr;
+
+	/** When set the pages Take copies are its frames, given back once no
+	*	snapshot shares them, rather than from the heap. It must outlive the
+	*	snapshots */
+	PageArena* Arena = nullptr;
+
+	/** The snapshot the memory was last taken to or restored from */
+	std::shared_ptr<const Snapshot> Current;
+
+	/** Start taking snapshots of memory */
+	void Attach( Mem& memory );
+
+	void Detach();
+
+	/** @return a snapshot of cpu & the attached memory */
+	std::shared_ptr<const Snapshot> Take( const CPU& cpu );
+
+	/** Put cpu & the attached memory back to From, invalidating the caches
+	*	attached to the memory where it changes */
+	void Restore( const std::shared_ptr<const Snapshot>& From, CPU& cpu );
+};
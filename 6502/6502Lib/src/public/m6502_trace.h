@@ -0,0 +1,227 @@
+#pragma once
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct TraceRecord;
+	struct TraceRing;
+	struct Tracer;
+	struct TraceReader;
+}
+
+/** The state of the CPU as an instruction is about to run */
+struct m6502::TraceRecord
+{
+	u64 Cycle;			//TotalCycles
+	Word PC;
+	Byte Opcode;
+	Byte Operand[2];	//only the instruction's length of them are traced, 0 in a device page
+	Byte A, X, Y, SP;
+	Byte PS;			//as GetPS() packs it
+};
+
+/**	A ring of TraceRecords for one thread to push to & another to pop from
+*	- Neither side locks, each only writes its own index & reads the other's
+*	- Capacity is rounded up to a power of 2 */
+struct m6502::TraceRing
+{
+	static constexpr u32 PUBLISH_EVERY = 64;	//records, so the popper doesn't read the line being written
+
+	std::vector<TraceRecord> Records;
+	u32 Mask;
+
+	explicit TraceRing( u32 Capacity );
+	TraceRing( const TraceRing& ) = delete;
+	TraceRing& operator=( const TraceRing& ) = delete;
+
+	/** Only from the pushing thread, the slot of the next record to push
+	*	@return nullptr when the ring is full */
+	TraceRecord* Claim()
+	{
+		if ( Pushed - TailSeen > Mask )
+		{
+			TailSeen = Tail.load( std::memory_order_acquire );
+			if ( Pushed - TailSeen > Mask )
+			{
+				Publish();
+				return nullptr;
+			}
+		}
+		return &Records[Pushed & Mask];
+	}
+
+	/** Only from the pushing thread, push the claimed record. It isn't
+	*	poppable until the next Publish, which this does every PUBLISH_EVERY */
+	void Commit()
+	{
+		Pushed++;
+		if ( !(Pushed % PUBLISH_EVERY) )
+		{
+			Publish();
+		}
+	}
+
+	/** Claim, copy & Commit
+	*	@return false when the ring is full */
+	bool TryPush( const TraceRecord& Record )
+	{
+		TraceRecord* Slot = Claim();
+		if ( !Slot )
+		{
+			return false;
+		}
+		*Slot = Record;
+		Commit();
+		return true;
+	}
+
+	/** Only from the pushing thread, make every pushed record poppable */
+	void Publish()
+	{
+		Head.store( Pushed, std::memory_order_release );
+	}
+
+	/** Only from the popping thread
+	*	@return how many records were copied to Out, up to MaxRecords */
+	u32 Pop( TraceRecord* Out, u32 MaxRecords );
+
+	bool IsEmpty() const
+	{
+		return Head.load( std::memory_order_acquire ) == Tail.load( std::memory_order_acquire );
+	}
+
+private:
+	// each side's index on a cache line of its own, so they don't bounce
+	alignas( 64 ) std::atomic<u32> Head{ 0 };	//the next record to pop up to
+	u32 Pushed = 0;								//the next record to push
+	u32 TailSeen = 0;							//the pusher's last look at Tail
+	alignas( 64 ) std::atomic<u32> Tail{ 0 };	//the next record to pop
+};
+
+/**	Writes a trace of every instruction CPU::ExecuteTrace runs to a file
+*	- ExecuteTrace pushes the records into Ring, a thread of the Tracer's
+*	  pops them, encodes them & writes the file, so the CPU's thread never
+*	  formats or writes anything
+*	- When the ring is full ExecuteTrace waits for room, nothing is dropped.
+*	  NumStalls counts the waits, a bigger ring helps with a slow disk
+*	- The file is "M6TR" & a version byte, then each record as:
+*		a byte of TRACE_... bits for what is in the record
+*		the PC (2 bytes, little endian), when it isn't where the previous
+*		  instruction falls through to
+*		the opcode & its operands, when they aren't the same as the last
+*		  time the PC was there
+*		A, X, Y, SP & PS, each only when it changed
+*		the cycles since the previous record as a LEB128
+*	  so a loop takes 2 or 3 bytes an instruction. TraceReader decodes it */
+struct m6502::Tracer
+{
+	enum Contents : Byte
+	{
+		TRACE_PC = 1 << 0,
+		TRACE_CODE = 1 << 1,
+		TRACE_A = 1 << 2,
+		TRACE_X = 1 << 3,
+		TRACE_Y = 1 << 4,
+		TRACE_SP = 1 << 5,
+		TRACE_PS = 1 << 6,
+	};
+
+	static constexpr Byte VERSION = 1;
+	static constexpr u32 HEADER_SIZE = 4 + 1;
+	static constexpr u32 DEFAULT_CAPACITY = 1 << 16;
+
+	TraceRing Ring;
+	Mem* Memory = nullptr;
+	u64 NumStalls = 0;
+
+	/** Only read them after Close, the writing thread counts them */
+	u64 NumRecords = 0;
+	u64 NumBytes = 0;
+
+	explicit Tracer( u32 Capacity = DEFAULT_CAPACITY );
+	~Tracer();
+	Tracer( const Tracer& ) = delete;
+	Tracer& operator=( const Tracer& ) = delete;
+
+	/** Start a new trace file & the thread that writes it
+	*	@return false when the file can't be created */
+	bool Open( const char* Path );
+
+	/** Write the rest of the records & close the file, from the CPU's thread */
+	void Close();
+
+	bool IsOpen() const
+	{
+		return File != nullptr;
+	}
+
+	/** Trace the instructions ExecuteTrace runs in memory */
+	void Attach( Mem& memory );
+	void Detach();
+
+	/** From the CPU's thread, while open, the slot to fill in before
+	*	Ring.Commit(), waiting for room when the ring is full */
+	TraceRecord& Claim()
+	{
+		TraceRecord* Slot;
+		while ( !(Slot = Ring.Claim()) )
+		{
+			NumStalls++;
+			std::this_thread::yield();
+		}
+		return *Slot;
+	}
+
+private:
+	FILE* File = nullptr;
+	std::thread Writer;
+	std::atomic<bool> Closing{ false };
+
+	// the writing thread's
+	std::vector<Byte> Buffer;	//of the file, written when it has FLUSH_BYTES
+	size_t BufferUsed = 0;
+	std::vector<u32> LastCode;	//by PC, the opcode & operands last seen there
+	TraceRecord Last;
+	bool First = true;
+
+	void Write();
+	void Encode( const TraceRecord& Record );
+	void Flush();
+};
+
+/**	Reads a file written by Tracer, back into TraceRecords or as text */
+struct m6502::TraceReader
+{
+	std::vector<Byte> Stream;
+	u32 Offset = Tracer::HEADER_SIZE;
+
+	/** @return false when the file can't be read or isn't a trace */
+	bool Load( const char* Path );
+
+	/** @return false when Stream doesn't start with a header of this version */
+	bool IsValid() const;
+
+	/** Decode the next record
+	*	@return false at the end of the stream or when the record is truncated */
+	bool Next( TraceRecord& Out );
+
+	/** Start from the first record again */
+	void Rewind();
+
+	/** e.g. "      1234  1003  8D 20 30  STA $3020     A:42 X:00 Y:00 SP:FF NV-BDIZC:00100100" */
+	static std::string Format( const TraceRecord& Record );
+
+	/** Write every record from the first as a line of Format
+	*	@return the number of records written */
+	u64 WriteText( FILE* Out );
+
+private:
+	std::vector<u32> LastCode;
+	TraceRecord Last = {};
+	bool First = true;
+};
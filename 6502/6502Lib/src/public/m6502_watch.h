@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include "m6502.h"
+
+namespace m6502
+{
+	struct Watchpoints;
+}
+
+/**	Read, write & access watchpoints on ranges of addresses
+*	- Only the pages with a watched address are mapped to the watchpoints'
+*	  handlers, which check the address & pass the access on to what the
+*	  page was mapped to before. Every other page keeps its single load or
+*	  store in CPU::ReadByte & CPU::WriteByte
+*	- Pages with only write watchpoints keep reading directly. A page with a
+*	  read watchpoint reads through a handler like a device page does, but
+*	  keeps its Code, so the engines that decode ahead (Cached, Blocks, Debug
+*	  & Jit) still run code from it. Their fetches aren't hits, the other
+*	  engines' fetches from a read watched range are
+*	- The PC of a hit is the CPU's at the access, past the instruction's
+*	  operands. The cycle is CPU::TotalCycles, which CPU::ExecuteDebug keeps
+*	  up to date at each block it runs (the other engines only on return)
+*	- With StopOnHit, ExecuteDebug returns after the block (or the instruction,
+*	  in a page with breakpoints) that hit one, with StopReason::Watchpoint
+*	- Don't map the watched pages while attached */
+struct m6502::Watchpoints
+{
+	enum Kind : Byte
+	{
+		WATCH_READ = 1,
+		WATCH_WRITE = 2,
+		WATCH_ACCESS = WATCH_READ | WATCH_WRITE,
+	};
+
+	struct Range
+	{
+		Word First;
+		Word Last;		//inclusive
+		Kind On;
+	};
+
+	struct Hit
+	{
+		u64 Cycle;
+		Word PC;
+		Word Address;
+		Byte OldValue;	//what a read returned, or what was there before a write
+		Byte NewValue;	//the same as OldValue for a read
+		bool Write;
+	};
+
+	CPU* Cpu = nullptr;
+	Mem* Memory = nullptr;
+	std::vector<Range> Ranges;
+	std::vector<Hit> Hits;
+	u32 MaxHits = 1 << 16;		//later hits are counted but not kept
+	u64 NumHits = 0;
+	bool StopOnHit = false;
+
+	Watchpoints() = default;
+	~Watchpoints();
+	Watchpoints( const Watchpoints& ) = delete;
+	Watchpoints& operator=( const Watchpoints& ) = delete;
+
+	/** Watch cpu's accesses to memory */
+	void Attach( CPU& cpu, Mem& memory );
+
+	/** Give the watched pages back their own mapping */
+	void Detach();
+
+	/** Watch First to Last (inclusive) */
+	void Add( Word First, Word Last, Kind On );
+
+	void ClearAll();
+
+private:
+	Mem::Page Originals[Mem::NUM_PAGES];	//of the pages that are routed here
+	Byte Routed[Mem::NUM_PAGES] = {};		//the Kinds watched in each page
+
+	/** Route the pages with watchpoints here & the rest back, flushing the caches */
+	void Route();
+
+	Byte Watched( Word Address ) const;
+	void Record( Word Address, Byte OldValue, Byte NewValue, bool Write );
+
+	static Byte CheckedRead( void* Context, Word Address );
+	static void CheckedWrite( void* Context, Word Address, Byte Value );
+};
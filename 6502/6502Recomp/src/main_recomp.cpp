@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "m6502_recomp.h"
+
+/**	m6502-recomp [-n FunctionName] [-e EntryPoint]... [-o Output.cpp] Input.prg
+*	- EntryPoint is hex, with or without a $ or 0x, the load address when there is none
+*	- Writes the C++ to stdout when there is no -o */
+static void Usage()
+{
+	fprintf( stderr, "usage: m6502-recomp [-n FunctionName] [-e EntryPoint]... [-o Output.cpp] Input.prg\n" );
+}
+
+static bool ParseAddress( const char* Text, m6502::Word& Address )
+{
+	if ( Text[0] == '$' )
+	{
+		Text++;
+	}
+	char* End = nullptr;
+	const unsigned long Value = strtoul( Text, &End, 16 );
+	if ( End == Text || *End != '\0' || Value > 0xFFFF )
+	{
+		return false;
+	}
+	Address = (m6502::Word)Value;
+	return true;
+}
+
+int main( int argc, char** argv )
+{
+	using namespace m6502;
+	const char* FunctionName = "RecompiledPrg";
+	const char* OutputPath = nullptr;
+	const char* InputPath = nullptr;
+	std::vector<Word> EntryPoints;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		const bool HasValue = i + 1 < argc;
+		if ( strcmp( argv[i], "-n" ) == 0 && HasValue )
+		{
+			FunctionName = argv[++i];
+		}
+		else if ( strcmp( argv[i], "-o" ) == 0 && HasValue )
+		{
+			OutputPath = argv[++i];
+		}
+		else if ( strcmp( argv[i], "-e" ) == 0 && HasValue )
+		{
+			Word Address;
+			if ( !ParseAddress( argv[++i], Address ) )
+			{
+				fprintf( stderr, "m6502-recomp: bad entry point '%s'\n", argv[i] );
+				return 1;
+			}
+			EntryPoints.push_back( Address );
+		}
+		else if ( argv[i][0] != '-' && !InputPath )
+		{
+			InputPath = argv[i];
+		}
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+	if ( !InputPath )
+	{
+		Usage();
+		return 1;
+	}
+
+	FILE* Input = fopen( InputPath, "rb" );
+	if ( !Input )
+	{
+		fprintf( stderr, "m6502-recomp: can't open '%s'\n", InputPath );
+		return 1;
+	}
+	std::vector<Byte> Program;
+	Byte Buffer[4096];
+	size_t NumRead;
+	while ( (NumRead = fread( Buffer, 1, sizeof( Buffer ), Input )) > 0 )
+	{
+		Program.insert( Program.end(), Buffer, Buffer + NumRead );
+	}
+	fclose( Input );
+
+	Recompiler Recomp( Program.data(), (u32)Program.size() );
+	if ( Recomp.Image.empty() )
+	{
+		fprintf( stderr, "m6502-recomp: '%s' isn't a PRG\n", InputPath );
+		return 1;
+	}
+	if ( EntryPoints.empty() )
+	{
+		EntryPoints.push_back( Recomp.LoadAddress );
+	}
+	for ( Word Entry : EntryPoints )
+	{
+		Recomp.AddEntryPoint( Entry );
+	}
+	Recomp.Trace();
+	const std::string Source = Recomp.Generate( FunctionName );
+
+	FILE* Output = OutputPath ? fopen( OutputPath, "w" ) : stdout;
+	if ( !Output )
+	{
+		fprintf( stderr, "m6502-recomp: can't write '%s'\n", OutputPath );
+		return 1;
+	}
+	fwrite( Source.data(), 1, Source.size(), Output );
+	if ( OutputPath )
+	{
+		fclose( Output );
+	}
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+#include "m6502_batch.h"
+
+class M6502BatchRunnerTests : public testing::Test
+{
+public:
+	std::vector<std::unique_ptr<m6502::Mem>> Memories;
+	std::vector<std::unique_ptr<m6502::CPU>> CPUs;
+	std::vector<m6502::BatchJob> Jobs;
+
+	virtual void SetUp()
+	{
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/** Machines that add their index to A forever, the budgets go up with the index
+	*
+	* = $1000
+	loop
+		clc
+		adc #index
+		jmp loop
+	*/
+	void MakeMachines( m6502::u32 NumMachines )
+	{
+		using namespace m6502;
+		for ( u32 i = 0; i < NumMachines; i++ )
+		{
+			Memories.emplace_back( new Mem() );
+			CPUs.emplace_back( new CPU() );
+			Mem& memory = *Memories.back();
+			CPU& cpu = *CPUs.back();
+			cpu.Reset( 0x1000, memory );
+			Byte Program[] = { 0x18, 0x69, (Byte)i, 0x4C, 0x00, 0x10 };
+			for ( u32 b = 0; b < sizeof( Program ); b++ )
+			{
+				memory[0x1000 + b] = Program[b];
+			}
+
+			BatchJob Job;
+			Job.Cpu = &cpu;
+			Job.Memory = &memory;
+			Job.Cycles = 1000 + (s32)i * 97;
+			Jobs.push_back( Job );
+		}
+	}
+};
+
+TEST_F( M6502BatchRunnerTests, EveryMachineRunsTheSameAsOnItsOwn )
+{
+	// given:
+	using namespace m6502;
+	constexpr u32 NUM_MACHINES = 200;
+	MakeMachines( NUM_MACHINES );
+	std::vector<CPU> Expected;
+	std::vector<s32> ExpectedCycles;
+	for ( u32 i = 0; i < NUM_MACHINES; i++ )
+	{
+		Mem Copy = *Memories[i];
+		CPU Cpu = *CPUs[i];
+		ExpectedCycles.push_back( Cpu.Execute( Jobs[i].Cycles, Copy ) );
+		Expected.push_back( Cpu );
+	}
+	BatchRunner Runner;
+	Runner.NumThreads = 4;
+
+	// when:
+	const BatchResult Result = Runner.Run( Jobs );
+
+	// then:
+	u64 TotalCycles = 0;
+	for ( u32 i = 0; i < NUM_MACHINES; i++ )
+	{
+		EXPECT_FALSE( Jobs[i].Threw );
+		EXPECT_EQ( Jobs[i].CyclesUsed, ExpectedCycles[i] );
+		EXPECT_EQ( CPUs[i]->A, Expected[i].A );
+		EXPECT_EQ( CPUs[i]->PC, Expected[i].PC );
+		TotalCycles += ExpectedCycles[i];
+	}
+	EXPECT_EQ( Result.TotalCycles, TotalCycles );
+	EXPECT_EQ( Result.NumThrew, 0u );
+	EXPECT_GT( Result.CyclesPerSecond, 0 );
+}
+
+TEST_F( M6502BatchRunnerTests, AMachineThatThrowsDoesntStopTheOthers )
+{
+	// given:
+	using namespace m6502;
+	MakeMachines( 8 );
+	(*Memories[3])[0x1000] = 0xFF;	// illegal
+	BatchRunner Runner;
+	Runner.NumThreads = 3;
+
+	// when:
+	testing::internal::CaptureStdout();
+	const BatchResult Result = Runner.Run( Jobs );
+	testing::internal::GetCapturedStdout();
+
+	// then:
+	EXPECT_EQ( Result.NumThrew, 1u );
+	EXPECT_TRUE( Jobs[3].Threw );
+	EXPECT_EQ( Jobs[3].CyclesUsed, 0 );
+	for ( u32 i = 0; i < 8; i++ )
+	{
+		EXPECT_TRUE( i == 3 || Jobs[i].CyclesUsed >= Jobs[i].Cycles );
+	}
+}
+
+TEST_F( M6502BatchRunnerTests, MoreThreadsThanJobsIsFine )
+{
+	// given:
+	using namespace m6502;
+	MakeMachines( 2 );
+	BatchRunner Runner;
+	Runner.NumThreads = 16;
+	Runner.Engine = &CPU::ExecuteTable;
+
+	// when:
+	const BatchResult Result = Runner.Run( Jobs );
+
+	// then:
+	EXPECT_GE( Jobs[0].CyclesUsed, Jobs[0].Cycles );
+	EXPECT_GE( Jobs[1].CyclesUsed, Jobs[1].Cycles );
+	EXPECT_EQ( Result.TotalCycles, (u64)(Jobs[0].CyclesUsed + Jobs[1].CyclesUsed) );
+}
+
+TEST_F( M6502BatchRunnerTests, NoJobsIsFine )
+{
+	// given:
+	using namespace m6502;
+	BatchRunner Runner;
+
+	// when:
+	const BatchResult Result = Runner.Run( Jobs );
+
+	// then:
+	EXPECT_EQ( Result.TotalCycles, 0u );
+}
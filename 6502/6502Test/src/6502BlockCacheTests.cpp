@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+#include "m6502.h"
+
+class M6502BlockCacheTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::BlockCache Cache;
+
+	virtual void SetUp()
+	{
+		Cache.Attach( mem );
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502BlockCacheTests, ABlockEndsAtTheFirstBranch )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	cpu.Flag.Z = false;
+	mem[0xFF00] = CPU::INS_LDA_ABSX;
+	mem[0xFF01] = 0x80;
+	mem[0xFF02] = 0x44;
+	mem[0xFF03] = CPU::INS_INX;
+	mem[0xFF04] = CPU::INS_BEQ;
+	mem[0xFF05] = 0x10;
+	mem[0xFF06] = CPU::INS_NOP;
+
+	// when:
+	cpu.ExecuteBlocks( 4 + 2 + 2, mem );
+
+	// then:
+	const BlockCache::Block* B = Cache.Blocks[0xFF00];
+	ASSERT_NE( B, nullptr );
+	EXPECT_EQ( B->Ops.size(), 3u );
+	EXPECT_EQ( B->Length, 6 );
+	EXPECT_EQ( B->MaxCycles, (4 + 1) + 2 + (2 + 2) );
+	EXPECT_EQ( B->Ops[0].Operand, 0x4480 );
+	EXPECT_EQ( cpu.PC, 0xFF06 );
+}
+
+TEST_F( M6502BlockCacheTests, ABlockThatWouldOverrunTheBudgetStopsOnTheSameInstructionAsExecute )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_NOP;
+	mem[0xFF01] = CPU::INS_NOP;
+	mem[0xFF02] = CPU::INS_NOP;
+	mem[0xFF03] = CPU::INS_JMP_ABS;
+	mem[0xFF04] = 0x00;
+	mem[0xFF05] = 0xFF;
+
+	// when:
+	const s32 ActualCycles = cpu.ExecuteBlocks( 3, mem );
+
+	// then:
+	EXPECT_EQ( ActualCycles, 4 );
+	EXPECT_EQ( cpu.PC, 0xFF02 );
+}
+
+TEST_F( M6502BlockCacheTests, BlocksAreChainedToTheBlocksThatRunAfterThem )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_JSR;
+	mem[0xFF01] = 0x00;
+	mem[0xFF02] = 0x80;
+	mem[0xFF03] = CPU::INS_JMP_ABS;
+	mem[0xFF04] = 0x00;
+	mem[0xFF05] = 0xFF;
+	mem[0x8000] = CPU::INS_RTS;
+
+	// when:
+	cpu.ExecuteBlocks( 6 + 6 + 3 + 1, mem );
+
+	// then:
+	const BlockCache::Block* Call = Cache.Blocks[0xFF00];
+	const BlockCache::Block* Sub = Cache.Blocks[0x8000];
+	const BlockCache::Block* Return = Cache.Blocks[0xFF03];
+	ASSERT_NE( Call, nullptr );
+	ASSERT_NE( Sub, nullptr );
+	ASSERT_NE( Return, nullptr );
+	EXPECT_EQ( Call->Next[0], Sub );
+	EXPECT_EQ( Sub->Next[0], Return );
+	EXPECT_EQ( Return->Next[0], Call );
+	EXPECT_EQ( Cache.Translated.size(), 3u );
+}
+
+TEST_F( M6502BlockCacheTests, AStoreIntoTheRunningBlockInvalidatesIt )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	cpu.A = 0x37;
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x04;
+	mem[0xFF02] = 0xFF;
+	mem[0xFF03] = CPU::INS_LDX_IM;
+	mem[0xFF04] = 0x42;
+	mem[0xFF05] = CPU::INS_JMP_ABS;
+	mem[0xFF06] = 0x00;
+	mem[0xFF07] = 0xFF;
+
+	// when:
+	cpu.ExecuteBlocks( 4 + 2, mem );
+
+	// then:
+	EXPECT_EQ( mem[0xFF04], 0x37 );
+	EXPECT_EQ( cpu.X, 0x37 );
+	EXPECT_EQ( cpu.PC, 0xFF05 );
+	EXPECT_EQ( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_FALSE( Cache.Translated[0]->Valid );
+}
+
+TEST_F( M6502BlockCacheTests, WritesOutsideTheBlocksLeaveThemAlone )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x10;
+	mem[0xFF02] = 0xFF;	// the same page, after the block
+	mem[0xFF03] = CPU::INS_JMP_ABS;
+	mem[0xFF04] = 0x00;
+	mem[0xFF05] = 0xFF;
+
+	// when:
+	cpu.ExecuteBlocks( 4 + 3, mem );
+
+	// then:
+	ASSERT_NE( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_TRUE( Cache.Blocks[0xFF00]->Valid );
+	EXPECT_EQ( Cache.PageBlocks[0xFF].size(), 1u );
+}
+
+TEST_F( M6502BlockCacheTests, ABlockCrossingAPageIsInvalidatedByEitherPage )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x10FE, mem );
+	mem[0x10FE] = CPU::INS_LDA_ABS;
+	mem[0x10FF] = 0x00;
+	mem[0x1100] = 0x20;
+	mem[0x1101] = CPU::INS_RTS;
+	cpu.ExecuteBlocks( 4, mem );
+
+	// when:
+	s32 Cycles = 0;
+	cpu.WriteByte( 0x30, Cycles, 0x1101, mem );
+
+	// then:
+	EXPECT_EQ( Cache.Blocks[0x10FE], nullptr );
+	EXPECT_TRUE( Cache.PageBlocks[0x11].empty() );
+}
+
+TEST_F( M6502BlockCacheTests, InitialisingTheMemoryFlushesTheCache )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_NOP;
+	cpu.ExecuteBlocks( 2, mem );
+
+	// when:
+	mem.Initialise();
+
+	// then:
+	EXPECT_EQ( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_TRUE( Cache.Translated.empty() );
+	EXPECT_TRUE( Cache.PageBlocks[0xFF].empty() );
+}
+
+TEST_F( M6502BlockCacheTests, WithoutACacheAttachedTheInstructionsStillRun )
+{
+	// given:
+	using namespace m6502;
+	Cache.Detach();
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_LDA_IM;
+	mem[0xFF01] = 0x84;
+
+	// when:
+	const s32 ActualCycles = cpu.ExecuteBlocks( 2, mem );
+
+	// then:
+	EXPECT_EQ( mem.Blocks, nullptr );
+	EXPECT_EQ( ActualCycles, 2 );
+	EXPECT_EQ( cpu.A, 0x84 );
+	EXPECT_TRUE( cpu.Flag.N );
+}
+
+TEST_F( M6502BlockCacheTests, DestroyingTheCacheDetachesItFromTheMemory )
+{
+	// given:
+	using namespace m6502;
+	BlockCache* Temporary = new BlockCache;
+	Temporary->Attach( mem );
+	EXPECT_EQ( mem.Blocks, Temporary );
+
+	// when:
+	delete Temporary;
+
+	// then:
+	EXPECT_EQ( mem.Blocks, nullptr );
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "m6502.h"
+
+class M6502BreakpointTests : public testing::TestWithParam<bool>
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::BlockCache Blocks;
+	m6502::Breakpoints Breaks;
+
+	virtual void SetUp()
+	{
+		using namespace m6502;
+		if ( GetParam() )
+		{
+			Blocks.Attach( mem );
+		}
+		Breaks.Attach( mem );
+		cpu.Reset( 0x1000, mem );
+		/*
+		* = $1000
+		loop
+			inx
+			inx
+			jsr sub
+			iny
+			jmp loop
+		sub
+			sta $20
+			rts
+		*/
+		Byte Program[] = { 0xE8, 0xE8, 0x20, 0x09, 0x10, 0xC8, 0x4C, 0x00, 0x10, 0x85, 0x20, 0x60 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			mem[0x1000 + i] = Program[i];
+		}
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_P( M6502BreakpointTests, StopsBeforeTheInstructionAtABreakpoint )
+{
+	// given:
+	using namespace m6502;
+	Breaks.Set( 0x1005 );
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Breakpoint );
+	EXPECT_EQ( cpu.PC, 0x1005 );
+	EXPECT_EQ( cpu.X, 2 );
+	EXPECT_EQ( cpu.Y, 0 );
+	EXPECT_EQ( CyclesUsed, 2 + 2 + 6 + 3 + 6 );
+	EXPECT_EQ( cpu.TotalCycles, (u64)CyclesUsed );
+}
+
+TEST_P( M6502BreakpointTests, ContinuesFromTheBreakpointItStoppedAt )
+{
+	// given:
+	using namespace m6502;
+	Breaks.Set( 0x1005 );
+	cpu.ExecuteDebug( 1000, mem );
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Breakpoint );
+	EXPECT_EQ( cpu.PC, 0x1005 );
+	EXPECT_EQ( cpu.X, 4 );
+	EXPECT_EQ( cpu.Y, 1 );
+	EXPECT_EQ( CyclesUsed, 2 + 3 + 2 + 2 + 6 + 3 + 6 );
+}
+
+TEST_P( M6502BreakpointTests, RunsTheSameAsExecuteWithoutAnyBreakpoints )
+{
+	// given:
+	using namespace m6502;
+	CPU Reference = cpu;
+	Mem ReferenceMem = mem;
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteDebug( 5000, mem );
+	const s32 ReferenceCycles = Reference.Execute( 5000, ReferenceMem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Budget );
+	EXPECT_EQ( CyclesUsed, ReferenceCycles );
+	EXPECT_EQ( cpu.PC, Reference.PC );
+	EXPECT_EQ( cpu.X, Reference.X );
+	EXPECT_EQ( cpu.Y, Reference.Y );
+}
+
+TEST_P( M6502BreakpointTests, ABreakpointInTheNextPageOfABlockIsSeen )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $10FE
+		inx
+		inx
+		inx	; $1100
+		inx
+		jmp $10FE
+	*/
+	cpu.PC = 0x10FE;
+	Byte Program[] = { 0xE8, 0xE8, 0xE8, 0xE8, 0x4C, 0xFE, 0x10 };
+	for ( u32 i = 0; i < sizeof( Program ); i++ )
+	{
+		mem[0x10FE + i] = Program[i];
+	}
+	Breaks.Set( 0x1101 );
+
+	// when:
+	cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Breakpoint );
+	EXPECT_EQ( cpu.PC, 0x1101 );
+	EXPECT_EQ( cpu.X, 3 );
+}
+
+TEST_P( M6502BreakpointTests, AClearedBreakpointIsntHit )
+{
+	// given:
+	using namespace m6502;
+	Breaks.Set( 0x1005 );
+	Breaks.Set( 0x1009 );
+	Breaks.Clear( 0x1005 );
+
+	// when:
+	cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Breakpoint );
+	EXPECT_EQ( cpu.PC, 0x1009 );
+	EXPECT_TRUE( Breaks.PageHasAny( 0x10 ) );
+	Breaks.Clear( 0x1009 );
+	EXPECT_FALSE( Breaks.PageHasAny( 0x10 ) );
+}
+
+TEST_P( M6502BreakpointTests, TheOtherEnginesIgnoreTheBreakpoints )
+{
+	// given:
+	using namespace m6502;
+	Breaks.Set( 0x1005 );
+
+	// when:
+	cpu.ExecuteBlocks( 1000, mem );
+
+	// then:
+	EXPECT_GE( cpu.X, 80 );		// 2 a loop of 24 cycles
+}
+
+INSTANTIATE_TEST_SUITE_P( WithAndWithoutBlocks, M6502BreakpointTests, testing::Values( true, false ) );
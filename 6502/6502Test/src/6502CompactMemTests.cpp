@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+#include "m6502_compact.h"
+#include "m6502_batch.h"
+
+class M6502CompactMemTests : public testing::Test
+{
+public:
+	m6502::Mem Source;
+	m6502::CPU cpu;
+	m6502::PageArena Arena;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( 0x1000, Source );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/** A program that stores A & X round a loop
+	*
+	* = $1000
+	loop
+		clc
+		adc #$03
+		sta $2000,x
+		inx
+		bne loop
+		sta $3000
+		jmp loop
+	*/
+	void LoadProgram()
+	{
+		using namespace m6502;
+		Byte Program[] = {
+			0x18, 0x69, 0x03, 0x9D, 0x00, 0x20, 0xE8, 0xD0, 0xF7, 0x8D, 0x00, 0x30, 0x4C, 0x00, 0x10 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			Source[0x1000 + i] = Program[i];
+		}
+	}
+};
+
+TEST_F( M6502CompactMemTests, PagesThatAreTheSameShareAFrame )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+
+	// when:
+	SharedImage Image( Source );
+
+	// then:
+	EXPECT_EQ( Image.NumFrames(), 2u );		// the zeros & the program
+	EXPECT_EQ( Image.Pages[0x00], Image.Pages[0xFF] );
+	EXPECT_NE( Image.Pages[0x10], Image.Pages[0x00] );
+	EXPECT_EQ( Image.Pages[0x10]->Bytes[0], 0x18 );
+}
+
+TEST_F( M6502CompactMemTests, AMachineOnlyHoldsThePagesItWrote )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	SharedImage Image( Source );
+	CompactMem Machine( Image, Arena );
+	Mem Bindable;
+	Machine.Bind( Bindable );
+
+	// when:
+	cpu.Execute( 1000, Bindable );
+
+	// then:
+	EXPECT_EQ( Machine.NumPrivatePages(), 1u );
+	EXPECT_NE( Machine.Private[0x20], nullptr );
+	EXPECT_EQ( Arena.NumAllocated(), 1u );
+	EXPECT_EQ( Machine.Read( 0x2000 ), 0x03 );
+	EXPECT_EQ( Image.Pages[0x20]->Bytes[0], 0 );
+}
+
+TEST_F( M6502CompactMemTests, ACopyOfABoundMemDoesntWriteToTheMachine )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	SharedImage Image( Source );
+	CompactMem Machine( Image, Arena );
+	Mem Bindable;
+	Machine.Bind( Bindable );
+	cpu.WriteByte( 0x11, 0x2000, Bindable );
+
+	// when:
+	Mem Copy = Bindable;
+	cpu.WriteByte( 0x22, 0x2000, Copy );
+	cpu.WriteByte( 0x33, 0x4000, Copy );
+
+	// then:
+	EXPECT_EQ( Machine.Read( 0x2000 ), 0x11 );
+	EXPECT_EQ( Machine.Read( 0x4000 ), 0x00 );
+	EXPECT_EQ( Machine.NumPrivatePages(), 1u );
+	EXPECT_EQ( Copy.Peek( 0x2000 ), 0x22 );
+	EXPECT_EQ( Copy.Peek( 0x1000 ), 0x18 );
+	EXPECT_TRUE( Copy.ReadsAreFlat() );
+}
+
+TEST_F( M6502CompactMemTests, RunsTheSameAsAFullMem )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	SharedImage Image( Source );
+	CompactMem Machine( Image, Arena );
+	Mem Bindable;
+	Machine.Bind( Bindable );
+	CPU Reference = cpu;
+	Mem ReferenceMem = Source;
+
+	// when:
+	const s32 CyclesUsed = cpu.Execute( 20000, Bindable );
+	const s32 ReferenceCycles = Reference.Execute( 20000, ReferenceMem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, ReferenceCycles );
+	EXPECT_EQ( cpu.PC, Reference.PC );
+	EXPECT_EQ( cpu.A, Reference.A );
+	EXPECT_EQ( cpu.X, Reference.X );
+	EXPECT_EQ( cpu.PS, Reference.PS );
+	u32 NumDifferent = 0;
+	for ( u32 Address = 0; Address < Mem::MAX_MEM; Address++ )
+	{
+		NumDifferent += Machine.Read( (Word)Address ) != ReferenceMem.Data[Address];
+	}
+	EXPECT_EQ( NumDifferent, 0u );
+	EXPECT_EQ( Machine.NumPrivatePages(), 2u );
+}
+
+TEST_F( M6502CompactMemTests, WritesToRomAreIgnored )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	Source[0xE000] = 0x42;
+	Source.MapRom( 0xE0, 0x20 );
+	SharedImage Image( Source );
+	CompactMem Machine( Image, Arena );
+	Mem Bindable;
+	Machine.Bind( Bindable );
+
+	// when:
+	cpu.WriteByte( 0x99, 0xE000, Bindable );
+	Machine.Write( 0xE001, 0x99 );
+
+	// then:
+	EXPECT_EQ( cpu.ReadByte( 0xE000, Bindable ), 0x42 );
+	EXPECT_EQ( Machine.Read( 0xE001 ), 0 );
+	EXPECT_EQ( Machine.NumPrivatePages(), 0u );
+}
+
+TEST_F( M6502CompactMemTests, OneMemCanRunManyMachinesInTurn )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	SharedImage Image( Source );
+	CompactMem First( Image, Arena );
+	CompactMem Second( Image, Arena );
+	Mem Bindable;
+	CPU FirstCpu = cpu;
+	CPU SecondCpu = cpu;
+	SecondCpu.A = 0x80;
+
+	// when:
+	First.Bind( Bindable );
+	FirstCpu.Execute( 100, Bindable );
+	Second.Bind( Bindable );
+	SecondCpu.Execute( 100, Bindable );
+	First.Write( 0x4000, 0x11 );	// while Second is bound
+	First.Bind( Bindable );
+	FirstCpu.Execute( 100, Bindable );
+
+	// then:
+	EXPECT_EQ( First.Read( 0x2000 ), 0x03 );
+	EXPECT_EQ( Second.Read( 0x2000 ), 0x83 );
+	EXPECT_EQ( First.Read( 0x4000 ), 0x11 );
+	EXPECT_EQ( Second.Read( 0x4000 ), 0 );
+	EXPECT_EQ( Bindable.Peek( 0x4000 ), 0x11 );
+}
+
+TEST_F( M6502CompactMemTests, ResettingAMachineGivesItsFramesBackForReuse )
+{
+	// given:
+	using namespace m6502;
+	SharedImage Image( Source );
+	CompactMem Machine( Image, Arena );
+	for ( u32 Page = 0; Page < 100; Page++ )
+	{
+		Machine.Write( (Word)(Page * Mem::PAGE_SIZE), 1 );
+	}
+	const u32 NumFrames = Arena.NumFrames();
+
+	// when:
+	Machine.Reset();
+	CompactMem Another( Image, Arena );
+	for ( u32 Page = 0; Page < 100; Page++ )
+	{
+		Another.Write( (Word)(Page * Mem::PAGE_SIZE), 1 );
+	}
+
+	// then:
+	EXPECT_EQ( Machine.NumPrivatePages(), 0u );
+	EXPECT_EQ( Machine.Read( 0 ), 0 );
+	EXPECT_EQ( Arena.NumAllocated(), 100u );
+	EXPECT_EQ( Arena.NumFrames(), NumFrames );
+}
+
+TEST_F( M6502CompactMemTests, TheBatchRunnerCanRunCompactMachines )
+{
+	// given:
+	using namespace m6502;
+	constexpr u32 NUM_MACHINES = 64;
+	LoadProgram();
+	SharedImage Image( Source );
+	std::vector<std::unique_ptr<CompactMem>> Machines;
+	std::vector<CPU> CPUs( NUM_MACHINES, cpu );
+	std::vector<BatchJob> Jobs;
+	for ( u32 i = 0; i < NUM_MACHINES; i++ )
+	{
+		Machines.emplace_back( new CompactMem( Image, Arena ) );
+		CPUs[i].A = (Byte)i;
+		BatchJob Job;
+		Job.Cpu = &CPUs[i];
+		Job.Compact = Machines.back().get();
+		Job.Cycles = 3000;
+		Jobs.push_back( Job );
+	}
+	CPU Reference = cpu;
+	Reference.A = NUM_MACHINES - 1;
+	Mem ReferenceMem = Source;
+	const s32 ReferenceCycles = Reference.Execute( 3000, ReferenceMem );
+	BatchRunner Runner;
+	Runner.NumThreads = 4;
+
+	// when:
+	const BatchResult Result = Runner.Run( Jobs );
+
+	// then:
+	EXPECT_EQ( Result.NumThrew, 0u );
+	EXPECT_EQ( Jobs.back().CyclesUsed, ReferenceCycles );
+	EXPECT_EQ( CPUs.back().A, Reference.A );
+	EXPECT_EQ( Machines.back()->Read( 0x2010 ), ReferenceMem.Data[0x2010] );
+	EXPECT_EQ( Machines[0]->Read( 0x2000 ), 0x03 );
+	EXPECT_EQ( Arena.NumAllocated(), NUM_MACHINES );	// only the page at $2000
+}
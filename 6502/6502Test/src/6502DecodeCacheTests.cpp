@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "m6502.h"
+
+class M6502DecodeCacheTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::DecodeCache Cache;
+
+	virtual void SetUp()
+	{
+		Cache.Attach( mem );
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502DecodeCacheTests, AnInstructionIsDecodedTheFirstTimeItRuns )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_LDA_ABSX;
+	mem[0xFF01] = 0x80;
+	mem[0xFF02] = 0x44;
+	EXPECT_EQ( Cache.Entries[0xFF00].Execute, nullptr );
+
+	// when:
+	const s32 ActualCycles = cpu.ExecuteCached( 4, mem );
+
+	// then:
+	EXPECT_EQ( ActualCycles, 4 );
+	EXPECT_EQ( cpu.PC, 0xFF03 );
+	EXPECT_NE( Cache.Entries[0xFF00].Execute, nullptr );
+	EXPECT_EQ( Cache.Entries[0xFF00].Operand, 0x4480 );
+	EXPECT_EQ( Cache.Entries[0xFF00].Length, 3 );
+	EXPECT_EQ( Cache.Entries[0xFF00].BaseCycles, 4 );
+}
+
+TEST_F( M6502DecodeCacheTests, AStoreOverAnOperandInvalidatesTheInstruction )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_LDX_IM;
+	mem[0xFF01] = 0x42;
+	mem[0xFF02] = CPU::INS_STA_ABS;
+	mem[0xFF03] = 0x01;
+	mem[0xFF04] = 0xFF;
+	cpu.A = 0x37;
+	cpu.ExecuteCached( 2 + 4, mem );
+
+	// when:
+	cpu.PC = 0xFF00;
+	cpu.ExecuteCached( 2, mem );
+
+	// then:
+	EXPECT_EQ( mem[0xFF01], 0x37 );
+	EXPECT_EQ( cpu.X, 0x37 );
+}
+
+TEST_F( M6502DecodeCacheTests, PushingOntoTheStackInvalidatesCodeInTheStackPage )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x01F0, mem );
+	cpu.SP = 0x80;
+	cpu.A = 0x55;
+	mem[0x01F0] = CPU::INS_PHA;
+	mem[0x01F1] = CPU::INS_NOP;
+	cpu.ExecuteCached( 3 + 2, mem );
+	EXPECT_NE( Cache.Entries[0x01F1].Execute, nullptr );
+
+	// when:
+	cpu.PC = 0x01F0;
+	cpu.SP = 0xF1;
+	cpu.ExecuteCached( 3, mem );
+
+	// then:
+	EXPECT_EQ( mem[0x01F1], 0x55 );
+	EXPECT_EQ( Cache.Entries[0x01F1].Execute, nullptr );
+}
+
+TEST_F( M6502DecodeCacheTests, WritesToPagesWithoutDecodedCodeLeaveTheCacheAlone )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x00;
+	mem[0xFF02] = 0x80;
+
+	// when:
+	cpu.ExecuteCached( 4, mem );
+
+	// then:
+	EXPECT_NE( Cache.Entries[0xFF00].Execute, nullptr );
+	EXPECT_FALSE( Cache.CodePages[0x80] );
+}
+
+TEST_F( M6502DecodeCacheTests, AnInstructionCrossingAPageIsInvalidatedByEitherPage )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x10FE, mem );
+	mem[0x10FE] = CPU::INS_LDA_ABS;
+	mem[0x10FF] = 0x00;
+	mem[0x1100] = 0x20;
+	cpu.ExecuteCached( 4, mem );
+	EXPECT_TRUE( Cache.CodePages[0x10] );
+	EXPECT_TRUE( Cache.CodePages[0x11] );
+
+	// when:
+	s32 Cycles = 0;
+	cpu.WriteByte( 0x30, Cycles, 0x1100, mem );
+
+	// then:
+	EXPECT_EQ( Cache.Entries[0x10FE].Execute, nullptr );
+}
+
+TEST_F( M6502DecodeCacheTests, InitialisingTheMemoryFlushesTheCache )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_NOP;
+	cpu.ExecuteCached( 2, mem );
+
+	// when:
+	mem.Initialise();
+
+	// then:
+	EXPECT_EQ( Cache.Entries[0xFF00].Execute, nullptr );
+	EXPECT_FALSE( Cache.CodePages[0xFF] );
+}
+
+TEST_F( M6502DecodeCacheTests, WithoutACacheAttachedTheInstructionsStillRun )
+{
+	// given:
+	using namespace m6502;
+	Cache.Detach();
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_LDA_IM;
+	mem[0xFF01] = 0x84;
+
+	// when:
+	const s32 ActualCycles = cpu.ExecuteCached( 2, mem );
+
+	// then:
+	EXPECT_EQ( mem.Decoded, nullptr );
+	EXPECT_EQ( ActualCycles, 2 );
+	EXPECT_EQ( cpu.A, 0x84 );
+	EXPECT_TRUE( cpu.Flag.N );
+}
+
+TEST_F( M6502DecodeCacheTests, DestroyingTheCacheDetachesItFromTheMemory )
+{
+	// given:
+	using namespace m6502;
+	DecodeCache* Temporary = new DecodeCache;
+	Temporary->Attach( mem );
+	EXPECT_EQ( mem.Decoded, Temporary );
+
+	// when:
+	delete Temporary;
+
+	// then:
+	EXPECT_EQ( mem.Decoded, nullptr );
+}
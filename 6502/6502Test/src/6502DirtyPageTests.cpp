@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "m6502.h"
+
+class M6502DirtyPageTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+		mem.TrackDirtyPages = true;
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502DirtyPageTests, NothingIsDirtyAfterClearing )
+{
+	// given:
+	using namespace m6502;
+	mem[0x1234] = 0x56;
+
+	// when:
+	mem.ClearDirtyPages();
+
+	// then:
+	EXPECT_EQ( mem.NumDirtyPages(), 0u );
+	EXPECT_TRUE( mem.GetDirtyPages().empty() );
+}
+
+TEST_F( M6502DirtyPageTests, TheCPUsWritesAndStackPushesMakeTheirPagesDirty )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1000, mem );
+	mem[0x1000] = CPU::INS_STA_ABS;
+	mem[0x1001] = 0x34;
+	mem[0x1002] = 0x92;
+	mem[0x1003] = CPU::INS_JSR;
+	mem[0x1004] = 0x00;
+	mem[0x1005] = 0x80;
+	mem[0x8000] = CPU::INS_RTS;
+	mem.ClearDirtyPages();
+
+	// when:
+	cpu.Execute( 4 + 6 + 6, mem );
+
+	// then:
+	const std::vector<Byte> Expected = { 0x01, 0x92 };
+	EXPECT_EQ( mem.GetDirtyPages(), Expected );
+	EXPECT_EQ( mem.NumDirtyPages(), 2u );
+	EXPECT_TRUE( mem.IsPageDirty( 0x92 ) );
+	EXPECT_FALSE( mem.IsPageDirty( 0x10 ) );
+}
+
+TEST_F( M6502DirtyPageTests, WritingThroughAMirrorMakesTheTargetPageDirty )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1000, mem );
+	mem.MapMirror( 0x08, 0x08, 0x00 );
+	mem[0x1000] = CPU::INS_STA_ABS;
+	mem[0x1001] = 0x00;
+	mem[0x1002] = 0x0A;
+	mem.ClearDirtyPages();
+
+	// when:
+	cpu.Execute( 4, mem );
+
+	// then:
+	const std::vector<Byte> Expected = { 0x02 };
+	EXPECT_EQ( mem.GetDirtyPages(), Expected );
+}
+
+TEST_F( M6502DirtyPageTests, WritingToADeviceOrRomLeavesThePageClean )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1000, mem );
+	mem.MapDevice( 0xD0, 1, nullptr, nullptr, nullptr );
+	mem.MapRom( 0xE0, 0x20 );
+	mem[0x1000] = CPU::INS_STA_ABS;
+	mem[0x1001] = 0x00;
+	mem[0x1002] = 0xD0;
+	mem[0x1003] = CPU::INS_STA_ABS;
+	mem[0x1004] = 0x00;
+	mem[0x1005] = 0xE0;
+	mem.ClearDirtyPages();
+
+	// when:
+	cpu.Execute( 4 + 4, mem );
+
+	// then:
+	EXPECT_EQ( mem.NumDirtyPages(), 0u );
+}
+
+TEST_F( M6502DirtyPageTests, ForEachDirtyPageVisitsThemInOrder )
+{
+	// given:
+	using namespace m6502;
+	mem.ClearDirtyPages();
+	mem[0xFF00] = 1;
+	mem[0x0000] = 1;
+	mem[0x2040] = 1;
+	mem[0x20FF] = 1;
+
+	// when:
+	std::vector<Byte> Visited;
+	mem.ForEachDirtyPage( [&Visited]( Byte Page ) { Visited.push_back( Page ); } );
+
+	// then:
+	const std::vector<Byte> Expected = { 0x00, 0x20, 0xFF };
+	EXPECT_EQ( Visited, Expected );
+}
+
+TEST_F( M6502DirtyPageTests, InitialiseMakesThePagesItClearsDirty )
+{
+	// given:
+	using namespace m6502;
+	mem.ClearWrittenPagesOnly = true;
+	mem[0x4000] = 1;
+	mem.ClearDirtyPages();
+
+	// when:
+	mem.Initialise();
+
+	// then:
+	const std::vector<Byte> Expected = { 0x40 };
+	EXPECT_EQ( mem.GetDirtyPages(), Expected );
+}
+
+TEST_F( M6502DirtyPageTests, NothingIsTrackedWhenItIsOff )
+{
+	// given:
+	using namespace m6502;
+	mem.ClearDirtyPages();
+	mem.TrackDirtyPages = false;
+
+	// when:
+	mem[0x4000] = 1;
+
+	// then:
+	EXPECT_EQ( mem.NumDirtyPages(), 0u );
+}
+
+TEST_F( M6502DirtyPageTests, RunningCodeThatDoesntStoreLeavesEveryPageClean )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		lda $2000,x
+		inx
+		bne loop
+		jmp loop
+	*/
+	DecodeCache Cache;
+	BlockCache Blocks;
+	Cache.Attach( mem );
+	Blocks.Attach( mem );
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = { 0xBD, 0x00, 0x20, 0xE8, 0xD0, 0xFA, 0x4C, 0x00, 0x10 };
+	for ( u32 i = 0; i < sizeof( Program ); i++ )
+	{
+		mem[0x1000 + i] = Program[i];
+	}
+	mem.ClearDirtyPages();
+
+	// when:
+	cpu.ExecuteCached( 1000, mem );
+	cpu.ExecuteBlocks( 1000, mem );
+	cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( mem.NumDirtyPages(), 0u );
+}
@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <vector>
+#include "m6502.h"
+
+/**	Every execution engine must behave exactly like the reference CPU::Execute,
+*	so these tests run the same instructions through both and compare the
+*	registers, the memory and the cycles used. */
+
+using ExecuteFunction = m6502::s32 (m6502::CPU::*)( m6502::s32, m6502::Mem& );
+
+class M6502ExecutionEngineTests : public testing::TestWithParam<ExecuteFunction>
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::DecodeCache Cache;
+	m6502::BlockCache Blocks;
+
+	m6502::Mem ReferenceMem;
+	m6502::CPU ReferenceCPU;
+
+	virtual void SetUp()
+	{
+		Cache.Attach( mem );
+		Blocks.Attach( mem );
+		Blocks.JitThreshold = 1;	// compile every block the first time it runs
+		cpu.Reset( mem );
+		ReferenceCPU.Reset( ReferenceMem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/** Fill the memory & registers with junk that is the same for a given seed */
+	void Randomise( m6502::u32 Seed )
+	{
+		using namespace m6502;
+		u32 State = Seed * 2654435761u + 1;
+		auto Next = [&State]() -> Byte
+		{
+			State = State * 1664525u + 1013904223u;
+			return (Byte)(State >> 24);
+		};
+
+		for ( u32 i = 0; i < Mem::MAX_MEM; i++ )
+		{
+			mem[i] = Next();
+		}
+		cpu.A = Next();
+		cpu.X = Next();
+		cpu.Y = Next();
+		cpu.SP = Next();
+		cpu.PS = Next();
+		cpu.PC = (Word)(Next() | (Next() << 8));
+	}
+
+	/** Run the same code through the reference engine and the engine under test */
+	void ExpectSameAsReference( m6502::s32 Cycles )
+	{
+		using namespace m6502;
+		ReferenceCPU = cpu;
+		memcpy( ReferenceMem.Data, mem.Data, Mem::MAX_MEM );
+		Cache.Flush();	// the tests poke the memory directly
+		Blocks.Flush();
+
+		bool ReferenceThrew = false;
+		s32 ReferenceCycles = 0;
+		bool Threw = false;
+		s32 ActualCycles = 0;
+
+		testing::internal::CaptureStdout();
+		try
+		{
+			ReferenceCycles = ReferenceCPU.Execute( Cycles, ReferenceMem );
+		}
+		catch ( ... )
+		{
+			ReferenceThrew = true;
+		}
+		try
+		{
+			ActualCycles = (cpu.*GetParam())( Cycles, mem );
+		}
+		catch ( ... )
+		{
+			Threw = true;
+		}
+		testing::internal::GetCapturedStdout();
+
+		ASSERT_EQ( Threw, ReferenceThrew );
+		if ( ReferenceThrew )
+		{
+			return;
+		}
+		EXPECT_EQ( ActualCycles, ReferenceCycles );
+		EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+		EXPECT_EQ( cpu.SP, ReferenceCPU.SP );
+		EXPECT_EQ( cpu.A, ReferenceCPU.A );
+		EXPECT_EQ( cpu.X, ReferenceCPU.X );
+		EXPECT_EQ( cpu.Y, ReferenceCPU.Y );
+		EXPECT_EQ( cpu.PS, ReferenceCPU.PS );
+		EXPECT_EQ( cpu.TotalCycles, ReferenceCPU.TotalCycles );
+		EXPECT_EQ( memcmp( mem.Data, ReferenceMem.Data, Mem::MAX_MEM ), 0 );
+	}
+};
+
+TEST_P( M6502ExecutionEngineTests, EveryOpcodeBehavesTheSameAsTheReferenceEngine )
+{
+	// given:
+	using namespace m6502;
+	constexpr u32 NUM_SEEDS = 8;
+
+	for ( u32 Opcode = 0; Opcode < 256; Opcode++ )
+	{
+		for ( u32 Seed = 0; Seed < NUM_SEEDS; Seed++ )
+		{
+			SCOPED_TRACE( testing::Message() << "Opcode " << Opcode << " Seed " << Seed );
+			Randomise( Opcode * NUM_SEEDS + Seed );
+			mem[cpu.PC] = (Byte)Opcode;
+			cpu.Flag.D = Seed & 1 ? false : cpu.Flag.D;
+
+			// when:
+			// then:
+			ExpectSameAsReference( 1 );
+		}
+	}
+}
+
+TEST_P( M6502ExecutionEngineTests, RandomCodeBehavesTheSameAsTheReferenceEngine )
+{
+	// given:
+	using namespace m6502;
+	constexpr u32 NUM_SEEDS = 512;
+
+	// only the opcodes the reference engine runs, so it doesn't stop straight away
+	std::vector<Byte> Opcodes;
+	for ( u32 Opcode = 0; Opcode < 256; Opcode++ )
+	{
+		ReferenceCPU.Reset( 0x1000, ReferenceMem );
+		ReferenceMem[0x1000] = (Byte)Opcode;
+		testing::internal::CaptureStdout();
+		try
+		{
+			ReferenceCPU.Execute( 1, ReferenceMem );
+			if ( Opcode != CPU::INS_SED )
+			{
+				Opcodes.push_back( (Byte)Opcode );
+			}
+		}
+		catch ( ... )
+		{
+		}
+		testing::internal::GetCapturedStdout();
+	}
+
+	for ( u32 Seed = 0; Seed < NUM_SEEDS; Seed++ )
+	{
+		SCOPED_TRACE( testing::Message() << "Seed " << Seed );
+		Randomise( Seed + 0x10000 );
+		for ( u32 i = 0; i < Mem::MAX_MEM; i++ )
+		{
+			mem[i] = Opcodes[mem[i] % Opcodes.size()];
+		}
+		cpu.Flag.D = false;
+
+		// when:
+		// then:
+		ExpectSameAsReference( 200 );
+	}
+}
+
+TEST_P( M6502ExecutionEngineTests, IndexedAddressingCrossingAPageBoundaryTakesTheSameCycles )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	cpu.X = 0xFF;
+	cpu.Y = 0xFF;
+	mem[0xFF00] = CPU::INS_LDA_ABSX;
+	mem[0xFF01] = 0x02;
+	mem[0xFF02] = 0x44;	// 0x4402 + 0xFF crosses into page 0x45
+	mem[0xFF03] = CPU::INS_LDA_INDY;
+	mem[0xFF04] = 0x02;
+	mem[0x0002] = 0x02;
+	mem[0x0003] = 0x44;
+	mem[0xFF05] = CPU::INS_STA_ABSY;
+	mem[0xFF06] = 0x00;
+	mem[0xFF07] = 0x80;
+
+	// when:
+	// then:
+	ExpectSameAsReference( 5 + 6 + 5 );
+}
+
+TEST_P( M6502ExecutionEngineTests, BranchingIntoANewPageTakesTheSameCycles )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFEFD, mem );
+	cpu.Flag.Z = true;
+	mem[0xFEFD] = CPU::INS_BEQ;
+	mem[0xFEFE] = 0x1;
+
+	// when:
+	// then:
+	ExpectSameAsReference( 4 );
+}
+
+TEST_P( M6502ExecutionEngineTests, CanRunALoopForManyCycles )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		ldx #$00
+	loop
+		txa
+		sta $2000,x
+		adc #$03
+		inx
+		bne loop
+		jsr sub
+		jmp $1000
+	sub
+		rts
+	*/
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = {
+		0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x20, 0x69, 0x03, 0xE8, 0xD0, 0xF7,
+		0x20, 0x11, 0x10, 0x4C, 0x00, 0x10, 0x60 };
+	memcpy( &mem[0x1000], Program, sizeof( Program ) );
+
+	// when:
+	// then:
+	ExpectSameAsReference( 100000 );
+}
+
+TEST_P( M6502ExecutionEngineTests, SelfModifyingCodeRunsTheSame )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		lda #$00
+		inc loop+1	; the lda loads one more each time round
+		jmp loop
+	*/
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = { 0xA9, 0x00, 0xEE, 0x01, 0x10, 0x4C, 0x00, 0x10 };
+	memcpy( &mem[0x1000], Program, sizeof( Program ) );
+
+	// when:
+	// then:
+	ExpectSameAsReference( 10000 );
+}
+
+TEST_P( M6502ExecutionEngineTests, CodeThatModifiesTheRestOfItsBlockRunsTheSame )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		lda #$00
+		sta load+1	; changes the ldx that is 3 bytes on
+	load
+		ldx #$00
+		inc loop+1
+		jmp loop
+	*/
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = {
+		0xA9, 0x00, 0x8D, 0x06, 0x10, 0xA2, 0x00, 0xEE, 0x01, 0x10, 0x4C, 0x00, 0x10 };
+	memcpy( &mem[0x1000], Program, sizeof( Program ) );
+
+	// when:
+	// then:
+	ExpectSameAsReference( 10001 );
+}
+
+TEST_P( M6502ExecutionEngineTests, FlagsThatArePushedOrBranchedOnAreTheSame )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		adc #$41
+		rol $20
+		php
+		cmp #$80
+		bcs skip
+		ror $21
+		php
+	skip
+		bit $20
+		bvc loop
+		pla
+		jmp loop
+	*/
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = {
+		0x69, 0x41, 0x26, 0x20, 0x08, 0xC9, 0x80, 0xB0, 0x03, 0x66, 0x21, 0x08,
+		0x24, 0x20, 0x50, 0xF0, 0x68, 0x4C, 0x00, 0x10 };
+	memcpy( &mem[0x1000], Program, sizeof( Program ) );
+
+	// when:
+	// then:
+	ExpectSameAsReference( 20000 );
+}
+
+INSTANTIATE_TEST_SUITE_P( Engines, M6502ExecutionEngineTests,
+	testing::Values(
+		&m6502::CPU::ExecuteTable,
+		&m6502::CPU::ExecuteThreaded,
+		&m6502::CPU::ExecuteCached,
+		&m6502::CPU::ExecuteBlocks,
+		&m6502::CPU::ExecuteJit,
+		&m6502::CPU::ExecuteDebug ) );
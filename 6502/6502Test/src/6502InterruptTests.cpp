@@ -0,0 +1,346 @@
+#include <gtest/gtest.h>
+#include "m6502_scheduler.h"
+#include "m6502_replay.h"
+
+class M6502InterruptTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::Scheduler Events;
+
+	virtual void SetUp()
+	{
+		using namespace m6502;
+		cpu.Reset( 0x1000, mem );
+		mem[0xFFFA] = 0x00;		// NMI handler at $3000
+		mem[0xFFFB] = 0x30;
+		mem[0xFFFE] = 0x00;		// IRQ handler at $2000
+		mem[0xFFFF] = 0x20;
+		Events.Attach( cpu, mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502InterruptTests, AnIRQPushesThePCAndStatusAndJumpsThroughItsVector )
+{
+	// given:
+	using namespace m6502;
+	cpu.Flag.C = true;
+	cpu.RaiseIRQ();
+
+	// when:
+	const s32 CyclesUsed = cpu.ServiceInterrupts( mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, 7 );
+	EXPECT_EQ( cpu.PC, 0x2000 );
+	EXPECT_TRUE( cpu.Flag.I );
+	EXPECT_EQ( cpu.SP, 0xFC );
+	EXPECT_EQ( mem[0x01FF], 0x10 );
+	EXPECT_EQ( mem[0x01FE], 0x00 );
+	EXPECT_EQ( mem[0x01FD], CPU::CarryFlagBit | CPU::UnusedFlagBit );	// B is clear
+	EXPECT_TRUE( cpu.IrqLine );		// until the device drops it
+}
+
+TEST_F( M6502InterruptTests, AnIRQIsntTakenWhileInterruptsAreDisabled )
+{
+	// given:
+	using namespace m6502;
+	cpu.Flag.I = true;
+	cpu.RaiseIRQ();
+
+	// when:
+	const s32 CyclesUsed = cpu.ServiceInterrupts( mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, 0 );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+}
+
+TEST_F( M6502InterruptTests, AnNMIIsTakenOnceEvenWhileInterruptsAreDisabled )
+{
+	// given:
+	using namespace m6502;
+	cpu.Flag.I = true;
+	cpu.RaiseNMI();
+
+	// when:
+	const s32 First = cpu.ServiceInterrupts( mem );
+	const s32 Second = cpu.ServiceInterrupts( mem );
+
+	// then:
+	EXPECT_EQ( First, 7 );
+	EXPECT_EQ( Second, 0 );
+	EXPECT_EQ( cpu.PC, 0x3000 );
+}
+
+TEST_F( M6502InterruptTests, RTIReturnsFromAnIRQToTheInterruptedInstruction )
+{
+	// given:
+	using namespace m6502;
+	mem[0x2000] = CPU::INS_RTI;
+	cpu.Flag.Z = true;
+	cpu.RaiseIRQ();
+	cpu.ServiceInterrupts( mem );
+	cpu.ClearIRQ();
+
+	// when:
+	cpu.Execute( 6, mem );
+
+	// then:
+	EXPECT_EQ( cpu.PC, 0x1000 );
+	EXPECT_FALSE( cpu.Flag.I );
+	EXPECT_TRUE( cpu.Flag.Z );
+	EXPECT_EQ( cpu.SP, 0xFF );
+}
+
+TEST_F( M6502InterruptTests, BRKStillGoesThroughTheIRQVector )
+{
+	// given:
+	using namespace m6502;
+	mem[0x1000] = CPU::INS_BRK;
+
+	// when:
+	cpu.ExecuteTable( 7, mem );
+
+	// then:
+	EXPECT_EQ( cpu.PC, 0x2000 );
+	EXPECT_EQ( mem[0x01FD] & CPU::BreakFlagBit, CPU::BreakFlagBit );
+	EXPECT_EQ( mem[0x01FE], 0x02 );
+}
+
+TEST_F( M6502InterruptTests, ATimerCanDriveTheFirmwareThroughIRQs )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		cli
+	loop
+		jmp loop
+
+	* = $2000
+		sta $D000	; acknowledge the timer
+		inc $10
+		rti
+	*/
+	mem[0x1000] = CPU::INS_CLI;
+	mem[0x1001] = CPU::INS_JMP_ABS;
+	mem[0x1002] = 0x01;
+	mem[0x1003] = 0x10;
+	mem[0x2000] = CPU::INS_STA_ABS;
+	mem[0x2001] = 0x00;
+	mem[0x2002] = 0xD0;
+	mem[0x2003] = CPU::INS_INC_ZP;
+	mem[0x2004] = 0x10;
+	mem[0x2005] = CPU::INS_RTI;
+	struct Timer
+	{
+		static void Tick( void* Context, Scheduler& scheduler )
+		{
+			scheduler.Cpu->RaiseIRQ();
+			(*static_cast<u32*>( Context ))++;
+			scheduler.Schedule( scheduler.Cpu->TotalCycles + 1000, Tick, Context );
+		}
+
+		static void Acknowledge( void* Context, Word, Byte )
+		{
+			static_cast<CPU*>( Context )->ClearIRQ();
+		}
+	};
+	mem.MapDevice( 0xD0, 1, nullptr, Timer::Acknowledge, &cpu );
+	u32 NumTicks = 0;
+	Events.Schedule( 1000, Timer::Tick, &NumTicks );
+
+	// when:
+	Events.Execute( 10500 );
+
+	// then:
+	EXPECT_EQ( NumTicks, 10u );
+	EXPECT_EQ( mem[0x10], 10 );
+	EXPECT_FALSE( cpu.IrqLine );
+	EXPECT_GE( cpu.TotalCycles, 10500u );
+	EXPECT_EQ( Events.NumPending(), 1u );
+}
+
+TEST_F( M6502InterruptTests, AnEventFiresAtTheEndOfTheInstructionThatReachesItsCycle )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		inx
+		jmp loop
+	*/
+	mem[0x1000] = CPU::INS_INX;
+	mem[0x1001] = CPU::INS_JMP_ABS;
+	mem[0x1002] = 0x00;
+	mem[0x1003] = 0x10;
+	mem[0x3000] = CPU::INS_JMP_ABS;	// stay in the NMI handler
+	mem[0x3001] = 0x00;
+	mem[0x3002] = 0x30;
+	Events.Schedule( 501, Scheduler::Action::RaiseNMI );
+
+	// when:
+	Events.Execute( 500 );
+	const Word PCBefore = cpu.PC;
+	const Byte XBefore = cpu.X;
+	Events.Execute( 10 );
+
+	// then:
+	EXPECT_NE( PCBefore, 0x3000 );
+	EXPECT_EQ( XBefore, 100 );		// 5 cycles a loop
+	EXPECT_EQ( cpu.PC, 0x3000 );
+	EXPECT_EQ( cpu.X, 101 );		// the inx at 500 finished first
+}
+
+TEST_F( M6502InterruptTests, AHeldIRQIsTakenAsSoonAsInterruptsAreEnabled )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		sei
+		nop
+		nop
+		cli
+		nop
+	*/
+	mem[0x1000] = CPU::INS_SEI;
+	mem[0x1001] = CPU::INS_NOP;
+	mem[0x1002] = CPU::INS_NOP;
+	mem[0x1003] = CPU::INS_CLI;
+	mem[0x1004] = CPU::INS_NOP;
+	mem[0x2000] = CPU::INS_JMP_ABS;
+	mem[0x2001] = 0x00;
+	mem[0x2002] = 0x20;
+	Events.Engine = &CPU::ExecuteTable;
+	Events.Schedule( 3, Scheduler::Action::RaiseIRQ );
+
+	// when:
+	Events.Execute( 30 );
+
+	// then:
+	EXPECT_EQ( cpu.PC, 0x2000 );
+	EXPECT_EQ( mem[0x01FE], 0x04 );		// returns to the nop after cli
+}
+
+TEST_F( M6502InterruptTests, TheInterruptsRaisedAreRecorded )
+{
+	// given:
+	using namespace m6502;
+	mem[0x1000] = CPU::INS_JMP_ABS;
+	mem[0x1001] = 0x00;
+	mem[0x1002] = 0x10;
+	Recorder Recording;
+	Recording.Attach( mem );
+	Events.Recording = &Recording;
+	Events.Schedule( 30, Scheduler::Action::RaiseNMI );
+	Events.Schedule( 60, Scheduler::Action::RaiseIRQ );
+	Events.Schedule( 61, Scheduler::Action::ClearIRQ );
+
+	// when:
+	Events.Execute( 100 );
+
+	// then:
+	u32 Offset = InputLog::HEADER_SIZE;
+	u64 PreviousCycle = 0;
+	InputLog::Event Recorded;
+	ASSERT_TRUE( Recording.Log.ReadEvent( Offset, PreviousCycle, Recorded ) );
+	EXPECT_EQ( Recorded.Type, InputLog::EVENT_NMI );
+	EXPECT_EQ( Recorded.Cycle, 30u );
+	ASSERT_TRUE( Recording.Log.ReadEvent( Offset, PreviousCycle, Recorded ) );
+	EXPECT_EQ( Recorded.Type, InputLog::EVENT_IRQ );
+	EXPECT_GE( Recorded.Cycle, 60u );
+	ASSERT_TRUE( Recording.Log.ReadEvent( Offset, PreviousCycle, Recorded ) );
+	EXPECT_EQ( Recorded.Type, InputLog::EVENT_CLEAR_IRQ );
+	EXPECT_GE( Recorded.Cycle, 61u );
+	EXPECT_FALSE( Recording.Log.ReadEvent( Offset, PreviousCycle, Recorded ) );
+}
+
+static void RaiseTheIRQ( void*, m6502::Scheduler& scheduler )
+{
+	scheduler.Cpu->RaiseIRQ();
+}
+
+TEST_F( M6502InterruptTests, AHeldIRQReplaysTheSameAsItWasRecorded )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		sei
+		ldx #$00
+	wait
+		inx
+		cpx #$14
+		bne wait
+		cli			; the held IRQ is taken until it is cleared
+	loop
+		inx
+		jmp loop
+
+	* = $2000
+		inc $10
+		rti
+	*/
+	Byte Program[] = { 0x78, 0xA2, 0x00, 0xE8, 0xE0, 0x14, 0xD0, 0xFB, 0x58, 0xE8, 0x4C, 0x09, 0x10 };
+	Byte Handler[] = { 0xE6, 0x10, 0x40 };
+	auto Load = [&]( Mem& Memory )
+	{
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			Memory[0x1000 + i] = Program[i];
+		}
+		for ( u32 i = 0; i < sizeof( Handler ); i++ )
+		{
+			Memory[0x2000 + i] = Handler[i];
+		}
+	};
+	Load( mem );
+	Events.Engine = &CPU::ExecuteTable;
+	Recorder Recording;
+	Recording.Attach( mem );
+	Events.Recording = &Recording;
+	Events.Schedule( 20, RaiseTheIRQ, nullptr );
+	Events.Schedule( 250, Scheduler::Action::ClearIRQ );
+	Events.Execute( 400 );
+
+	Mem ReplayMem;
+	CPU ReplayCPU;
+	ReplayCPU.Reset( 0x1000, ReplayMem );
+	ReplayMem[0xFFFE] = 0x00;
+	ReplayMem[0xFFFF] = 0x20;
+	Load( ReplayMem );
+	Scheduler ReplayEvents;
+	ReplayEvents.Attach( ReplayCPU, ReplayMem );
+	ReplayEvents.Engine = &CPU::ExecuteTable;
+	Replayer Player;
+	ASSERT_TRUE( Player.Attach( Recording.Log, ReplayMem ) );
+
+	// when:
+	InputLog::Event Recorded;
+	u32 NumClears = 0;
+	while ( Player.NextTimedEvent( Recorded ) )
+	{
+		ASSERT_NE( Recorded.Type, InputLog::EVENT_NMI );
+		NumClears += Recorded.Type == InputLog::EVENT_CLEAR_IRQ;
+		ReplayEvents.Schedule( Recorded.Cycle, Recorded.Type == InputLog::EVENT_IRQ ?
+			Scheduler::Action::RaiseIRQ : Scheduler::Action::ClearIRQ );
+	}
+	ReplayEvents.Execute( 400 );
+
+	// then:
+	EXPECT_EQ( NumClears, 1u );
+	EXPECT_GT( mem[0x10], 1 );		// taken more than once while it was held
+	EXPECT_EQ( ReplayMem[0x10], mem[0x10] );
+	EXPECT_EQ( ReplayCPU.X, cpu.X );
+	EXPECT_EQ( ReplayCPU.PC, cpu.PC );
+	EXPECT_EQ( ReplayCPU.TotalCycles, cpu.TotalCycles );
+	EXPECT_FALSE( ReplayCPU.IrqLine );
+}
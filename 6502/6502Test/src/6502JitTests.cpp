@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502.h"
+
+class M6502JitTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::BlockCache Cache;
+
+	virtual void SetUp()
+	{
+		if ( !m6502::BlockCache::JitSupported() )
+		{
+			GTEST_SKIP() << "The library was built without M6502_JIT";
+		}
+		Cache.Attach( mem );
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502JitTests, AHotBlockIsCompiledToNativeCode )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		ldx #$00
+	loop
+		txa
+		sta $2000,x
+		inx
+		bne loop
+	*/
+	Cache.JitThreshold = 4;
+	cpu.Reset( 0x1000, mem );
+	Byte Program[] = { 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x20, 0xE8, 0xD0, 0xF9 };
+	memcpy( &mem[0x1000], Program, sizeof( Program ) );
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteJit( 2 + 255 * (2 + 5 + 2 + 3) + (2 + 5 + 2 + 2), mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, 2 + 255 * (2 + 5 + 2 + 3) + (2 + 5 + 2 + 2) );
+	ASSERT_NE( Cache.Blocks[0x1002], nullptr );
+	EXPECT_NE( Cache.Blocks[0x1002]->Native, nullptr );
+	EXPECT_EQ( cpu.PC, 0x1009 );
+	EXPECT_EQ( cpu.X, 0 );
+	EXPECT_TRUE( cpu.Flag.Z );
+	for ( u32 i = 0; i < 256; i++ )
+	{
+		EXPECT_EQ( mem[0x2000 + i], i );
+	}
+}
+
+TEST_F( M6502JitTests, AColdBlockIsNotCompiled )
+{
+	// given:
+	using namespace m6502;
+	Cache.JitThreshold = 4;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_NOP;
+	mem[0xFF01] = CPU::INS_JMP_ABS;
+	mem[0xFF02] = 0x00;
+	mem[0xFF03] = 0xFF;
+
+	// when:
+	cpu.ExecuteJit( 3 * (2 + 3) + 1, mem );
+
+	// then:
+	ASSERT_NE( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_EQ( Cache.Blocks[0xFF00]->RunCount, 3u );
+	EXPECT_EQ( Cache.Blocks[0xFF00]->Native, nullptr );
+}
+
+TEST_F( M6502JitTests, AStoreIntoACompiledBlockLeavesIt )
+{
+	// given:
+	using namespace m6502;
+	Cache.JitThreshold = 1;
+	cpu.Reset( 0xFF00, mem );
+	cpu.A = 0x37;
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x04;
+	mem[0xFF02] = 0xFF;
+	mem[0xFF03] = CPU::INS_LDX_IM;
+	mem[0xFF04] = 0x42;
+	mem[0xFF05] = CPU::INS_JMP_ABS;
+	mem[0xFF06] = 0x00;
+	mem[0xFF07] = 0xFF;
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteJit( 4 + 2 + 3 + 1, mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, 4 + 2 + 3 + 4 );
+	EXPECT_EQ( cpu.X, 0x37 );
+	EXPECT_EQ( cpu.PC, 0xFF03 );
+	EXPECT_FALSE( Cache.Translated[0]->Valid );
+	EXPECT_NE( Cache.Translated[0]->Native, nullptr );
+}
+
+TEST_F( M6502JitTests, AnInstructionThatThrowsInNativeCodeStillThrows )
+{
+	// given:
+	using namespace m6502;
+	Cache.JitThreshold = 1;
+	cpu.Reset( 0xFF00, mem );
+	cpu.Flag.D = true;
+	mem[0xFF00] = CPU::INS_LDA_IM;
+	mem[0xFF01] = 0x01;
+	mem[0xFF02] = CPU::INS_ADC;
+	mem[0xFF03] = 0x01;
+	mem[0xFF04] = CPU::INS_JMP_ABS;
+	mem[0xFF05] = 0x00;
+	mem[0xFF06] = 0xFF;
+
+	// when:
+	// then:
+	EXPECT_ANY_THROW( cpu.ExecuteJit( 100, mem ) );
+	ASSERT_NE( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_NE( Cache.Blocks[0xFF00]->Native, nullptr );
+}
+
+TEST_F( M6502JitTests, FlushingTheBlocksForgetsTheNativeCode )
+{
+	// given:
+	using namespace m6502;
+	Cache.JitThreshold = 1;
+	cpu.Reset( 0xFF00, mem );
+	mem[0xFF00] = CPU::INS_INX;
+	mem[0xFF01] = CPU::INS_JMP_ABS;
+	mem[0xFF02] = 0x00;
+	mem[0xFF03] = 0xFF;
+	cpu.ExecuteJit( 100, mem );
+
+	// when:
+	Cache.Flush();
+	cpu.X = 0;
+	cpu.ExecuteJit( 100, mem );
+
+	// then:
+	ASSERT_NE( Cache.Blocks[0xFF00], nullptr );
+	EXPECT_NE( Cache.Blocks[0xFF00]->Native, nullptr );
+	EXPECT_EQ( cpu.X, 20 );
+}
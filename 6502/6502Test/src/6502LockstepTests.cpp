@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string.h>
+#include <vector>
+#include "m6502_lockstep.h"
+
+class M6502LockstepTests : public testing::Test
+{
+public:
+	std::vector<std::unique_ptr<m6502::Mem>> Memories;
+	std::vector<m6502::CPU> CPUs;
+
+	virtual void SetUp()
+	{
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/** Machines with Program at $1000, A is the index of the machine */
+	void MakeMachines( m6502::u32 NumMachines, const m6502::Byte* Program, m6502::u32 NumBytes )
+	{
+		using namespace m6502;
+		for ( u32 i = 0; i < NumMachines; i++ )
+		{
+			Memories.emplace_back( new Mem() );
+			CPUs.emplace_back();
+			Mem& memory = *Memories.back();
+			CPU& cpu = CPUs.back();
+			cpu.Reset( 0x1000, memory );
+			cpu.A = (Byte)i;
+			for ( u32 b = 0; b < NumBytes; b++ )
+			{
+				memory[0x1000 + b] = Program[b];
+			}
+		}
+	}
+
+	/** Run every machine with CPU::Execute on its own & all of them in lockstep */
+	void ExpectSameAsOnTheirOwn( m6502::Lockstep& Lanes, m6502::s32 Cycles )
+	{
+		using namespace m6502;
+		const u32 NumMachines = (u32)CPUs.size();
+		std::vector<Mem> ExpectedMem;
+		std::vector<CPU> ExpectedCPU;
+		std::vector<s32> ExpectedCycles;
+		std::vector<bool> ExpectedThrew;
+		Lanes.Resize( NumMachines );
+		testing::internal::CaptureStdout();
+		for ( u32 i = 0; i < NumMachines; i++ )
+		{
+			Lanes.SetLane( i, CPUs[i], *Memories[i] );
+			ExpectedMem.push_back( *Memories[i] );
+			ExpectedCPU.push_back( CPUs[i] );
+			ExpectedCycles.push_back( 0 );
+			ExpectedThrew.push_back( false );
+			try
+			{
+				ExpectedCycles.back() = ExpectedCPU.back().Execute( Cycles, ExpectedMem.back() );
+			}
+			catch ( ... )
+			{
+				ExpectedThrew.back() = true;
+			}
+		}
+
+		Lanes.Execute( Cycles );
+		testing::internal::GetCapturedStdout();
+
+		for ( u32 i = 0; i < NumMachines; i++ )
+		{
+			SCOPED_TRACE( testing::Message() << "Lane " << i );
+			ASSERT_EQ( Lanes.Threw[i] != 0, (bool)ExpectedThrew[i] );
+			if ( ExpectedThrew[i] )
+			{
+				continue;
+			}
+			CPU Actual;
+			Lanes.GetLane( i, Actual );
+			EXPECT_EQ( Lanes.CyclesUsed[i], ExpectedCycles[i] );
+			EXPECT_EQ( Actual.PC, ExpectedCPU[i].PC );
+			EXPECT_EQ( Actual.SP, ExpectedCPU[i].SP );
+			EXPECT_EQ( Actual.A, ExpectedCPU[i].A );
+			EXPECT_EQ( Actual.X, ExpectedCPU[i].X );
+			EXPECT_EQ( Actual.Y, ExpectedCPU[i].Y );
+			EXPECT_EQ( Actual.GetPS(), ExpectedCPU[i].GetPS() );
+			EXPECT_EQ( memcmp( Memories[i]->Data, ExpectedMem[i].Data, Mem::MAX_MEM ), 0 );
+		}
+	}
+};
+
+TEST_F( M6502LockstepTests, ALoopThatDoesntDivergeRunsInLockstep )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		clc
+		adc #$03
+		tax
+		inx
+		cpx #$80
+		lsr
+		jmp loop
+	*/
+	Byte Program[] = { 0x18, 0x69, 0x03, 0xAA, 0xE8, 0xE0, 0x80, 0x4A, 0x4C, 0x00, 0x10 };
+	MakeMachines( 16, Program, sizeof( Program ) );
+	Lockstep Lanes;
+
+	// when:
+	// then:
+	ExpectSameAsOnTheirOwn( Lanes, 5000 );
+	EXPECT_GT( Lanes.LockstepInstructions, 0u );
+	EXPECT_EQ( Lanes.ScalarInstructions, 0u );
+}
+
+TEST_F( M6502LockstepTests, LanesThatBranchDifferentWaysRunTheSame )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		sec
+		sbc #$01
+		cmp #$40
+		bcc low
+		sta $2000
+		ror
+		jmp loop
+	low
+		eor #$FF
+		sta $2001,x
+		inx
+		bne loop
+		jsr sub
+		jmp loop
+	sub
+		rts
+	*/
+	Byte Program[] = {
+		0x38, 0xE9, 0x01, 0xC9, 0x40, 0x90, 0x07, 0x8D, 0x00, 0x20, 0x6A, 0x4C, 0x00, 0x10,
+		0x49, 0xFF, 0x9D, 0x01, 0x20, 0xE8, 0xD0, 0xF0, 0x20, 0x1B, 0x10, 0x4C, 0x00, 0x10, 0x60 };
+	MakeMachines( 32, Program, sizeof( Program ) );
+	Lockstep Lanes;
+
+	// when:
+	// then:
+	ExpectSameAsOnTheirOwn( Lanes, 20000 );
+	EXPECT_GT( Lanes.LockstepInstructions, 0u );
+	EXPECT_GT( Lanes.ScalarInstructions, 0u );
+}
+
+TEST_F( M6502LockstepTests, RandomCodeRunsTheSame )
+{
+	// given:
+	using namespace m6502;
+	constexpr u32 NUM_LANES = 24;
+	// mostly the instructions that run in lockstep, with some that don't
+	const Byte Opcodes[] = {
+		CPU::INS_LDA_IM, CPU::INS_LDX_IM, CPU::INS_LDY_IM, CPU::INS_AND_IM, CPU::INS_ORA_IM,
+		CPU::INS_EOR_IM, CPU::INS_ADC, CPU::INS_SBC, CPU::INS_CMP, CPU::INS_CPX, CPU::INS_CPY,
+		CPU::INS_ASL, CPU::INS_LSR, CPU::INS_ROL, CPU::INS_ROR, CPU::INS_TAX, CPU::INS_TAY,
+		CPU::INS_TXA, CPU::INS_TYA, CPU::INS_INX, CPU::INS_INY, CPU::INS_DEX, CPU::INS_DEY,
+		CPU::INS_CLC, CPU::INS_SEC, CPU::INS_CLV, CPU::INS_NOP, CPU::INS_BEQ, CPU::INS_BNE,
+		CPU::INS_BCS, CPU::INS_BCC, CPU::INS_BMI, CPU::INS_BPL, CPU::INS_BVS, CPU::INS_BVC,
+		CPU::INS_STA_ZP, CPU::INS_INC_ZP, CPU::INS_PHA, CPU::INS_PLA };
+	u32 State = 12345;
+	std::vector<Byte> Program( 0x400 );
+	for ( Byte& Code : Program )
+	{
+		State = State * 1664525u + 1013904223u;
+		Code = Opcodes[(State >> 24) % sizeof( Opcodes )];
+	}
+	MakeMachines( NUM_LANES, Program.data(), (u32)Program.size() );
+	for ( u32 i = 0; i < NUM_LANES; i++ )
+	{
+		CPUs[i].X = (Byte)(i * 7);
+		CPUs[i].Flag.C = i & 1;
+	}
+	Lockstep Lanes;
+
+	// when:
+	// then:
+	ExpectSameAsOnTheirOwn( Lanes, 1000 );
+}
+
+TEST_F( M6502LockstepTests, ALaneThatThrowsStopsOnItsOwn )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		inx
+		jmp loop
+	*/
+	Byte Program[] = { 0xE8, 0x4C, 0x00, 0x10 };
+	MakeMachines( 8, Program, sizeof( Program ) );
+	(*Memories[5])[0x1000] = 0xFF;	// illegal
+	Lockstep Lanes;
+
+	// when:
+	// then:
+	ExpectSameAsOnTheirOwn( Lanes, 1000 );
+	EXPECT_EQ( Lanes.CyclesUsed[5], 0 );
+	EXPECT_GE( Lanes.CyclesUsed[4], 1000 );
+}
+
+TEST_F( M6502LockstepTests, LanesCanBeCopiedInAndOut )
+{
+	// given:
+	using namespace m6502;
+	Mem memory;
+	CPU cpu;
+	cpu.Reset( 0x1234, memory );
+	cpu.A = 1;
+	cpu.X = 2;
+	cpu.Y = 3;
+	cpu.SetPS( 0xC3 );
+	Lockstep Lanes( 2 );
+
+	// when:
+	Lanes.SetLane( 1, cpu, memory );
+	CPU Copy;
+	Lanes.GetLane( 1, Copy );
+
+	// then:
+	EXPECT_EQ( Copy.PC, 0x1234 );
+	EXPECT_EQ( Copy.A, 1 );
+	EXPECT_EQ( Copy.X, 2 );
+	EXPECT_EQ( Copy.Y, 3 );
+	EXPECT_EQ( Copy.GetPS(), cpu.GetPS() );
+	EXPECT_EQ( Lanes.Memory[1], &memory );
+}
@@ -0,0 +1,372 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <vector>
+#include "m6502.h"
+
+/** A device that counts its reads & remembers its writes */
+struct TestDevice
+{
+	m6502::Byte NextRead = 0x40;
+	std::vector<m6502::Word> ReadAddresses;
+	std::vector<std::pair<m6502::Word, m6502::Byte>> Writes;
+
+	static m6502::Byte Read( void* Context, m6502::Word Address )
+	{
+		TestDevice* Device = (TestDevice*)Context;
+		Device->ReadAddresses.push_back( Address );
+		return Device->NextRead++;
+	}
+
+	static void Write( void* Context, m6502::Word Address, m6502::Byte Value )
+	{
+		TestDevice* Device = (TestDevice*)Context;
+		Device->Writes.push_back( { Address, Value } );
+	}
+};
+
+/** A bank switch, a write selects which page $4000-$40FF mirrors */
+struct BankSwitch
+{
+	static void Write( void* Context, m6502::Word, m6502::Byte Value )
+	{
+		m6502::Mem* Memory = (m6502::Mem*)Context;
+		Memory->MapMirror( 0x40, 1, (Value & 1) ? 0x60 : 0x50 );
+	}
+};
+
+class M6502MemoryBusTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502MemoryBusTests, EveryPageStartsAsRam )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	// then:
+	EXPECT_TRUE( mem.ReadsAreFlat() );
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		EXPECT_EQ( mem.Pages[Page].Read, mem.Data + Page * Mem::PAGE_SIZE );
+		EXPECT_EQ( mem.Pages[Page].Write, mem.Data + Page * Mem::PAGE_SIZE );
+	}
+}
+
+TEST_F( M6502MemoryBusTests, WritingToRomIsIgnored )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1000, mem );
+	mem.MapRom( 0xE0, 0x20 );
+	mem[0xE123] = 0x37;
+	cpu.A = 0x99;
+	mem[0x1000] = CPU::INS_STA_ABS;
+	mem[0x1001] = 0x23;
+	mem[0x1002] = 0xE1;
+	mem[0x1003] = CPU::INS_LDX_ABS;
+	mem[0x1004] = 0x23;
+	mem[0x1005] = 0xE1;
+
+	// when:
+	cpu.Execute( 4 + 4, mem );
+
+	// then:
+	EXPECT_EQ( cpu.X, 0x37 );
+	EXPECT_EQ( mem[0xE123], 0x37 );
+	EXPECT_TRUE( mem.ReadsAreFlat() );
+}
+
+TEST_F( M6502MemoryBusTests, AMirrorReadsAndWritesTheTargetPages )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1000, mem );
+	mem.MapMirror( 0x08, 0x08, 0x00 );	// $0800-$0FFF mirrors $0000-$07FF
+	mem[0x0010] = 0x42;
+	cpu.A = 0x24;
+	mem[0x1000] = CPU::INS_LDX_ABS;
+	mem[0x1001] = 0x10;
+	mem[0x1002] = 0x08;
+	mem[0x1003] = CPU::INS_STA_ABS;
+	mem[0x1004] = 0x11;
+	mem[0x1005] = 0x08;
+
+	// when:
+	cpu.Execute( 4 + 4, mem );
+
+	// then:
+	EXPECT_EQ( cpu.X, 0x42 );
+	EXPECT_EQ( mem[0x0011], 0x24 );
+	EXPECT_FALSE( mem.ReadsAreFlat() );
+}
+
+TEST_F( M6502MemoryBusTests, ADeviceSeesTheReadsAndWritesOfItsPagesOnly )
+{
+	// given:
+	using namespace m6502;
+	TestDevice Device;
+	cpu.Reset( 0xFF00, mem );
+	mem.MapDevice( 0xD0, 1, TestDevice::Read, TestDevice::Write, &Device );
+	cpu.A = 0x55;
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x20;
+	mem[0xFF02] = 0xD0;
+	mem[0xFF03] = CPU::INS_LDX_ABS;
+	mem[0xFF04] = 0x12;
+	mem[0xFF05] = 0xD0;
+	mem[0xFF06] = CPU::INS_LDY_ABS;
+	mem[0xFF07] = 0x12;
+	mem[0xFF08] = 0xD1;
+
+	// when:
+	cpu.Execute( 4 + 4 + 4, mem );
+
+	// then:
+	EXPECT_EQ( cpu.X, 0x40 );
+	ASSERT_EQ( Device.ReadAddresses.size(), 1u );
+	EXPECT_EQ( Device.ReadAddresses[0], 0xD012 );
+	ASSERT_EQ( Device.Writes.size(), 1u );
+	EXPECT_EQ( Device.Writes[0].first, 0xD020 );
+	EXPECT_EQ( Device.Writes[0].second, 0x55 );
+	EXPECT_EQ( mem[0xD020], 0 );
+}
+
+TEST_F( M6502MemoryBusTests, ADeviceWithoutHandlersReadsZeroAndIgnoresWrites )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0xFF00, mem );
+	mem.MapDevice( 0xD0, 1, nullptr, nullptr, nullptr );
+	mem[0xD012] = 0x77;
+	cpu.A = 0x55;
+	cpu.X = 0x66;
+	mem[0xFF00] = CPU::INS_STA_ABS;
+	mem[0xFF01] = 0x12;
+	mem[0xFF02] = 0xD0;
+	mem[0xFF03] = CPU::INS_LDX_ABS;
+	mem[0xFF04] = 0x12;
+	mem[0xFF05] = 0xD0;
+
+	// when:
+	cpu.Execute( 4 + 4, mem );
+
+	// then:
+	EXPECT_EQ( cpu.X, 0 );
+	EXPECT_EQ( mem[0xD012], 0x77 );
+}
+
+TEST_F( M6502MemoryBusTests, MappingRamAgainUndoesTheOtherMappings )
+{
+	// given:
+	using namespace m6502;
+	mem.MapRom( 0xE0, 0x20 );
+	mem.MapDevice( 0xD0, 1, nullptr, nullptr, nullptr );
+	mem.MapMirror( 0x08, 0x08, 0x00 );
+
+	// when:
+	mem.MapRam( 0, Mem::NUM_PAGES );
+
+	// then:
+	EXPECT_TRUE( mem.ReadsAreFlat() );
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		EXPECT_EQ( mem.Pages[Page].Write, mem.Data + Page * Mem::PAGE_SIZE );
+	}
+}
+
+TEST_F( M6502MemoryBusTests, ACopyMapsItsOwnData )
+{
+	// given:
+	using namespace m6502;
+	mem.MapMirror( 0x08, 0x08, 0x00 );
+	mem[0x0010] = 0x42;
+
+	// when:
+	Mem Copy = mem;
+	Copy[0x0010] = 0x43;
+
+	// then:
+	EXPECT_EQ( Copy.Pages[0x08].Read, Copy.Data );
+	EXPECT_EQ( mem.Pages[0x08].Read, mem.Data );
+	EXPECT_EQ( Copy.Peek( 0x0810 ), 0x43 );
+	EXPECT_EQ( mem.Peek( 0x0810 ), 0x42 );
+	EXPECT_EQ( Copy.Decoded, nullptr );
+	EXPECT_EQ( Copy.Blocks, nullptr );
+}
+
+using ExecuteFunction = m6502::s32 (m6502::CPU::*)( m6502::s32, m6502::Mem& );
+
+class M6502MemoryBusEngineTests : public testing::TestWithParam<ExecuteFunction>
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::DecodeCache Cache;
+	m6502::BlockCache Blocks;
+
+	virtual void SetUp()
+	{
+		Cache.Attach( mem );
+		Blocks.Attach( mem );
+		Blocks.JitThreshold = 1;
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_P( M6502MemoryBusEngineTests, EveryEngineGoesThroughTheDevicesAndRom )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+		ldx #$00
+	loop
+		lda $d000	; the device counts up
+		sta $0200,x
+		sta $e000,x	; rom
+		sta $0900,x	; mirror of $0100
+		inx
+		bne loop
+		jmp $1000
+	*/
+	Byte Program[] = {
+		0xA2, 0x00, 0xAD, 0x00, 0xD0, 0x9D, 0x00, 0x02, 0x9D, 0x00, 0xE0,
+		0x9D, 0x00, 0x09, 0xE8, 0xD0, 0xF1, 0x4C, 0x00, 0x10 };
+
+	Mem ReferenceMem;
+	CPU ReferenceCPU;
+	TestDevice ReferenceDevice;
+	TestDevice Device;
+	cpu.Reset( 0x1000, mem );
+	ReferenceCPU = cpu;
+	ReferenceMem.Initialise();
+	for ( Mem* Memory : { &ReferenceMem, &mem } )
+	{
+		memcpy( &(*Memory)[0x1000], Program, sizeof( Program ) );
+		Memory->MapRom( 0xE0, 0x20 );
+		Memory->MapMirror( 0x08, 0x08, 0x00 );
+	}
+	ReferenceMem.MapDevice( 0xD0, 1, TestDevice::Read, TestDevice::Write, &ReferenceDevice );
+	mem.MapDevice( 0xD0, 1, TestDevice::Read, TestDevice::Write, &Device );
+
+	// when:
+	const s32 ReferenceCycles = ReferenceCPU.Execute( 20000, ReferenceMem );
+	const s32 ActualCycles = (cpu.*GetParam())( 20000, mem );
+
+	// then:
+	EXPECT_EQ( ActualCycles, ReferenceCycles );
+	EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+	EXPECT_EQ( cpu.A, ReferenceCPU.A );
+	EXPECT_EQ( cpu.X, ReferenceCPU.X );
+	EXPECT_EQ( cpu.GetPS(), ReferenceCPU.GetPS() );
+	EXPECT_EQ( Device.ReadAddresses, ReferenceDevice.ReadAddresses );
+	EXPECT_EQ( memcmp( mem.Data, ReferenceMem.Data, Mem::MAX_MEM ), 0 );
+	EXPECT_EQ( mem[0xE000], 0 );
+	EXPECT_EQ( mem[0x0100], mem[0x0200] );
+}
+
+TEST_P( M6502MemoryBusEngineTests, EveryEngineRunsCodeThroughAMirror )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $0010, run from its mirror at $0810
+	loop
+		inx
+		inx
+		jmp $0810
+	*/
+	Byte Program[] = { 0xE8, 0xE8, 0x4C, 0x10, 0x08 };
+
+	Mem ReferenceMem;
+	CPU ReferenceCPU;
+	cpu.Reset( 0x0810, mem );
+	ReferenceCPU = cpu;
+	ReferenceMem.Initialise();
+	for ( Mem* Memory : { &ReferenceMem, &mem } )
+	{
+		memcpy( &(*Memory)[0x0010], Program, sizeof( Program ) );
+		memset( &(*Memory)[0x0800], CPU::INS_NOP, Mem::PAGE_SIZE );	// hidden by the mirror
+		Memory->MapMirror( 0x08, 0x08, 0x00 );
+	}
+
+	// when:
+	const s32 ReferenceCycles = ReferenceCPU.Execute( 1000, ReferenceMem );
+	const s32 ActualCycles = (cpu.*GetParam())( 1000, mem );
+
+	// then:
+	EXPECT_EQ( ActualCycles, ReferenceCycles );
+	EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+	EXPECT_EQ( cpu.X, ReferenceCPU.X );
+}
+
+TEST_P( M6502MemoryBusEngineTests, ADeviceCanRemapPagesPartWayThroughABlock )
+{
+	// given:
+	using namespace m6502;
+	/*
+	* = $1000
+	loop
+		stx $d000	; switches the bank at $4000
+		lda $4000
+		sta $0200,x
+		inx
+		bne loop
+		jmp $1000
+	*/
+	Byte Program[] = {
+		0x8E, 0x00, 0xD0, 0xAD, 0x00, 0x40, 0x9D, 0x00, 0x02, 0xE8,
+		0xD0, 0xF4, 0x4C, 0x00, 0x10 };
+
+	Mem ReferenceMem;
+	CPU ReferenceCPU;
+	cpu.Reset( 0x1000, mem );
+	ReferenceCPU = cpu;
+	ReferenceMem.Initialise();
+	for ( Mem* Memory : { &ReferenceMem, &mem } )
+	{
+		memcpy( &(*Memory)[0x1000], Program, sizeof( Program ) );
+		(*Memory)[0x5000] = 0x11;
+		(*Memory)[0x6000] = 0x22;
+		Memory->MapDevice( 0xD0, 1, nullptr, BankSwitch::Write, Memory );
+	}
+
+	// when:
+	const s32 ReferenceCycles = ReferenceCPU.Execute( 20000, ReferenceMem );
+	const s32 ActualCycles = (cpu.*GetParam())( 20000, mem );
+
+	// then:
+	EXPECT_EQ( ActualCycles, ReferenceCycles );
+	EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+	EXPECT_EQ( cpu.A, ReferenceCPU.A );
+	EXPECT_EQ( cpu.X, ReferenceCPU.X );
+	EXPECT_EQ( memcmp( mem.Data, ReferenceMem.Data, Mem::MAX_MEM ), 0 );
+	EXPECT_EQ( mem[0x0200], 0x11 );
+	EXPECT_EQ( mem[0x0201], 0x22 );
+}
+
+INSTANTIATE_TEST_SUITE_P( Engines, M6502MemoryBusEngineTests,
+	testing::Values(
+		&m6502::CPU::ExecuteTable,
+		&m6502::CPU::ExecuteThreaded,
+		&m6502::CPU::ExecuteCached,
+		&m6502::CPU::ExecuteBlocks,
+		&m6502::CPU::ExecuteJit,
+		&m6502::CPU::ExecuteDebug ) );
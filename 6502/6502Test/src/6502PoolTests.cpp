@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <vector>
+#include "m6502_pool.h"
+#include "m6502_snapshot.h"
+#include "m6502_trace.h"
+
+class M6502PoolTests : public testing::Test
+{
+public:
+	m6502::MachinePool Pool;
+
+	virtual void SetUp()
+	{
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+static m6502::Byte ReadTheDevice( void*, m6502::Word )
+{
+	return 0x77;
+}
+
+TEST_F( M6502PoolTests, AReusedMachineIsLikeANewOne )
+{
+	// given:
+	using namespace m6502;
+	Machine* First = Pool.Acquire();
+	First->Cpu.A = 0x42;
+	First->Cpu.PC = 0x1234;
+	First->Cpu.WriteByte( 0x99, 0x2000, First->Memory );
+	First->Memory[0x3000] = 0x88;
+	First->Memory.MapDevice( 0xD0, 1, ReadTheDevice, nullptr, nullptr );
+	First->Memory.TrackDirtyPages = true;
+	Pool.Release( First );
+
+	// when:
+	Machine* Second = Pool.Acquire();
+
+	// then:
+	EXPECT_EQ( Second, First );
+	EXPECT_EQ( Second->Cpu.A, 0 );
+	EXPECT_EQ( Second->Cpu.PC, 0xFFFC );
+	EXPECT_EQ( Second->Memory.Data[0x2000], 0 );
+	EXPECT_EQ( Second->Memory.Data[0x3000], 0 );
+	EXPECT_EQ( Second->Cpu.ReadByte( 0xD000, Second->Memory ), 0 );
+	EXPECT_TRUE( Second->Memory.ReadsAreFlat() );
+	EXPECT_FALSE( Second->Memory.TrackDirtyPages );
+	EXPECT_FALSE( Second->Memory.ClearWrittenPagesOnly );
+}
+
+TEST_F( M6502PoolTests, AReusedMachineIsDetachedFromTheLastOwnersHooks )
+{
+	// given:
+	using namespace m6502;
+	Machine* First = Pool.Acquire();
+	DecodeCache OldCache;
+	BlockCache OldBlocks;
+	Breakpoints OldBreaks;
+	Tracer OldTrace;
+	OldCache.Attach( First->Memory );
+	OldBlocks.Attach( First->Memory );
+	OldBreaks.Attach( First->Memory );
+	OldTrace.Attach( First->Memory );
+	Pool.Release( First );
+
+	// when:
+	Machine* Second = Pool.Acquire();
+	DecodeCache NewCache;
+	NewCache.Attach( Second->Memory );
+	OldCache.Detach();
+	OldBlocks.Detach();
+
+	// then:
+	EXPECT_EQ( Second->Memory.Decoded, &NewCache );
+	EXPECT_EQ( Second->Memory.Blocks, nullptr );
+	EXPECT_EQ( Second->Memory.Breaks, nullptr );
+	EXPECT_EQ( Second->Memory.Trace, nullptr );
+	EXPECT_EQ( OldBreaks.Memory, nullptr );
+	EXPECT_EQ( OldTrace.Memory, nullptr );
+}
+
+TEST_F( M6502PoolTests, OnlyThePagesAReusedMachineWroteAreCleared )
+{
+	// given:
+	using namespace m6502;
+	Machine* Used = Pool.Acquire();
+	const u64 ClearedWhenNew = Pool.Stats().PagesCleared;
+	Used->Cpu.WriteByte( 1, 0x0200, Used->Memory );
+	Used->Cpu.WriteByte( 1, 0x8000, Used->Memory );
+	Pool.Release( Used );
+
+	// when:
+	Pool.Acquire();
+
+	// then:
+	EXPECT_EQ( ClearedWhenNew, Mem::NUM_PAGES );
+	EXPECT_EQ( Pool.Stats().PagesCleared, ClearedWhenNew + 2 );
+}
+
+TEST_F( M6502PoolTests, MachinesAreOnCacheLinesOfTheirOwn )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	Machine* A = Pool.Acquire();
+	Machine* B = Pool.Acquire();
+
+	// then:
+	EXPECT_EQ( (uintptr_t)A % 64, 0u );
+	EXPECT_EQ( (uintptr_t)B % 64, 0u );
+	EXPECT_NE( A, B );
+}
+
+TEST_F( M6502PoolTests, TheStatsFollowTheMachinesInUse )
+{
+	// given:
+	using namespace m6502;
+	std::vector<Machine*> Machines;
+	for ( u32 i = 0; i < 20; i++ )
+	{
+		Machines.push_back( Pool.Acquire() );
+	}
+
+	// when:
+	for ( u32 i = 0; i < 10; i++ )
+	{
+		Pool.Release( Machines[i] );
+	}
+	Pool.Acquire();
+
+	// then:
+	const PoolStats Stats = Pool.Stats();
+	EXPECT_EQ( Stats.NumSlots, 2 * MachinePool::MACHINES_PER_CHUNK );
+	EXPECT_EQ( Stats.NumInUse, 11u );
+	EXPECT_EQ( Stats.PeakInUse, 20u );
+	EXPECT_EQ( Stats.NumAcquired, 21u );
+	EXPECT_EQ( Stats.NumReused, 1u );
+	EXPECT_EQ( Stats.BytesReserved, sizeof( Machine ) * Stats.NumSlots );
+}
+
+TEST_F( M6502PoolTests, SnapshotsCanTakeTheirPagesFromAnArena )
+{
+	// given:
+	using namespace m6502;
+	PageArena Arena;
+	Machine* Used = Pool.Acquire();
+	Snapshotter Snapshots;
+	Snapshots.Arena = &Arena;
+	Snapshots.Attach( Used->Memory );
+
+	// when:
+	std::shared_ptr<const Snapshot> Taken = Snapshots.Take( Used->Cpu );
+	const u32 AllocatedWhileTaken = Arena.NumAllocated();
+	Used->Cpu.WriteByte( 1, 0x0200, Used->Memory );
+	std::shared_ptr<const Snapshot> Next = Snapshots.Take( Used->Cpu );
+	const u32 AllocatedForTheNext = Arena.NumAllocated() - AllocatedWhileTaken;
+	Snapshots.Detach();
+	Taken = nullptr;
+	Next = nullptr;
+
+	// then:
+	EXPECT_EQ( AllocatedWhileTaken, Mem::NUM_PAGES );
+	EXPECT_EQ( AllocatedForTheNext, 1u );
+	EXPECT_EQ( Arena.NumAllocated(), 0u );
+	EXPECT_EQ( Arena.Stats().PeakInUse, Mem::NUM_PAGES + 1 );
+}
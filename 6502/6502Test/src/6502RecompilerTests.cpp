@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502.h"
+#include "m6502_recomp.h"
+
+/** data/RecompiledLoop.prg, recompiled at build time by m6502_recompile()
+; RecompiledLoop
+
+* = $1000
+
+start
+	ldx #$00
+loop
+	txa
+	sta $2000,x
+	adc #$03
+	jsr clear
+	inx
+	bne loop
+	jsr $FF00		; outside of the image
+	jmp (vector)
+
+* = $101E
+vector
+	.word start
+clear
+	clc
+	rts
+
+*/
+m6502::s32 RecompiledLoop( m6502::s32 Cycles, m6502::CPU& cpu, m6502::Mem& memory );
+
+static m6502::Byte RecompiledLoopPrg[] = {
+	0x00, 0x10, 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x20, 0x69, 0x03, 0x20, 0x20,
+	0x10, 0xE8, 0xD0, 0xF4, 0x20, 0x00, 0xFF, 0x6C, 0x1E, 0x10, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x18, 0x60 };
+
+class M6502RecompilerTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502RecompilerTests, TracingFindsTheCodeReachableFromTheEntryPoint )
+{
+	// given:
+	using namespace m6502;
+	Recompiler Recomp( RecompiledLoopPrg, sizeof( RecompiledLoopPrg ) );
+	Recomp.AddEntryPoint( 0x1000 );
+
+	// when:
+	Recomp.Trace();
+
+	// then:
+	const Word Instructions[] = { 0x1000, 0x1002, 0x1003, 0x1006, 0x1008, 0x100B, 0x100C,
+		0x100E, 0x1011, 0x1020, 0x1021 };
+	u32 NumInstructions = 0;
+	for ( u32 Address = 0; Address < Mem::MAX_MEM; Address++ )
+	{
+		NumInstructions += Recomp.IsInstruction[Address] ? 1 : 0;
+	}
+	EXPECT_EQ( NumInstructions, sizeof( Instructions ) / sizeof( Instructions[0] ) );
+	for ( Word Address : Instructions )
+	{
+		EXPECT_TRUE( Recomp.IsInstruction[Address] ) << std::hex << Address;
+	}
+	EXPECT_TRUE( Recomp.IsLabel[0x1000] );
+	EXPECT_TRUE( Recomp.IsLabel[0x1002] );	// the branch target
+	EXPECT_TRUE( Recomp.IsLabel[0x100B] );	// the return from the JSR
+	EXPECT_TRUE( Recomp.IsLabel[0x1020] );	// the subroutine
+	EXPECT_FALSE( Recomp.IsLabel[0x1003] );
+}
+
+TEST_F( M6502RecompilerTests, AComputedJumpIsNotTraced )
+{
+	// given:
+	using namespace m6502;
+	Recompiler Recomp( RecompiledLoopPrg, sizeof( RecompiledLoopPrg ) );
+	Recomp.AddEntryPoint( 0x1000 );
+
+	// when:
+	Recomp.Trace();
+
+	// then:
+	EXPECT_FALSE( Recomp.IsInstruction[0x1014] );
+	EXPECT_FALSE( Recomp.IsInstruction[0x101E] );
+	EXPECT_FALSE( Recomp.IsLabel[0xFF00] );
+}
+
+TEST_F( M6502RecompilerTests, EntryPointsOutsideOfTheImageAreIgnored )
+{
+	// given:
+	using namespace m6502;
+	Recompiler Recomp( RecompiledLoopPrg, sizeof( RecompiledLoopPrg ) );
+
+	// when:
+	Recomp.AddEntryPoint( 0x0FFF );
+	Recomp.AddEntryPoint( 0x1022 );
+
+	// then:
+	EXPECT_TRUE( Recomp.EntryPoints.empty() );
+}
+
+TEST_F( M6502RecompilerTests, TheGeneratedCodeFallsBackToTheInterpreterForCodeOutsideOfTheImage )
+{
+	// given:
+	using namespace m6502;
+	Recompiler Recomp( RecompiledLoopPrg, sizeof( RecompiledLoopPrg ) );
+	Recomp.AddEntryPoint( 0x1000 );
+	Recomp.Trace();
+
+	// when:
+	const std::string Source = Recomp.Generate( "Loop" );
+
+	// then:
+	EXPECT_NE( Source.find( "m6502::s32 Loop( m6502::s32 Cycles, m6502::CPU& cpu, m6502::Mem& memory )" ), std::string::npos );
+	EXPECT_NE( Source.find( "case 0x1000: goto L_1000;" ), std::string::npos );
+	EXPECT_EQ( Source.find( "case 0xFF00:" ), std::string::npos );
+	EXPECT_NE( Source.find( "cpu.Execute( 1, memory )" ), std::string::npos );
+}
+
+TEST_F( M6502RecompilerTests, TheRecompiledProgramBehavesTheSameAsTheInterpreter )
+{
+	using namespace m6502;
+	const s32 Budgets[] = { 1, 2, 7, 13, 100, 1000, 7777, 12345, 50000 };
+	for ( s32 Budget : Budgets )
+	{
+		// given:
+		cpu.Reset( mem );
+		cpu.PC = cpu.LoadPrg( RecompiledLoopPrg, sizeof( RecompiledLoopPrg ), mem );
+		mem[0xFF00] = CPU::INS_RTS;
+		Mem RefMem = mem;
+		CPU RefCpu = cpu;
+
+		// when:
+		const s32 RefCycles = RefCpu.Execute( Budget, RefMem );
+		const s32 Cycles = RecompiledLoop( Budget, cpu, mem );
+
+		// then:
+		EXPECT_EQ( Cycles, RefCycles ) << "budget " << Budget;
+		EXPECT_EQ( cpu.PC, RefCpu.PC ) << "budget " << Budget;
+		EXPECT_EQ( cpu.SP, RefCpu.SP ) << "budget " << Budget;
+		EXPECT_EQ( cpu.A, RefCpu.A ) << "budget " << Budget;
+		EXPECT_EQ( cpu.X, RefCpu.X ) << "budget " << Budget;
+		EXPECT_EQ( cpu.Y, RefCpu.Y ) << "budget " << Budget;
+		EXPECT_EQ( cpu.PS, RefCpu.PS ) << "budget " << Budget;
+		EXPECT_EQ( cpu.TotalCycles, RefCpu.TotalCycles ) << "budget " << Budget;
+		EXPECT_EQ( memcmp( &mem[0], &RefMem[0], Mem::MAX_MEM ), 0 ) << "budget " << Budget;
+	}
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502_replay.h"
+
+/** A device that returns a different value each read */
+struct NoisyDevice
+{
+	m6502::u32 State = 12345;
+	m6502::u32 NumWrites = 0;
+
+	static m6502::Byte Read( void* Context, m6502::Word )
+	{
+		NoisyDevice* Device = (NoisyDevice*)Context;
+		Device->State = Device->State * 1664525u + 1013904223u;
+		return (m6502::Byte)(Device->State >> 24);
+	}
+
+	static void Write( void* Context, m6502::Word, m6502::Byte )
+	{
+		((NoisyDevice*)Context)->NumWrites++;
+	}
+};
+
+class M6502ReplayTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	NoisyDevice Device;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/**
+	* = $1000
+		ldx #$00
+	loop
+		lda $d000	; noise
+		sta $d001
+		eor $2000,x
+		sta $2000,x
+		inx
+		jmp loop
+	*/
+	void LoadProgram( m6502::Mem& memory, m6502::CPU& Cpu )
+	{
+		using namespace m6502;
+		Cpu.Reset( 0x1000, memory );
+		Byte Program[] = {
+			0xA2, 0x00, 0xAD, 0x00, 0xD0, 0x8D, 0x01, 0xD0, 0x5D, 0x00, 0x20,
+			0x9D, 0x00, 0x20, 0xE8, 0x4C, 0x02, 0x10 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			memory[0x1000 + i] = Program[i];
+		}
+	}
+};
+
+TEST_F( M6502ReplayTests, ReplayingTheReadsWithoutTheDeviceRunsTheSame )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram( mem, cpu );
+	mem.MapDevice( 0xD0, 1, NoisyDevice::Read, NoisyDevice::Write, &Device );
+	Recorder Rec;
+	Rec.Attach( mem );
+	const s32 Cycles = cpu.Execute( 10000, mem );
+	Rec.Detach();
+
+	Mem ReplayMem;
+	CPU ReplayCPU;
+	LoadProgram( ReplayMem, ReplayCPU );
+	Replayer Player;
+
+	// when:
+	ASSERT_TRUE( Player.Attach( Rec.Log, ReplayMem ) );
+	const s32 ReplayCycles = ReplayCPU.Execute( 10000, ReplayMem );
+
+	// then:
+	EXPECT_FALSE( Player.Diverged );
+	EXPECT_EQ( ReplayCycles, Cycles );
+	EXPECT_EQ( ReplayCPU.PC, cpu.PC );
+	EXPECT_EQ( ReplayCPU.A, cpu.A );
+	EXPECT_EQ( memcmp( ReplayMem.Data + 0x2000, mem.Data + 0x2000, 0x100 ), 0 );
+	EXPECT_GT( Device.NumWrites, 0u );
+}
+
+TEST_F( M6502ReplayTests, TheDeviceKeepsItsHandlersAfterRecording )
+{
+	// given:
+	using namespace m6502;
+	mem.MapDevice( 0xD0, 1, NoisyDevice::Read, NoisyDevice::Write, &Device );
+	Recorder Rec;
+
+	// when:
+	Rec.Attach( mem );
+	EXPECT_EQ( mem.Pages[0xD0].Context, &Rec );
+	Rec.Detach();
+
+	// then:
+	EXPECT_EQ( mem.Pages[0xD0].OnRead, &NoisyDevice::Read );
+	EXPECT_EQ( mem.Pages[0xD0].OnWrite, &NoisyDevice::Write );
+	EXPECT_EQ( mem.Pages[0xD0].Context, &Device );
+	EXPECT_NE( mem.Pages[0xD1].Context, &Rec );
+}
+
+TEST_F( M6502ReplayTests, InterruptsAndResetsComeBackAtTheirCycles )
+{
+	// given:
+	using namespace m6502;
+	Recorder Rec;
+	Rec.Attach( mem );
+	Rec.RecordInterrupt( InputLog::EVENT_IRQ, 100 );
+	Rec.Log.AppendDeviceRead( 0xD000, 0x12 );
+	Rec.RecordInterrupt( InputLog::EVENT_NMI, 100 );
+	Rec.RecordReset( 1ull << 40 );
+	Replayer Player;
+	ASSERT_TRUE( Player.Attach( Rec.Log, mem ) );
+
+	// when:
+	InputLog::Event Events[4];
+	u32 NumEvents = 0;
+	while ( NumEvents < 4 && Player.NextTimedEvent( Events[NumEvents] ) )
+	{
+		NumEvents++;
+	}
+
+	// then:
+	ASSERT_EQ( NumEvents, 3u );
+	EXPECT_EQ( Events[0].Type, InputLog::EVENT_IRQ );
+	EXPECT_EQ( Events[0].Cycle, 100u );
+	EXPECT_EQ( Events[1].Type, InputLog::EVENT_NMI );
+	EXPECT_EQ( Events[1].Cycle, 100u );
+	EXPECT_EQ( Events[2].Type, InputLog::EVENT_RESET );
+	EXPECT_EQ( Events[2].Cycle, 1ull << 40 );
+}
+
+TEST_F( M6502ReplayTests, EventsAreCompact )
+{
+	// given:
+	using namespace m6502;
+	InputLog Log;
+	Log.Begin( mem );
+
+	// when:
+	Log.AppendDeviceRead( 0xD000, 0x12 );
+	Log.AppendTimed( InputLog::EVENT_IRQ, 100 );
+	Log.AppendTimed( InputLog::EVENT_IRQ, 20000 );
+
+	// then:
+	EXPECT_EQ( Log.Stream.size(), InputLog::HEADER_SIZE + 4 + 2 + 4 );
+}
+
+TEST_F( M6502ReplayTests, ReadingSomethingElseThanTheRecordingDiverges )
+{
+	// given:
+	using namespace m6502;
+	mem.MapDevice( 0xD0, 1, NoisyDevice::Read, NoisyDevice::Write, &Device );
+	Recorder Rec;
+	Rec.Attach( mem );
+	Rec.Log.AppendDeviceRead( 0xD000, 0x12 );
+	Mem ReplayMem;
+	Replayer Player;
+	ASSERT_TRUE( Player.Attach( Rec.Log, ReplayMem ) );
+
+	// when:
+	const Byte First = cpu.ReadByte( 0xD000, ReplayMem );
+	const Byte Second = cpu.ReadByte( 0xD000, ReplayMem );
+
+	// then:
+	EXPECT_EQ( First, 0x12 );
+	EXPECT_EQ( Second, 0 );
+	EXPECT_TRUE( Player.Diverged );
+}
+
+TEST_F( M6502ReplayTests, ALogWithoutTheHeaderIsRejected )
+{
+	// given:
+	using namespace m6502;
+	InputLog Log;
+	Log.Stream = { 'M', '6', 'R', 'L', 99 };
+	Replayer Player;
+
+	// when:
+	// then:
+	EXPECT_FALSE( Player.Attach( Log, mem ) );
+}
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502.h"
+
+class M6502ResetTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	void ExpectAllZero()
+	{
+		using namespace m6502;
+		u32 NumNonZero = 0;
+		for ( u32 i = 0; i < Mem::MAX_MEM; i++ )
+		{
+			NumNonZero += mem.Data[i] != 0;
+		}
+		EXPECT_EQ( NumNonZero, 0u );
+	}
+};
+
+TEST_F( M6502ResetTests, ResetClearsTheMemoryAndRegisters )
+{
+	// given:
+	using namespace m6502;
+	mem[0x0000] = 0x11;
+	mem[0x8080] = 0x22;
+	mem[0xFFFF] = 0x33;
+	cpu.A = cpu.X = cpu.Y = 0x44;
+	cpu.Flag.C = true;
+
+	// when:
+	cpu.Reset( 0x1000, mem );
+
+	// then:
+	ExpectAllZero();
+	EXPECT_EQ( cpu.PC, 0x1000 );
+	EXPECT_EQ( cpu.SP, 0xFF );
+	EXPECT_EQ( cpu.A, 0 );
+	EXPECT_EQ( cpu.X, 0 );
+	EXPECT_EQ( cpu.Y, 0 );
+	EXPECT_EQ( cpu.GetPS(), 0 );
+}
+
+TEST_F( M6502ResetTests, ResetWithoutTheMemoryKeepsIt )
+{
+	// given:
+	using namespace m6502;
+	mem[0x8080] = 0x22;
+	cpu.A = 0x44;
+
+	// when:
+	cpu.Reset( 0x1000 );
+
+	// then:
+	EXPECT_EQ( mem[0x8080], 0x22 );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+	EXPECT_EQ( cpu.A, 0 );
+}
+
+TEST_F( M6502ResetTests, ClearingTheWrittenPagesOnlyClearsWhatTheCPUAndOperatorWrote )
+{
+	// given:
+	using namespace m6502;
+	mem.ClearWrittenPagesOnly = true;
+	cpu.Reset( 0x1000, mem );
+	mem[0x1000] = CPU::INS_STA_ABS;
+	mem[0x1001] = 0x34;
+	mem[0x1002] = 0x12;
+	mem[0x1003] = CPU::INS_JSR;
+	mem[0x1004] = 0x00;
+	mem[0x1005] = 0x80;
+	mem[0x8000] = CPU::INS_RTS;
+	cpu.A = 0x56;
+	cpu.Execute( 4 + 6 + 6, mem );
+	EXPECT_EQ( mem[0x1234], 0x56 );
+	EXPECT_EQ( mem[0x01FF], 0x10 );
+
+	// when:
+	cpu.Reset( 0x1000, mem );
+
+	// then:
+	ExpectAllZero();
+}
+
+TEST_F( M6502ResetTests, ClearingTheWrittenPagesOnlyLeavesDataThatWasWrittenBehindItsBack )
+{
+	// given:
+	using namespace m6502;
+	mem.ClearWrittenPagesOnly = true;
+	cpu.Reset( 0x1000, mem );
+	mem.Data[0x4000] = 0x12;
+	mem.Data[0x5000] = 0x34;
+	mem.MarkWritten( 0x5000 );
+
+	// when:
+	cpu.Reset( 0x1000, mem );
+
+	// then:
+	EXPECT_EQ( mem.Data[0x4000], 0x12 );
+	EXPECT_EQ( mem.Data[0x5000], 0 );
+}
+
+TEST_F( M6502ResetTests, ANewMemoryIsAllClearedTheFirstTime )
+{
+	// given:
+	using namespace m6502;
+	Mem* Junk = new Mem();
+	memset( Junk->Data, 0xAA, Mem::MAX_MEM );	// what a new Mem could hold
+	Junk->ClearWrittenPagesOnly = true;
+
+	// when:
+	Junk->Initialise();
+
+	// then:
+	u32 NumNonZero = 0;
+	for ( u32 i = 0; i < Mem::MAX_MEM; i++ )
+	{
+		NumNonZero += Junk->Data[i] != 0;
+	}
+	EXPECT_EQ( NumNonZero, 0u );
+	delete Junk;
+}
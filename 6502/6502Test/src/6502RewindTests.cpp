@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502_rewind.h"
+
+class M6502RewindTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::Rewinder Rewind;
+
+	virtual void SetUp()
+	{
+		LoadProgram( mem, cpu );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/**
+	* = $1000
+		ldy #$00
+	loop
+		ldx #$00
+	inner
+		txa
+		sta $2000,x	; a different page each time round
+	page = * - 1
+		inx
+		bne inner
+		inc page
+		iny
+		jmp loop
+	*/
+	void LoadProgram( m6502::Mem& memory, m6502::CPU& Cpu )
+	{
+		using namespace m6502;
+		Cpu.Reset( 0x1000, memory );
+		Byte Program[] = {
+			0xA0, 0x00, 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x20, 0xE8, 0xD0, 0xF9,
+			0xEE, 0x07, 0x10, 0xC8, 0x4C, 0x02, 0x10 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			memory[0x1000 + i] = Program[i];
+		}
+	}
+};
+
+TEST_F( M6502RewindTests, SteppingBackGetsToTheSameStateAsRunningThatFar )
+{
+	// given:
+	using namespace m6502;
+	Rewind.Interval = 5000;
+	Rewind.Attach( cpu, mem );
+	Rewind.Execute( 100000 );
+
+	Mem ExpectedMem;
+	CPU ExpectedCPU;
+	LoadProgram( ExpectedMem, ExpectedCPU );
+	const s32 ExpectedCycles = ExpectedCPU.Execute( (s32)Rewind.Cycle - 42000, ExpectedMem );
+
+	// when:
+	ASSERT_TRUE( Rewind.StepBack( 42000 ) );
+
+	// then:
+	EXPECT_EQ( Rewind.Cycle, (u64)ExpectedCycles );
+	EXPECT_EQ( cpu.PC, ExpectedCPU.PC );
+	EXPECT_EQ( cpu.A, ExpectedCPU.A );
+	EXPECT_EQ( cpu.X, ExpectedCPU.X );
+	EXPECT_EQ( cpu.Y, ExpectedCPU.Y );
+	EXPECT_EQ( cpu.GetPS(), ExpectedCPU.GetPS() );
+	EXPECT_EQ( memcmp( mem.Data, ExpectedMem.Data, Mem::MAX_MEM ), 0 );
+}
+
+TEST_F( M6502RewindTests, RunningOnAfterSteppingBackIsTheSame )
+{
+	// given:
+	using namespace m6502;
+	Rewind.Interval = 3000;
+	Rewind.Attach( cpu, mem );
+	Rewind.Execute( 50000 );
+	const CPU Before = cpu;
+	const u64 CycleBefore = Rewind.Cycle;
+
+	// when:
+	ASSERT_TRUE( Rewind.StepBack( 20000 ) );
+	Rewind.Execute( (s32)(CycleBefore - Rewind.Cycle) );
+
+	// then:
+	EXPECT_EQ( Rewind.Cycle, CycleBefore );
+	EXPECT_EQ( cpu.PC, Before.PC );
+	EXPECT_EQ( cpu.Y, Before.Y );
+}
+
+TEST_F( M6502RewindTests, TheSnapshotsOnlyCostThePagesThatChanged )
+{
+	// given:
+	using namespace m6502;
+	Rewind.Interval = 1000;	// less than the 256 * 11 cycles to write a page
+
+	// when:
+	Rewind.Attach( cpu, mem );
+	Rewind.Execute( 10000 );
+
+	// then:
+	ASSERT_GE( Rewind.Points.size(), 10u );
+	for ( size_t i = 1; i < Rewind.Points.size(); i++ )
+	{
+		EXPECT_LE( Rewind.Points[i].Bytes, sizeof( Snapshot ) + 3 * sizeof( Snapshot::PageData ) );
+	}
+}
+
+TEST_F( M6502RewindTests, TheOldestSnapshotsAreDroppedToStayInTheBudget )
+{
+	// given:
+	using namespace m6502;
+	Rewind.Interval = 1000;
+	Rewind.MemoryBudget = 2 * sizeof( Snapshot ) + 300 * sizeof( Snapshot::PageData );
+
+	// when:
+	Rewind.Attach( cpu, mem );
+	Rewind.Execute( 100000 );
+
+	// then:
+	EXPECT_LE( Rewind.BytesUsed, Rewind.MemoryBudget );
+	EXPECT_GT( Rewind.Points.front().Cycle, 0u );
+	EXPECT_FALSE( Rewind.StepBack( Rewind.Cycle - Rewind.Points.front().Cycle + 1 ) );
+	EXPECT_TRUE( Rewind.StepBack( Rewind.Cycle - Rewind.Points.front().Cycle ) );
+}
+
+TEST_F( M6502RewindTests, CantStepBackBeforeTheStart )
+{
+	// given:
+	using namespace m6502;
+	Rewind.Attach( cpu, mem );
+	Rewind.Execute( 100 );
+
+	// when:
+	// then:
+	EXPECT_FALSE( Rewind.StepBack( Rewind.Cycle + 1 ) );
+	EXPECT_TRUE( Rewind.StepBack( Rewind.Cycle ) );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include "m6502.h"
+
+class M6502RunUntilTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		using namespace m6502;
+		cpu.Reset( 0x1000, mem );
+		/*
+		* = $1000
+		loop
+			inx
+			jsr sub
+			jmp loop
+		sub
+			iny
+			rts
+		*/
+		Byte Program[] = { 0xE8, 0x20, 0x07, 0x10, 0x4C, 0x00, 0x10, 0xC8, 0x60 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			mem[0x1000 + i] = Program[i];
+		}
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502RunUntilTests, TheEnginesAddTheCyclesTheyUseToTheTotal )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	const s32 First = cpu.Execute( 100, mem );
+	const s32 Second = cpu.ExecuteTable( 100, mem );
+	cpu.RaiseNMI();
+	const s32 Interrupt = cpu.ServiceInterrupts( mem );
+
+	// then:
+	EXPECT_EQ( cpu.TotalCycles, (u64)(First + Second + Interrupt) );
+}
+
+TEST_F( M6502RunUntilTests, ResettingTheCPUDoesntResetTheTotal )
+{
+	// given:
+	using namespace m6502;
+	cpu.Execute( 100, mem );
+	const u64 Total = cpu.TotalCycles;
+
+	// when:
+	cpu.Reset( 0x1000 );
+
+	// then:
+	EXPECT_EQ( cpu.TotalCycles, Total );
+}
+
+TEST_F( M6502RunUntilTests, CanRunUntilACyclePastTheRangeOfABudget )
+{
+	// given:
+	using namespace m6502;
+	cpu.TotalCycles = 0xFFFFFF00ull;
+	CPU Reference = cpu;
+	Mem ReferenceMem = mem;
+	Reference.Execute( 0x200, ReferenceMem );
+
+	// when:
+	const u64 CyclesUsed = cpu.RunUntilCycle( 0x100000000ull + 0x100, mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, Reference.TotalCycles - 0xFFFFFF00ull );
+	EXPECT_EQ( cpu.TotalCycles, Reference.TotalCycles );
+	EXPECT_EQ( cpu.PC, Reference.PC );
+	EXPECT_EQ( cpu.X, Reference.X );
+	EXPECT_EQ( cpu.Y, Reference.Y );
+}
+
+TEST_F( M6502RunUntilTests, RunningUntilACycleThatHasPassedDoesNothing )
+{
+	// given:
+	using namespace m6502;
+	cpu.TotalCycles = 1000;
+
+	// when:
+	const u64 CyclesUsed = cpu.RunUntilCycle( 500, mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, 0u );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+}
+
+TEST_F( M6502RunUntilTests, CanRunUntilThePCReachesAnAddress )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	const s32 ToSub = cpu.RunUntilPC( 0x1007, 1000, mem );
+	const s32 ToTheLoopAgain = cpu.RunUntilPC( 0x1000, 1000, mem );
+
+	// then:
+	EXPECT_EQ( ToSub, 2 + 6 );
+	EXPECT_EQ( ToTheLoopAgain, 2 + 6 + 3 );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+	EXPECT_EQ( cpu.X, 1 );
+	EXPECT_EQ( cpu.Y, 1 );
+	EXPECT_EQ( cpu.TotalCycles, (u64)(ToSub + ToTheLoopAgain) );
+}
+
+TEST_F( M6502RunUntilTests, RunningUntilAnAddressThatIsntReachedStopsAtTheLimit )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	const s32 CyclesUsed = cpu.RunUntilPC( 0x2000, 1000, mem );
+
+	// then:
+	EXPECT_GE( CyclesUsed, 1000 );
+	EXPECT_LT( CyclesUsed, 1000 + 7 );
+	EXPECT_NE( cpu.PC, 0x2000 );
+}
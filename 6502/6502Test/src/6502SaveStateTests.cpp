@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502_savestate.h"
+
+class M6502SaveStateTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502SaveStateTests, LoadingASaveStatePutsTheCPUAndMemoryBack )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1234, mem );
+	cpu.A = 0x11;
+	cpu.X = 0x22;
+	cpu.Y = 0x33;
+	cpu.SP = 0x44;
+	cpu.Flag.C = cpu.Flag.V = cpu.Flag.N = true;
+	mem[0x0000] = 0x01;
+	mem[0x8123] = 0x02;
+	mem[0xFFFF] = 0x03;
+	const std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+
+	Mem LoadedMem;
+	CPU LoadedCPU;
+	LoadedCPU.Reset( LoadedMem );
+	LoadedMem[0x4000] = 0x99;
+	SaveState State;
+
+	// when:
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size() ) );
+	State.Load( LoadedCPU, LoadedMem );
+
+	// then:
+	EXPECT_EQ( LoadedCPU.PC, 0x1234 );
+	EXPECT_EQ( LoadedCPU.A, 0x11 );
+	EXPECT_EQ( LoadedCPU.X, 0x22 );
+	EXPECT_EQ( LoadedCPU.Y, 0x33 );
+	EXPECT_EQ( LoadedCPU.SP, 0x44 );
+	EXPECT_EQ( LoadedCPU.GetPS(), cpu.GetPS() );
+	EXPECT_EQ( memcmp( LoadedMem.Data, mem.Data, Mem::MAX_MEM ), 0 );
+}
+
+TEST_F( M6502SaveStateTests, TheCycleCountAndInterruptInputsAreSaved )
+{
+	// given:
+	using namespace m6502;
+	cpu.TotalCycles = 0x123456789ull;
+	cpu.RaiseIRQ();
+	cpu.RaiseNMI();
+	const std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	CPU LoadedCPU;
+	SaveState State;
+
+	// when:
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size() ) );
+	State.Load( LoadedCPU, mem );
+
+	// then:
+	EXPECT_EQ( LoadedCPU.TotalCycles, 0x123456789ull );
+	EXPECT_TRUE( LoadedCPU.IrqLine );
+	EXPECT_TRUE( LoadedCPU.NmiPending );
+}
+
+TEST_F( M6502SaveStateTests, AVersion1SaveStateLeavesTheCycleCountAlone )
+{
+	// given:
+	using namespace m6502;
+	cpu.A = 0x42;
+	std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	SaveState::Header* Head = (SaveState::Header*)Saved.data();
+	Head->Version = 1;
+	Head->Interrupts = 0;
+	Head->TotalCyclesLow = Head->TotalCyclesHigh = 0;
+	CPU LoadedCPU;
+	LoadedCPU.TotalCycles = 1000;
+	SaveState State;
+
+	// when:
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size(), false ) );
+	State.Load( LoadedCPU, mem );
+
+	// then:
+	EXPECT_EQ( LoadedCPU.A, 0x42 );
+	EXPECT_EQ( LoadedCPU.TotalCycles, 1000u );
+}
+
+TEST_F( M6502SaveStateTests, OnlyThePagesThatArentZeroAreStored )
+{
+	// given:
+	using namespace m6502;
+	mem[0x0010] = 0x01;
+	mem[0x80FF] = 0x02;
+
+	// when:
+	const std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	SaveState State;
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size() ) );
+
+	// then:
+	EXPECT_EQ( State.Head->NumPages, 2u );
+	EXPECT_LT( Saved.size(), sizeof( SaveState::Header ) + 64 + 2 * Mem::PAGE_SIZE );
+	ASSERT_NE( State.Page( 0x80 ), nullptr );
+	EXPECT_EQ( State.Page( 0x80 )[0xFF], 0x02 );
+	EXPECT_EQ( State.Page( 0x81 ), nullptr );
+	EXPECT_EQ( (uintptr_t)State.Page( 0x00 ) % SaveState::ALIGNMENT, (uintptr_t)Saved.data() % SaveState::ALIGNMENT );
+}
+
+TEST_F( M6502SaveStateTests, TheDeviceStateIsKeptAsItIs )
+{
+	// given:
+	using namespace m6502;
+	const Byte Device[] = { 1, 2, 3, 4, 5 };
+
+	// when:
+	const std::vector<Byte> Saved = SaveState::Write( cpu, mem, Device, sizeof( Device ) );
+	SaveState State;
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size() ) );
+
+	// then:
+	ASSERT_EQ( State.Head->DeviceStateSize, sizeof( Device ) );
+	EXPECT_EQ( memcmp( State.DeviceState(), Device, sizeof( Device ) ), 0 );
+}
+
+TEST_F( M6502SaveStateTests, OpeningIsInPlace )
+{
+	// given:
+	using namespace m6502;
+	mem[0x2000] = 0x42;
+	const std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	SaveState State;
+
+	// when:
+	ASSERT_TRUE( State.Open( Saved.data(), (u32)Saved.size() ) );
+
+	// then:
+	EXPECT_EQ( (const Byte*)State.Head, Saved.data() );
+	EXPECT_GE( State.Page( 0x20 ), Saved.data() );
+	EXPECT_LT( State.Page( 0x20 ), Saved.data() + Saved.size() );
+}
+
+TEST_F( M6502SaveStateTests, ACorruptSaveStateIsRejected )
+{
+	// given:
+	using namespace m6502;
+	mem[0x2000] = 0x42;
+	std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	Saved.back() ^= 0x01;
+	SaveState State;
+
+	// when:
+	// then:
+	EXPECT_FALSE( State.Open( Saved.data(), (u32)Saved.size() ) );
+	EXPECT_TRUE( State.Open( Saved.data(), (u32)Saved.size(), false ) );
+}
+
+TEST_F( M6502SaveStateTests, ATruncatedOrNewerSaveStateIsRejected )
+{
+	// given:
+	using namespace m6502;
+	mem[0x2000] = 0x42;
+	std::vector<Byte> Saved = SaveState::Write( cpu, mem );
+	SaveState State;
+
+	// when:
+	// then:
+	EXPECT_FALSE( State.Open( Saved.data(), (u32)Saved.size() - 1 ) );
+	EXPECT_FALSE( State.Open( Saved.data(), 16 ) );
+	Saved[4] = SaveState::VERSION + 1;
+	EXPECT_FALSE( State.Open( Saved.data(), (u32)Saved.size(), false ) );
+}
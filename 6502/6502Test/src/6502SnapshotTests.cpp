@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "m6502_snapshot.h"
+
+class M6502SnapshotTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::Snapshotter Snapshots;
+
+	virtual void SetUp()
+	{
+		cpu.Reset( mem );
+		Snapshots.Attach( mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+
+	/**
+	* = $1000
+	loop
+		inc $2000
+		inx
+		stx $3000,x
+		jmp loop
+	*/
+	void LoadProgram()
+	{
+		using namespace m6502;
+		cpu.Reset( 0x1000, mem );
+		Byte Program[] = { 0xEE, 0x00, 0x20, 0xE8, 0x9D, 0x00, 0x30, 0x4C, 0x00, 0x10 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			mem[0x1000 + i] = Program[i];
+		}
+	}
+};
+
+TEST_F( M6502SnapshotTests, RestoringPutsTheCPUAndMemoryBack )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	cpu.Execute( 1000, mem );
+	std::shared_ptr<const Snapshot> Saved = Snapshots.Take( cpu );
+	Mem SavedMem = mem;
+	CPU SavedCPU = cpu;
+	cpu.Execute( 5000, mem );
+
+	// when:
+	Snapshots.Restore( Saved, cpu );
+
+	// then:
+	EXPECT_EQ( cpu.PC, SavedCPU.PC );
+	EXPECT_EQ( cpu.X, SavedCPU.X );
+	EXPECT_EQ( cpu.GetPS(), SavedCPU.GetPS() );
+	EXPECT_EQ( memcmp( mem.Data, SavedMem.Data, Mem::MAX_MEM ), 0 );
+}
+
+TEST_F( M6502SnapshotTests, PagesThatWerentWrittenAreShared )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	std::shared_ptr<const Snapshot> First = Snapshots.Take( cpu );
+
+	// when:
+	cpu.Execute( 6 + 2 + 5 + 3, mem );
+	std::shared_ptr<const Snapshot> Second = Snapshots.Take( cpu );
+
+	// then:
+	u32 NumShared = 0;
+	for ( u32 Page = 0; Page < Mem::NUM_PAGES; Page++ )
+	{
+		NumShared += First->Pages[Page] == Second->Pages[Page];
+	}
+	EXPECT_EQ( NumShared, Mem::NUM_PAGES - 2 );
+	EXPECT_NE( First->Pages[0x20], Second->Pages[0x20] );
+	EXPECT_NE( First->Pages[0x30], Second->Pages[0x30] );
+	EXPECT_EQ( First->Pages[0x20]->Bytes[0], 0 );
+	EXPECT_EQ( Second->Pages[0x20]->Bytes[0], 1 );
+}
+
+TEST_F( M6502SnapshotTests, ASnapshotCanBeRestoredManyTimes )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	std::shared_ptr<const Snapshot> Boot = Snapshots.Take( cpu );
+
+	for ( s32 Run = 1; Run <= 4; Run++ )
+	{
+		// when:
+		Snapshots.Restore( Boot, cpu );
+		cpu.Execute( Run * 16, mem );
+
+		// then:
+		EXPECT_EQ( mem[0x2000], Run );
+		EXPECT_EQ( cpu.X, Run );
+	}
+}
+
+TEST_F( M6502SnapshotTests, RestoringASiblingSnapshotCopiesWhereTheyDiffer )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	std::shared_ptr<const Snapshot> Boot = Snapshots.Take( cpu );
+	mem[0x4000] = 0x11;
+	std::shared_ptr<const Snapshot> Left = Snapshots.Take( cpu );
+	Snapshots.Restore( Boot, cpu );
+	mem[0x5000] = 0x22;
+	std::shared_ptr<const Snapshot> Right = Snapshots.Take( cpu );
+
+	// when:
+	Snapshots.Restore( Left, cpu );
+
+	// then:
+	EXPECT_EQ( mem.NumDirtyPages(), 0u );
+	EXPECT_EQ( mem.Data[0x4000], 0x11 );
+	EXPECT_EQ( mem.Data[0x5000], 0 );
+}
+
+TEST_F( M6502SnapshotTests, AnotherMachineCanRestoreTheSnapshot )
+{
+	// given:
+	using namespace m6502;
+	LoadProgram();
+	cpu.Execute( 1000, mem );
+	std::shared_ptr<const Snapshot> Saved = Snapshots.Take( cpu );
+	Mem OtherMem;
+	CPU OtherCPU;
+	Snapshotter OtherSnapshots;
+	OtherSnapshots.Attach( OtherMem );
+
+	// when:
+	OtherSnapshots.Restore( Saved, OtherCPU );
+	const s32 Cycles = cpu.Execute( 100, mem );
+	const s32 OtherCycles = OtherCPU.Execute( 100, OtherMem );
+
+	// then:
+	EXPECT_EQ( OtherCycles, Cycles );
+	EXPECT_EQ( OtherCPU.PC, cpu.PC );
+	EXPECT_EQ( memcmp( mem.Data, OtherMem.Data, Mem::MAX_MEM ), 0 );
+}
+
+TEST_F( M6502SnapshotTests, RestoringInvalidatesTheCachedCode )
+{
+	// given:
+	using namespace m6502;
+	DecodeCache Cache;
+	Cache.Attach( mem );
+	cpu.Reset( 0x1000, mem );
+	mem[0x1000] = CPU::INS_LDA_IM;
+	mem[0x1001] = 0x42;
+	std::shared_ptr<const Snapshot> Saved = Snapshots.Take( cpu );
+	mem[0x1001] = 0x43;
+	Cache.Flush();
+	cpu.ExecuteCached( 2, mem );
+	EXPECT_EQ( cpu.A, 0x43 );
+
+	// when:
+	Snapshots.Restore( Saved, cpu );
+	cpu.ExecuteCached( 2, mem );
+
+	// then:
+	EXPECT_EQ( cpu.A, 0x42 );
+}
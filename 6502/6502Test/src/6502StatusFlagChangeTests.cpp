@@ -185,3 +185,73 @@ TEST_F( M6502StatusFlagChangeTests, CLVWillClearTheOverflowFlag )
 	EXPECT_EQ( cpu.Flag.N, CPUCopy.Flag.N );
 }
 
+TEST_F( M6502StatusFlagChangeTests, GetPSPacksTheFlagsInTheirBitOrder )
+{
+	// given:
+	using namespace m6502;
+	cpu.Flag.C = true;
+	cpu.Flag.D = true;
+	cpu.Flag.V = true;
+	cpu.Flag.N = true;
+
+	// when:
+	const Byte PS = cpu.GetPS();
+
+	// then:
+	EXPECT_EQ( PS, 0b11001001 );
+	EXPECT_EQ( cpu.PS, 0b11001001 );
+}
+
+TEST_F( M6502StatusFlagChangeTests, SetPSSetsEveryFlag )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	cpu.SetPS( 0b00110110 );
+
+	// then:
+	EXPECT_FALSE( cpu.Flag.C );
+	EXPECT_TRUE( cpu.Flag.Z );
+	EXPECT_TRUE( cpu.Flag.I );
+	EXPECT_FALSE( cpu.Flag.D );
+	EXPECT_TRUE( cpu.Flag.B );
+	EXPECT_TRUE( cpu.Flag.Unused );
+	EXPECT_FALSE( cpu.Flag.V );
+	EXPECT_FALSE( cpu.Flag.N );
+}
+
+TEST_F( M6502StatusFlagChangeTests, AssigningPSSetsTheFlagsLikeSetPS )
+{
+	// given:
+	using namespace m6502;
+
+	// when:
+	cpu.PS = 0b10000011;
+
+	// then:
+	EXPECT_TRUE( cpu.Flag.C );
+	EXPECT_TRUE( cpu.Flag.Z );
+	EXPECT_TRUE( cpu.Flag.N );
+	EXPECT_FALSE( cpu.Flag.I );
+	EXPECT_EQ( cpu.GetPS(), 0b10000011 );
+}
+
+TEST_F( M6502StatusFlagChangeTests, AssigningPSFromAnotherCPUCopiesItsFlags )
+{
+	// given:
+	using namespace m6502;
+	CPU Other;
+	Other.Reset( 0xFF00 );
+	Other.SetPS( 0b01000101 );
+
+	// when:
+	cpu.PS = Other.PS;
+
+	// then:
+	EXPECT_TRUE( cpu.Flag.C );
+	EXPECT_TRUE( cpu.Flag.I );
+	EXPECT_TRUE( cpu.Flag.V );
+	EXPECT_FALSE( cpu.Flag.Z );
+	EXPECT_EQ( cpu.PS, 0b01000101 );
+}
@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "m6502.h"
+#include "m6502_trace.h"
+
+class M6502TraceTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	std::string Path;
+
+	virtual void SetUp()
+	{
+		using namespace m6502;
+		Path = testing::TempDir() + "M6502TraceTests.m6tr";
+		cpu.Reset( 0x1000, mem );
+		/*
+		* = $1000
+			ldx #$00
+		loop
+			txa
+			sta $2000,x
+			adc #$03
+			inx
+			bne loop
+			jsr sub
+			jmp $1000
+		sub
+			rts
+		*/
+		Byte Program[] = {
+			0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x20, 0x69, 0x03, 0xE8, 0xD0, 0xF7,
+			0x20, 0x11, 0x10, 0x4C, 0x00, 0x10, 0x60 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			mem[0x1000 + i] = Program[i];
+		}
+	}
+
+	virtual void TearDown()
+	{
+		remove( Path.c_str() );
+	}
+
+	/** The records of running the same code an instruction at a time */
+	std::vector<m6502::TraceRecord> Reference( m6502::s32 Cycles )
+	{
+		using namespace m6502;
+		Mem ReferenceMem = mem;
+		CPU ReferenceCPU = cpu;
+		std::vector<TraceRecord> Records;
+		while ( Cycles > 0 )
+		{
+			TraceRecord Record = {};
+			Record.Cycle = ReferenceCPU.TotalCycles;
+			Record.PC = ReferenceCPU.PC;
+			Record.Opcode = ReferenceMem[Record.PC];
+			Record.A = ReferenceCPU.A;
+			Record.X = ReferenceCPU.X;
+			Record.Y = ReferenceCPU.Y;
+			Record.SP = ReferenceCPU.SP;
+			Record.PS = ReferenceCPU.GetPS();
+			Records.push_back( Record );
+			Cycles -= ReferenceCPU.ExecuteTable( 1, ReferenceMem );
+		}
+		return Records;
+	}
+};
+
+TEST_F( M6502TraceTests, TheRingPopsWhatWasPushedInOrderUntilItIsFull )
+{
+	// given:
+	using namespace m6502;
+	TraceRing Ring( 3 );
+	TraceRecord Record = {};
+
+	// when:
+	bool Pushed[5];
+	for ( Word i = 0; i < 5; i++ )
+	{
+		Record.PC = i;
+		Pushed[i] = Ring.TryPush( Record );
+	}
+	TraceRecord Popped[8];
+	const u32 NumPopped = Ring.Pop( Popped, 8 );
+
+	// then:
+	EXPECT_EQ( Ring.Records.size(), 4u );
+	EXPECT_TRUE( Pushed[3] );
+	EXPECT_FALSE( Pushed[4] );
+	ASSERT_EQ( NumPopped, 4u );
+	for ( Word i = 0; i < 4; i++ )
+	{
+		EXPECT_EQ( Popped[i].PC, i );
+	}
+	EXPECT_TRUE( Ring.IsEmpty() );
+	EXPECT_TRUE( Ring.TryPush( Record ) );
+}
+
+TEST_F( M6502TraceTests, WithoutATracerItRunsLikeExecuteTable )
+{
+	// given:
+	using namespace m6502;
+	Mem ReferenceMem = mem;
+	CPU ReferenceCPU = cpu;
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteTrace( 5000, mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, ReferenceCPU.ExecuteTable( 5000, ReferenceMem ) );
+	EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+	EXPECT_EQ( cpu.A, ReferenceCPU.A );
+	EXPECT_EQ( cpu.TotalCycles, ReferenceCPU.TotalCycles );
+}
+
+TEST_F( M6502TraceTests, WithATracerThatIsntOpenItRunsLikeExecuteTable )
+{
+	// given:
+	using namespace m6502;
+	Mem ReferenceMem = mem;
+	CPU ReferenceCPU = cpu;
+	Tracer Trace( 64 );
+	Trace.Attach( mem );
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteTrace( 10000, mem );
+
+	// then:
+	EXPECT_EQ( CyclesUsed, ReferenceCPU.ExecuteTable( 10000, ReferenceMem ) );
+	EXPECT_EQ( cpu.PC, ReferenceCPU.PC );
+	EXPECT_EQ( Trace.NumStalls, 0u );
+}
+
+TEST_F( M6502TraceTests, TheTraceReadsBackAsEveryInstructionThatRan )
+{
+	// given:
+	using namespace m6502;
+	const std::vector<TraceRecord> Expected = Reference( 5000 );
+	Tracer Trace;
+	Trace.Attach( mem );
+	ASSERT_TRUE( Trace.Open( Path.c_str() ) );
+
+	// when:
+	cpu.ExecuteTrace( 5000, mem );
+	Trace.Close();
+	TraceReader Reader;
+	ASSERT_TRUE( Reader.Load( Path.c_str() ) );
+
+	// then:
+	EXPECT_EQ( Trace.NumRecords, Expected.size() );
+	TraceRecord Record;
+	for ( const TraceRecord& Want : Expected )
+	{
+		ASSERT_TRUE( Reader.Next( Record ) );
+		EXPECT_EQ( Record.Cycle, Want.Cycle );
+		EXPECT_EQ( Record.PC, Want.PC );
+		EXPECT_EQ( Record.Opcode, Want.Opcode );
+		EXPECT_EQ( Record.A, Want.A );
+		EXPECT_EQ( Record.X, Want.X );
+		EXPECT_EQ( Record.Y, Want.Y );
+		EXPECT_EQ( Record.SP, Want.SP );
+		EXPECT_EQ( Record.PS, Want.PS );
+	}
+	EXPECT_FALSE( Reader.Next( Record ) );
+}
+
+TEST_F( M6502TraceTests, ARunThatThrowsStillTracesUpToTheIllegalOpcode )
+{
+	// given:
+	using namespace m6502;
+	cpu.Reset( 0x1100 );
+	mem[0x1100] = CPU::INS_INX;
+	mem[0x1101] = CPU::INS_INY;
+	mem[0x1102] = 0x02;		// illegal
+	Tracer Trace;
+	Trace.Attach( mem );
+	ASSERT_TRUE( Trace.Open( Path.c_str() ) );
+
+	// when:
+	EXPECT_ANY_THROW( cpu.ExecuteTrace( 1000, mem ) );
+	Trace.Close();
+	TraceReader Reader;
+	ASSERT_TRUE( Reader.Load( Path.c_str() ) );
+
+	// then:
+	EXPECT_EQ( Trace.NumRecords, 3u );
+	TraceRecord Record;
+	ASSERT_TRUE( Reader.Next( Record ) );
+	EXPECT_EQ( Record.PC, 0x1100 );
+	ASSERT_TRUE( Reader.Next( Record ) );
+	EXPECT_EQ( Record.PC, 0x1101 );
+	ASSERT_TRUE( Reader.Next( Record ) );
+	EXPECT_EQ( Record.PC, 0x1102 );
+	EXPECT_EQ( Record.Opcode, 0x02 );
+	EXPECT_EQ( Record.X, 1 );
+	EXPECT_EQ( Record.Y, 1 );
+	EXPECT_FALSE( Reader.Next( Record ) );
+}
+
+TEST_F( M6502TraceTests, ALoopTakesAFewBytesAnInstruction )
+{
+	// given:
+	using namespace m6502;
+	Tracer Trace;
+	Trace.Attach( mem );
+	ASSERT_TRUE( Trace.Open( Path.c_str() ) );
+
+	// when:
+	cpu.ExecuteTrace( 100000, mem );
+	Trace.Close();
+
+	// then:
+	EXPECT_GT( Trace.NumRecords, 20000u );
+	EXPECT_LT( Trace.NumBytes, Trace.NumRecords * 4 );
+}
+
+TEST_F( M6502TraceTests, NothingIsDroppedWhenTheRingIsFull )
+{
+	// given:
+	using namespace m6502;
+	const std::vector<TraceRecord> Expected = Reference( 20000 );
+	Tracer Trace( 2 );
+	Trace.Attach( mem );
+	ASSERT_TRUE( Trace.Open( Path.c_str() ) );
+
+	// when:
+	cpu.ExecuteTrace( 20000, mem );
+	Trace.Close();
+	TraceReader Reader;
+	ASSERT_TRUE( Reader.Load( Path.c_str() ) );
+
+	// then:
+	EXPECT_EQ( Trace.NumRecords, Expected.size() );
+	TraceRecord Record;
+	u64 NumRead = 0;
+	while ( Reader.Next( Record ) )
+	{
+		NumRead++;
+	}
+	EXPECT_EQ( NumRead, Expected.size() );
+	EXPECT_EQ( Record.Cycle, Expected.back().Cycle );
+}
+
+TEST_F( M6502TraceTests, ARecordFormatsAsALineOfText )
+{
+	// given:
+	using namespace m6502;
+	TraceRecord Store = { 1234, 0x1003, CPU::INS_STA_ABSX, { 0x00, 0x20 }, 0x42, 0x01, 0x00, 0xFF, 0x24 };
+	TraceRecord Branch = { 1240, 0x1009, CPU::INS_BNE, { 0xF7, 0x00 }, 0x45, 0x02, 0x00, 0xFF, 0x24 };
+	TraceRecord Implied = { 1238, 0x1008, CPU::INS_INX, { 0x00, 0x00 }, 0x45, 0x01, 0x00, 0xFF, 0x24 };
+
+	// when:
+	// then:
+	EXPECT_EQ( TraceReader::Format( Store ),
+		"      1234  1003  9D 00 20  STA $2000,X   A:42 X:01 Y:00 SP:FF NV-BDIZC:00100100" );
+	EXPECT_EQ( TraceReader::Format( Branch ),
+		"      1240  1009  D0 F7     BNE $1002     A:45 X:02 Y:00 SP:FF NV-BDIZC:00100100" );
+	EXPECT_EQ( TraceReader::Format( Implied ),
+		"      1238  1008  E8        INX           A:45 X:01 Y:00 SP:FF NV-BDIZC:00100100" );
+}
+
+TEST_F( M6502TraceTests, AFileThatIsntATraceDoesntLoad )
+{
+	// given:
+	using namespace m6502;
+	FILE* File = fopen( Path.c_str(), "wb" );
+	ASSERT_NE( File, nullptr );
+	fputs( "not a trace", File );
+	fclose( File );
+
+	// when:
+	TraceReader Reader;
+	const bool Loaded = Reader.Load( Path.c_str() );
+
+	// then:
+	EXPECT_FALSE( Loaded );
+	TraceRecord Record;
+	EXPECT_FALSE( Reader.Next( Record ) );
+}
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include "m6502.h"
+#include "m6502_watch.h"
+
+class M6502WatchpointTests : public testing::Test
+{
+public:
+	m6502::Mem mem;
+	m6502::CPU cpu;
+	m6502::Watchpoints Watch;
+
+	virtual void SetUp()
+	{
+		using namespace m6502;
+		cpu.Reset( 0x1000, mem );
+		/*
+		* = $1000
+		loop
+			lda $2010
+			sta $3020
+			inc $3021
+			inx
+			jmp loop
+		*/
+		Byte Program[] = {
+			0xAD, 0x10, 0x20, 0x8D, 0x20, 0x30, 0xEE, 0x21, 0x30, 0xE8, 0x4C, 0x00, 0x10 };
+		for ( u32 i = 0; i < sizeof( Program ); i++ )
+		{
+			mem[0x1000 + i] = Program[i];
+		}
+		mem[0x2010] = 0x42;
+		mem[0x3020] = 0x17;
+		Watch.Attach( cpu, mem );
+	}
+
+	virtual void TearDown()
+	{
+	}
+};
+
+TEST_F( M6502WatchpointTests, AWriteWatchpointRecordsTheOldAndNewValues )
+{
+	// given:
+	using namespace m6502;
+	Watch.Add( 0x3020, 0x3020, Watchpoints::WATCH_WRITE );
+
+	// when:
+	cpu.ExecuteTable( 4 + 4, mem );
+
+	// then:
+	ASSERT_EQ( Watch.Hits.size(), 1u );
+	EXPECT_TRUE( Watch.Hits[0].Write );
+	EXPECT_EQ( Watch.Hits[0].Address, 0x3020 );
+	EXPECT_EQ( Watch.Hits[0].OldValue, 0x17 );
+	EXPECT_EQ( Watch.Hits[0].NewValue, 0x42 );
+	EXPECT_EQ( Watch.Hits[0].PC, 0x1006 );
+	EXPECT_EQ( mem[0x3020], 0x42 );
+}
+
+TEST_F( M6502WatchpointTests, AReadWatchpointRecordsTheValueRead )
+{
+	// given:
+	using namespace m6502;
+	Watch.Add( 0x2000, 0x20FF, Watchpoints::WATCH_READ );
+
+	// when:
+	cpu.ExecuteTable( 4, mem );
+
+	// then:
+	ASSERT_EQ( Watch.Hits.size(), 1u );
+	EXPECT_FALSE( Watch.Hits[0].Write );
+	EXPECT_EQ( Watch.Hits[0].Address, 0x2010 );
+	EXPECT_EQ( Watch.Hits[0].OldValue, 0x42 );
+	EXPECT_EQ( cpu.A, 0x42 );
+}
+
+TEST_F( M6502WatchpointTests, AnAccessWatchpointSeesAReadModifyWriteTwice )
+{
+	// given:
+	using namespace m6502;
+	Watch.Add( 0x3021, 0x3021, Watchpoints::WATCH_ACCESS );
+	mem[0x3021] = 0x7F;
+
+	// when:
+	cpu.ExecuteTable( 4 + 4 + 6, mem );
+
+	// then:
+	ASSERT_EQ( Watch.Hits.size(), 2u );
+	EXPECT_FALSE( Watch.Hits[0].Write );
+	EXPECT_EQ( Watch.Hits[0].OldValue, 0x7F );
+	EXPECT_TRUE( Watch.Hits[1].Write );
+	EXPECT_EQ( Watch.Hits[1].OldValue, 0x7F );
+	EXPECT_EQ( Watch.Hits[1].NewValue, 0x80 );
+	EXPECT_EQ( mem[0x3021], 0x80 );
+}
+
+TEST_F( M6502WatchpointTests, OtherAddressesInAWatchedPageAreNotRecorded )
+{
+	// given:
+	using namespace m6502;
+	Watch.Add( 0x3000, 0x301F, Watchpoints::WATCH_ACCESS );
+
+	// when:
+	cpu.ExecuteTable( 1000, mem );
+
+	// then:
+	EXPECT_TRUE( Watch.Hits.empty() );
+	EXPECT_EQ( mem[0x3020], 0x42 );
+}
+
+TEST_F( M6502WatchpointTests, OnlyTheWatchedPagesAreRouted )
+{
+	// given:
+	using namespace m6502;
+	const Mem::Page Code = mem.Pages[0x10];
+
+	// when:
+	Watch.Add( 0x3020, 0x3020, Watchpoints::WATCH_WRITE );
+	Watch.Add( 0x2010, 0x2010, Watchpoints::WATCH_READ );
+
+	// then:
+	EXPECT_EQ( mem.Pages[0x10].Read, Code.Read );
+	EXPECT_EQ( mem.Pages[0x10].Write, Code.Write );
+	EXPECT_EQ( mem.Pages[0x30].Read, &mem.Data[0x3000] );
+	EXPECT_EQ( mem.Pages[0x30].Write, nullptr );
+	EXPECT_EQ( mem.Pages[0x20].Read, nullptr );
+	EXPECT_TRUE( mem.ReadsAreFlat() == false );
+}
+
+TEST_F( M6502WatchpointTests, DetachingGivesThePagesBackTheirMapping )
+{
+	// given:
+	using namespace m6502;
+	Watch.Add( 0x2010, 0x3020, Watchpoints::WATCH_ACCESS );
+
+	// when:
+	Watch.Detach();
+	cpu.ExecuteTable( 1000, mem );
+
+	// then:
+	EXPECT_TRUE( Watch.Hits.empty() );
+	EXPECT_TRUE( mem.ReadsAreFlat() );
+	EXPECT_EQ( mem.Pages[0x30].Write, &mem.Data[0x3000] );
+}
+
+TEST_F( M6502WatchpointTests, ExecuteDebugStopsAfterTheBlockThatHitOne )
+{
+	// given:
+	using namespace m6502;
+	BlockCache Blocks;
+	Blocks.Attach( mem );
+	Watch.StopOnHit = true;
+	Watch.Add( 0x3020, 0x3020, Watchpoints::WATCH_WRITE );
+
+	// when:
+	const s32 CyclesUsed = cpu.ExecuteDebug( 1000, mem );
+
+	// then:
+	EXPECT_EQ( cpu.LastStop, CPU::StopReason::Watchpoint );
+	EXPECT_EQ( CyclesUsed, 4 + 4 + 6 + 2 + 3 );
+	EXPECT_EQ( cpu.PC, 0x1000 );
+	ASSERT_EQ( Watch.Hits.size(), 1u );
+	EXPECT_EQ( Watch.Hits[0].Cycle, 0u );	// TotalCycles as the block started
+	EXPECT_EQ( cpu.TotalCycles, (u64)CyclesUsed );
+}
+
+TEST_F( M6502WatchpointTests, AWriteToAWatchedRomIsStillIgnored )
+{
+	// given:
+	using namespace m6502;
+	Watch.Detach();
+	mem.MapRom( 0x30 );
+	Watch.Attach( cpu, mem );
+	Watch.Add( 0x3020, 0x3020, Watchpoints::WATCH_WRITE );
+
+	// when:
+	cpu.ExecuteTable( 4 + 4, mem );
+
+	// then:
+	ASSERT_EQ( Watch.Hits.size(), 1u );
+	EXPECT_EQ( Watch.Hits[0].OldValue, 0x17 );
+	EXPECT_EQ( mem[0x3020], 0x17 );
+}
+
+TEST_F( M6502WatchpointTests, AWriteWatchpointOnADevicePageStillReadsTheDevice )
+{
+	// given:
+	using namespace m6502;
+	struct Device
+	{
+		Byte Register = 0x5A;
+		static Byte Read( void* Context, Word ) { return static_cast<Device*>( Context )->Register; }
+		static void Write( void* Context, Word, Byte Value ) { static_cast<Device*>( Context )->Register = Value; }
+	} Chip;
+	Watch.Detach();
+	mem.MapDevice( 0xD0, 1, &Device::Read, &Device::Write, &Chip );
+	Watch.Add( 0xD000, 0xD000, Watchpoints::WATCH_WRITE );
+	Watch.Attach( cpu, mem );
+	cpu.Reset( 0x1100 );
+	/*
+	* = $1100
+		lda $d000
+		sta $d000
+	*/
+	Byte Program[] = { 0xAD, 0x00, 0xD0, 0x8D, 0x00, 0xD0 };
+	for ( u32 i = 0; i < sizeof( Program ); i++ )
+	{
+		mem[0x1100 + i] = Program[i];
+	}
+	cpu.A = 0;
+
+	// when:
+	cpu.ExecuteTable( 4, mem );
+	const Byte Read = cpu.A;
+	cpu.A = 0x33;
+	cpu.ExecuteTable( 4, mem );
+
+	// then:
+	EXPECT_EQ( Read, 0x5A );
+	EXPECT_EQ( Chip.Register, 0x33 );
+	ASSERT_EQ( Watch.Hits.size(), 1u );
+	EXPECT_TRUE( Watch.Hits[0].Write );
+	EXPECT_EQ( Watch.Hits[0].NewValue, 0x33 );
+}
+
+TEST_F( M6502WatchpointTests, EveryEngineRunsCodeFromAReadWatchedPage )
+{
+	// given:
+	using namespace m6502;
+	using ExecuteFunction = s32 (CPU::*)( s32, Mem& );
+	std::unique_ptr<DecodeCache> Cache( new DecodeCache );
+	std::unique_ptr<BlockCache> Blocks( new BlockCache );
+	Cache->Attach( mem );
+	Blocks->Attach( mem );
+	Blocks->JitThreshold = 1;
+	/*
+	* = $1100
+	loop
+		lda $11f0	; watched, in the code's own page
+		inx
+		jmp loop
+	*/
+	Byte Program[] = { 0xAD, 0xF0, 0x11, 0xE8, 0x4C, 0x00, 0x11 };
+	for ( u32 i = 0; i < sizeof( Program ); i++ )
+	{
+		mem[0x1100 + i] = Program[i];
+	}
+	mem[0x11F0] = 0x42;
+	Watch.Add( 0x11F0, 0x11F0, Watchpoints::WATCH_READ );
+
+	// when:
+	// then:
+	for ( ExecuteFunction Engine : { &CPU::ExecuteTable, &CPU::ExecuteCached, &CPU::ExecuteBlocks,
+		&CPU::ExecuteJit, &CPU::ExecuteDebug } )
+	{
+		cpu.Reset( 0x1100 );
+		Watch.Hits.clear();
+		const s32 CyclesUsed = (cpu.*Engine)( 9 * 10, mem );
+
+		EXPECT_EQ( CyclesUsed, 9 * 10 );
+		EXPECT_EQ( cpu.PC, 0x1100 );
+		EXPECT_EQ( cpu.A, 0x42 );
+		EXPECT_EQ( cpu.X, 10 );
+		EXPECT_EQ( Watch.Hits.size(), 10u );
+	}
+}